@@ -1,10 +1,214 @@
 #include "ImageViewer.h"
 #include <qevent.h>
 #include <qpainter.h>
+#include <QPainterPath>
+#include <QThread>
+#include <QCache>
+#include <QHash>
 #include <set>
 #include <stack>
+#include <iostream>
 #include "util.h"
 #include "global_data_holder.h"
+#include "conv\Contour.h"
+#include "conv\Overlay.h"
+#include "conv\Resample.h"
+
+// the ids of a label mask and their outlines, a path of its pixels per id
+struct LabelMaskPaths
+{
+	QSize size;
+	ldp::MaskImage ids;
+	std::vector<int> labels;
+	std::vector<QPainterPath> paths;
+};
+
+// the most recently used masks, by their approximate bytes
+static QCache<QString, LabelMaskPaths> g_labelMaskPaths(1 << 27);
+
+static std::vector<QRgb> gen_color_table();
+
+class LabelMaskThread : public QThread
+{
+public:
+	LabelMaskThread(QString path) : m_path(path), m_paths(nullptr), m_bytes(0){}
+	~LabelMaskThread(){ delete m_paths; }
+	QString path()const { return m_path; }
+	// the outlines once finished, owned by the caller then; null if the mask cannot be read
+	LabelMaskPaths* takePaths(int& bytes)
+	{
+		LabelMaskPaths* paths = m_paths;
+		m_paths = nullptr;
+		bytes = m_bytes;
+		return paths;
+	}
+protected:
+	virtual void run()
+	{
+		try
+		{
+			QImage img(m_path);
+			if (img.isNull())
+				throw std::exception(("invalid label mask: " + m_path).toStdString().c_str());
+
+			// ids by the palette index, or the level of gray masks; other masks get an id per color, in the
+			// order met, black being the background 0
+			ldp::MaskImage ids;
+			ids.resize(ldp::Int2(img.width(), img.height()));
+			bool gray = true;
+			if (img.format() != QImage::Format_Indexed8)
+			{
+				img = img.convertToFormat(QImage::Format_RGB32);
+				for (int y = 0; y < img.height() && gray; y++)
+				{
+					const QRgb* src = (const QRgb*)img.constScanLine(y);
+					for (int x = 0; x < img.width() && gray; x++)
+						gray = qRed(src[x]) == qGreen(src[x]) && qGreen(src[x]) == qBlue(src[x]);
+				}
+			}
+			QHash<QRgb, int> colorIds;
+			colorIds.insert(qRgb(0, 0, 0), 0);
+			QRgb lastColor = qRgb(0, 0, 0);
+			int lastId = 0;
+			for (int y = 0; y < img.height(); y++)
+			{
+				unsigned char* dst = ids.data_XY(0, y);
+				if (img.format() == QImage::Format_Indexed8)
+				{
+					memcpy(dst, img.constScanLine(y), img.width());
+					continue;
+				}
+				const QRgb* src = (const QRgb*)img.constScanLine(y);
+				for (int x = 0; x < img.width(); x++)
+				{
+					if (gray)
+					{
+						dst[x] = (unsigned char)qBlue(src[x]);
+						continue;
+					}
+					if (src[x] != lastColor)
+					{
+						auto iter = colorIds.find(src[x]);
+						if (iter == colorIds.end())
+						{
+							if (colorIds.size() > 255)
+								throw std::exception(("more than 256 labels in: " + m_path).toStdString().c_str());
+							iter = colorIds.insert(src[x], colorIds.size());
+						}
+						lastColor = src[x];
+						lastId = iter.value();
+					}
+					dst[x] = (unsigned char)lastId;
+				}
+			}
+
+			std::vector<ldp::LabelContours> contours;
+			ldp::extractLabelContours(ids, contours);
+			LabelMaskPaths* paths = new LabelMaskPaths();
+			paths->size = img.size();
+			paths->ids.swap(ids);
+			m_bytes = img.width() * img.height();
+			for (const auto& lc : contours)
+			{
+				QPainterPath path;
+				path.setFillRule(Qt::OddEvenFill);
+				const ldp::Float2* v = lc.verts.data();
+				for (int n : lc.contourSizes)
+				{
+					path.moveTo(v[0][0], v[0][1]);
+					for (int i = 1; i < n; i++)
+						path.lineTo(v[i][0], v[i][1]);
+					path.closeSubpath();
+					v += n;
+				}
+				paths->labels.push_back(lc.label);
+				paths->paths.push_back(path);
+				m_bytes += (int)lc.verts.size() * 2 * sizeof(QPainterPath::Element);
+			}
+			m_paths = paths;
+		} catch (const std::exception& e)
+		{
+			std::cout << e.what() << std::endl;
+		}
+	}
+private:
+	QString m_path;
+	LabelMaskPaths* m_paths;
+	int m_bytes;
+};
+
+// tiles of the pyramid levels, drawn only when in view
+const static int g_colorTileSize = 256;
+
+// the next level of a pyramid of RGB32 images, half the size by the area filter
+static QImage pyramid_next_level(const QImage& level)
+{
+	QImage next((level.width() + 1) / 2, (level.height() + 1) / 2, level.format());
+	ldp::resampleImage(next.bits(), next.width(), next.height(), next.bytesPerLine(), level.constBits(),
+		level.width(), level.height(), level.bytesPerLine(), 4, ldp::ResampleArea);
+	return next;
+}
+
+// level k is 1/2^k of the image, the one nearest the view @scale in octaves
+static int pyramid_level(float scale)
+{
+	return scale < 1.f ? (int)floor(log2(1.0 / scale) + 0.5) : 0;
+}
+
+class ImagePyramidThread : public QThread
+{
+public:
+	// @currentId: the id of the image in view, the thread stops once it is not @imageId
+	ImagePyramidThread(const QImage& img, QString fileName, int imageId, const QAtomicInt* currentId)
+		: m_image(img), m_fileName(fileName), m_imageId(imageId), m_currentId(currentId){}
+	int imageId()const { return m_imageId; }
+	// null if @img is the full image already
+	const QImage& fullImage()const { return m_fullImage; }
+	const QVector<QImage>& levels()const { return m_levels; }
+protected:
+	// each level from the previous by the area filter, halving down to a single tile; alpha is
+	// premultiplied for the averages to be right. stale images, E.G., when holding an arrow key, are
+	// neither decoded nor built further
+	virtual void run()
+	{
+		try
+		{
+			if (isStale())
+				return;
+			if (!m_fileName.isEmpty())
+			{
+				QImage full = PatternImageInfo::getImage(m_fileName);
+				if (full.width() > m_image.width() || full.height() > m_image.height())
+					m_image = m_fullImage = full;
+			}
+			QImage level = m_image.convertToFormat(m_image.hasAlphaChannel() ?
+				QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+			m_levels.push_back(level);
+			while (level.width() > g_colorTileSize || level.height() > g_colorTileSize)
+			{
+				if (isStale())
+				{
+					m_levels.clear();
+					return;
+				}
+				level = pyramid_next_level(level);
+				m_levels.push_back(level);
+			}
+		} catch (const std::exception& e)
+		{
+			std::cout << e.what() << std::endl;
+			m_levels.clear();
+		}
+	}
+	bool isStale()const { return m_currentId->load() != m_imageId; }
+private:
+	QImage m_image;
+	QString m_fileName;
+	int m_imageId;
+	const QAtomicInt* m_currentId;
+	QImage m_fullImage;
+	QVector<QImage> m_levels;
+};
 
 ImageViewer::ImageViewer(QWidget* parent)
 :QWidget(parent)
@@ -12,10 +216,34 @@ ImageViewer::ImageViewer(QWidget* parent)
 	setMouseTracking(true);
 	setBackgroundRole(QPalette::ColorRole::Dark);
 	setAutoFillBackground(true);
+	m_colorImageId.store(0);
+
+	// the colors of gen_color_table(), the background transparent
+	m_labelOverlay = new ldp::LabelOverlay();
+	m_labelOverlayValid = false;
+	std::vector<QRgb> colors = gen_color_table();
+	for (int i = 0; i < 256; i++)
+	{
+		m_labelOverlay->setColor(i, colors[i % colors.size()]);
+		m_labelOverlay->setAlpha(i, i ? 255 : 0);
+	}
+	m_labelOverlay->setOpacity(0.5f);
 }
 
 ImageViewer::~ImageViewer()
 {
+	delete m_labelOverlay;
+	for (auto thread : m_labelMaskThreads)
+	{
+		thread->wait();
+		delete thread;
+	}
+	m_colorImageId.ref();
+	for (auto thread : m_colorPyramidThreads)
+	{
+		thread->wait();
+		delete thread;
+	}
 }
 
 void ImageViewer::setViewType(ViewType type)
@@ -29,11 +257,37 @@ ImageViewer::ViewType ImageViewer::getViewType()const
 	return m_viewType;
 }
 
-void ImageViewer::setColorImage(const QImage& img)
+void ImageViewer::setColorImage(const QImage& img, QString fileName)
 {
 	m_colorImage = img;
+	m_labelOverlayValid = false;
+	m_colorPyramid.clear();
+	m_colorImageId.ref();
 	updateViewRect();
 	setViewType(ViewColorImage);
+	if (img.width() <= g_colorTileSize && img.height() <= g_colorTileSize && fileName.isEmpty())
+		return;
+
+	// previous images still being built stop at their next level and are dropped
+	ImagePyramidThread* thread = new ImagePyramidThread(img, fileName, m_colorImageId.load(), &m_colorImageId);
+	m_colorPyramidThreads.push_back(thread);
+	connect(thread, &QThread::finished, this, [this, thread]()
+	{
+		m_colorPyramidThreads.removeOne(thread);
+		if (thread->imageId() == m_colorImageId.load())
+		{
+			// the view rect is kept, thus the view scale follows the new size
+			if (!thread->fullImage().isNull())
+			{
+				m_colorImage = thread->fullImage();
+				m_labelOverlayValid = false;
+			}
+			m_colorPyramid = thread->levels();
+		}
+		thread->deleteLater();
+		update();
+	});
+	thread->start();
 }
 
 const QImage* ImageViewer::getColorImage()const
@@ -41,6 +295,38 @@ const QImage* ImageViewer::getColorImage()const
 	return &m_colorImage;
 }
 
+void ImageViewer::setLabelMask(QString path)
+{
+	if (path != m_labelMaskPath)
+		m_labelOverlayValid = false;
+	m_labelMaskPath = path;
+	update();
+	if (path.isEmpty() || g_labelMaskPaths.contains(path))
+		return;
+	for (auto thread : m_labelMaskThreads)
+	if (thread->path() == path)
+		return;
+
+	LabelMaskThread* thread = new LabelMaskThread(path);
+	m_labelMaskThreads.push_back(thread);
+	connect(thread, &QThread::finished, this, [this, thread]()
+	{
+		m_labelMaskThreads.removeOne(thread);
+		int bytes = 0;
+		LabelMaskPaths* paths = thread->takePaths(bytes);
+		if (paths)
+			g_labelMaskPaths.insert(thread->path(), paths, std::max(1, bytes));
+		thread->deleteLater();
+		update();
+	});
+	thread->start();
+}
+
+QString ImageViewer::getLabelMask()const
+{
+	return m_labelMaskPath;
+}
+
 static std::vector<QRgb> gen_color_table()
 {
 	std::vector<QRgb> table;
@@ -134,13 +420,117 @@ void ImageViewer::paintEvent(QPaintEvent* ev)
 	switch (m_viewType)
 	{
 	case ImageViewer::ViewColorImage:
-		painter.drawImage(m_viewRect, m_colorImage);
+		drawColorImage(painter);
+		drawMaskAsPath(painter);
+		break;
+	case ImageViewer::ViewLabelOverlay:
+		drawLabelOverlay(painter);
 		break;
 	default:
 		break;
 	}
 }
 
+void ImageViewer::drawColorImage(QPainter& painter)
+{
+	if (m_colorImage.isNull() || m_viewRect.isEmpty())
+		return;
+
+	if (m_colorPyramid.isEmpty())
+		drawImageTiles(painter, m_colorImage);
+	else
+		drawImageTiles(painter, m_colorPyramid[std::min(m_colorPyramid.size() - 1, pyramid_level(getViewScale()))]);
+}
+
+void ImageViewer::drawImageTiles(QPainter& painter, const QImage& level)
+{
+	if (level.isNull() || m_viewRect.isEmpty())
+		return;
+
+	// the tiles in view only, by their level pixels
+	const double sx = m_viewRect.width() / level.width(), sy = m_viewRect.height() / level.height();
+	const QRectF visible = m_viewRect.intersected(QRectF(rect()));
+	if (visible.isEmpty())
+		return;
+	const int tx0 = std::max(0, (int)floor((visible.left() - m_viewRect.left()) / sx / g_colorTileSize));
+	const int ty0 = std::max(0, (int)floor((visible.top() - m_viewRect.top()) / sy / g_colorTileSize));
+	const int tx1 = std::min((level.width() - 1) / g_colorTileSize,
+		(int)floor((visible.right() - m_viewRect.left()) / sx / g_colorTileSize));
+	const int ty1 = std::min((level.height() - 1) / g_colorTileSize,
+		(int)floor((visible.bottom() - m_viewRect.top()) / sy / g_colorTileSize));
+	for (int ty = ty0; ty <= ty1; ty++)
+	for (int tx = tx0; tx <= tx1; tx++)
+	{
+		const QRect tile = QRect(tx * g_colorTileSize, ty * g_colorTileSize, g_colorTileSize, g_colorTileSize)
+			.intersected(level.rect());
+		const QRectF target(m_viewRect.left() + tile.left() * sx, m_viewRect.top() + tile.top() * sy,
+			tile.width() * sx, tile.height() * sy);
+		painter.drawImage(target, level, tile);
+	}
+}
+
+void ImageViewer::drawMaskAsPath(QPainter& painter)
+{
+	if (m_labelMaskPath.isEmpty())
+		return;
+	const LabelMaskPaths* paths = g_labelMaskPaths.object(m_labelMaskPath);
+	if (paths == nullptr || paths->size.isEmpty())
+		return;
+
+	// the mask covers the color image
+	painter.save();
+	painter.setRenderHint(QPainter::Antialiasing);
+	painter.translate(m_viewRect.topLeft());
+	painter.scale(m_viewRect.width() / paths->size.width(), m_viewRect.height() / paths->size.height());
+	for (size_t i = 0; i < paths->paths.size(); i++)
+	{
+		QColor color(m_labelOverlay->getColor(paths->labels[i]));
+		QPen pen(color, 1.5);
+		pen.setCosmetic(true);
+		painter.setPen(pen);
+		color.setAlpha(80);
+		painter.setBrush(color);
+		painter.drawPath(paths->paths[i]);
+	}
+	painter.restore();
+}
+
+void ImageViewer::drawLabelOverlay(QPainter& painter)
+{
+	const LabelMaskPaths* paths = m_labelMaskPath.isEmpty() ? nullptr : g_labelMaskPaths.object(m_labelMaskPath);
+	if (paths == nullptr || paths->size != m_colorImage.size())
+	{
+		drawColorImage(painter);
+		return;
+	}
+	if (!m_labelOverlayValid)
+	{
+		QImage img = m_colorImage.convertToFormat(QImage::Format_RGB32);
+		ldp::Rgb32Image rgb((unsigned int*)img.bits(), img.width(), img.height(), img.bytesPerLine() / 4);
+		m_overlayPyramid.clear();
+		m_labelOverlay->setImages(rgb, paths->ids);
+		m_labelOverlayValid = true;
+	}
+
+	// only the tiles of the labels whose alpha changed are blended again, and the coarser levels of the
+	// frame are then built again when zoomed out, else only the tiles in view are drawn
+	QPointF imgPt = view2image(m_mousePos);
+	int label = m_labelOverlay->labelAt((int)floor(imgPt.x()), (int)floor(imgPt.y()));
+	m_labelOverlay->setHovered(m_labelOverlay->getAlpha(label) ? label : -1);
+	if (m_labelOverlay->update() || m_overlayPyramid.isEmpty())
+	{
+		const ldp::Rgb32Image& frame = m_labelOverlay->frame();
+		m_overlayPyramid.clear();
+		m_overlayPyramid.push_back(QImage((const uchar*)frame.data(), frame.width(), frame.height(),
+			frame.stride_Y() * sizeof(unsigned int), QImage::Format_RGB32));
+	}
+	const int levelId = pyramid_level(getViewScale());
+	while (m_overlayPyramid.size() <= levelId && (m_overlayPyramid.back().width() > g_colorTileSize
+		|| m_overlayPyramid.back().height() > g_colorTileSize))
+		m_overlayPyramid.push_back(pyramid_next_level(m_overlayPyramid.back()));
+	drawImageTiles(painter, m_overlayPyramid[std::min(m_overlayPyramid.size() - 1, levelId)]);
+}
+
 void ImageViewer::resizeEvent(QResizeEvent* ev)
 {
 	updateViewRect(true);
@@ -202,5 +592,14 @@ void ImageViewer::keyPressEvent(QKeyEvent* ev)
 		setViewType(ViewType(((int)getViewType()+1)%ViewTypeEnd));
 		printf("view mode: %d\n", getViewType());
 		break;
+	case Qt::Key_Plus:
+	case Qt::Key_Equal:
+		m_labelOverlay->setOpacity(m_labelOverlay->getOpacity() + 0.1f);
+		update();
+		break;
+	case Qt::Key_Minus:
+		m_labelOverlay->setOpacity(m_labelOverlay->getOpacity() - 0.1f);
+		update();
+		break;
 	}
 }
\ No newline at end of file
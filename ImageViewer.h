@@ -1,12 +1,20 @@
 #pragma once
 
 #include <QWidget>
+#include <QAtomicInt>
+class LabelMaskThread;
+class ImagePyramidThread;
+namespace ldp
+{
+	class LabelOverlay;
+}
 class ImageViewer : public QWidget
 {
 public:
 	enum ViewType
 	{
 		ViewColorImage = 0,
+		ViewLabelOverlay,	// the label mask blended over the color image, the hovered label highlighted
 		ViewTypeEnd,
 	};
 public:
@@ -17,9 +25,20 @@ public:
 	void setViewType(ViewType type);
 	ViewType getViewType()const;
 
-	void setColorImage(const QImage& img);
+	// the image is drawn from a mip pyramid built on a worker thread, by the tiles in view of the level
+	// nearest the view scale, thus the full resolution only when zoomed in about 1:1 or more
+	// @fileName: of the full image when @img is a downscaled decode of it, E.G., by
+	// PatternImageInfo::getImage() at the size of the viewer; the full one is then decoded on the worker
+	// thread too and replaces it
+	void setColorImage(const QImage& img, QString fileName = QString());
 	const QImage* getColorImage()const;
 
+	// the label mask of the color image, E.G., its "_label.png", drawn as outlines over it, empty for none
+	// the outlines are extracted as vectors on a worker thread and cached by path, thus they are drawn
+	// at any zoom and switching back to a mask does not scan its pixels again
+	void setLabelMask(QString path);
+	QString getLabelMask()const;
+
 	float getViewScale()const;
 	QPointF image2view(QPointF imgPt);
 	QPointF view2image(QPointF viewPt);
@@ -38,10 +57,22 @@ protected:
 
 	void timerEvent(QTimerEvent* ev);
 private:
+	void drawColorImage(QPainter& painter);
+	// the tiles in view of @level, a level of a pyramid of the color image or of the overlay
+	void drawImageTiles(QPainter& painter, const QImage& level);
 	void drawStrokes(QPainter& painter);
 	void drawMaskAsPath(QPainter& painter);
+	void drawLabelOverlay(QPainter& painter);
 private:
 	QImage m_colorImage;
+	QVector<QImage> m_colorPyramid;	// level k at 1/2^k of the size, empty until built
+	QAtomicInt m_colorImageId;		// increased by setColorImage(), to stop and drop pyramids of previous images
+	QList<ImagePyramidThread*> m_colorPyramidThreads;
+	QString m_labelMaskPath;
+	QList<LabelMaskThread*> m_labelMaskThreads;
+	ldp::LabelOverlay* m_labelOverlay;
+	bool m_labelOverlayValid;	// holding the color image and the label mask
+	QVector<QImage> m_overlayPyramid;	// of the frame of m_labelOverlay, level 0 a view of it
 
 	QRectF m_viewRect;
 	QPoint m_mousePos;
@@ -36,7 +36,7 @@ void PatternWindow::updateImages()
 		for (const auto& info : g_dataholder.m_patternInfos)
 		{
 			QSharedPointer<QListWidgetItem> icon(new QListWidgetItem());
-			icon->setIcon(QIcon(*info.getImage(m_itemId_imgId)));
+			icon->setIcon(QIcon(QPixmap::fromImage(info.getImage(m_itemId_imgId, ui.listWidget->iconSize()))));
 			icon->setText(info.getBaseName());
 			icon->setToolTip(info.getImageName(m_itemId_imgId));
 			ui.listWidget->addItem(icon.data());
@@ -64,7 +64,8 @@ void PatternWindow::updateImages()
 			if (iter != g_dataholder.m_namePatternMap.end())
 			{
 				QSharedPointer<QListWidgetItem> icon(new QListWidgetItem());
-				icon->setIcon(QIcon(*iter.value().first->getImage(m_itemId_imgId)));
+				icon->setIcon(QIcon(QPixmap::fromImage(iter.value().first->getImage(m_itemId_imgId,
+					ui.listWidget->iconSize()))));
 				icon->setText(iter.value().first->getBaseName());
 				icon->setToolTip(QString().sprintf("[%d] ", iter.value().second) +
 					iter.value().first->getImageName(m_itemId_imgId));
@@ -74,8 +75,15 @@ void PatternWindow::updateImages()
 				m_lastInfo = iter.value().first;
 			} // end if iter
 		} // end if mapped
-		// insert matched items, sorted by their frequency
-		QVector<QPair<int, PatternImageInfo*>> matched;
+		// insert matched items, sorted by their visual similarity to the query,
+		// or by their frequency if the descriptors are not available.
+		struct Match
+		{
+			float sim;
+			int usage;
+			PatternImageInfo* info;
+		};
+		QVector<Match> matched;
 		for (const auto& info : g_dataholder.m_patternInfos)
 		{
 			if (g_dataholder.m_matchByClothTypeOnly)
@@ -90,16 +98,35 @@ void PatternWindow::updateImages()
 			} // match by all fields
 			const auto& iter = g_dataholder.m_namePatternMap.find(info.getBaseName());
 			if (iter != g_dataholder.m_namePatternMap.end())
-				matched.push_back(qMakePair(iter.value().second, iter.value().first));
+			{
+				Match m = { 0.f, iter.value().second, iter.value().first };
+				matched.push_back(m);
+			}
 		} // end for info
-		qSort(matched.begin(), matched.end(), qGreater<QPair<int, PatternImageInfo*>>());
+
+		const bool rankBySim = updateQueryDescriptor(query_info) && !matched.isEmpty();
+		if (rankBySim)
+		{
+			std::vector<float> sims;
+			g_dataholder.patternSimilarities(m_queryDescriptor, sims);
+			for (auto& m : matched)
+				m.sim = sims[m.info - g_dataholder.m_patternInfos.data()];
+		}
+		std::sort(matched.begin(), matched.end(), [](const Match& a, const Match& b){
+			if (a.sim != b.sim)
+				return a.sim > b.sim;
+			return a.usage > b.usage;
+		});
 		for (const auto& match : matched)
 		{
-			const auto& info = *match.second;
+			const auto& info = *match.info;
 			QSharedPointer<QListWidgetItem> icon(new QListWidgetItem());
-			icon->setIcon(QIcon(*info.getImage(m_itemId_imgId)));
+			icon->setIcon(QIcon(QPixmap::fromImage(info.getImage(m_itemId_imgId, ui.listWidget->iconSize()))));
 			icon->setText(info.getBaseName());
-			icon->setToolTip(QString().sprintf("[%d] ", match.first) + info.getImageName(m_itemId_imgId));
+			QString tip = QString().sprintf("[%d] ", match.usage);
+			if (rankBySim && match.sim >= 0)
+				tip += QString().sprintf("(%.2f) ", match.sim);
+			icon->setToolTip(tip + info.getImageName(m_itemId_imgId));
 			ui.listWidget->addItem(icon.data());
 			m_icons.push_back(icon);
 		} // end for info
@@ -138,9 +165,10 @@ void PatternWindow::listItemClicked(QListWidgetItem *item)
 		}
 	}
 
-	while (iter.value().first->getImage(m_itemId_imgId)->width() == 0)
+	const QSize iconSize = ui.listWidget->iconSize();
+	while (iter.value().first->getImage(m_itemId_imgId, iconSize).width() == 0)
 		m_itemId_imgId = (m_itemId_imgId + 1) % iter.value().first->numImages();
-	item->setIcon(QIcon(*iter.value().first->getImage(m_itemId_imgId)));
+	item->setIcon(QIcon(QPixmap::fromImage(iter.value().first->getImage(m_itemId_imgId, iconSize))));
 	ui.listWidget->update();
 }
 
@@ -159,6 +187,7 @@ void PatternWindow::removeSelectedPattern()
 		if (g_dataholder.m_patternInfos[i].getBaseName() == item->text())
 		{
 			g_dataholder.m_patternInfos.erase(g_dataholder.m_patternInfos.begin() + i);
+			g_dataholder.patternInfosChanged();
 			break;
 		}
 	}	
@@ -176,6 +205,22 @@ void PatternWindow::removeSelectedPattern()
 	updateImages();
 }
 
+bool PatternWindow::updateQueryDescriptor(const PatternImageInfo& query)
+{
+	g_dataholder.updatePatternDescriptors();
+	if (g_dataholder.m_patternDescriptors.cols() != (int)g_dataholder.m_patternInfos.size()
+		|| query.numImages() == 0)
+		return false;
+	const QString name = query.getImageName(0);
+	if (name != m_queryDescriptorName)
+	{
+		m_queryDescriptor.resize(ldp::ImageDescriptorDim, 1);
+		ldp::imageDescriptor(name, m_queryDescriptor.data());
+		m_queryDescriptorName = name;
+	}
+	return m_queryDescriptor.squaredNorm() > 0;
+}
+
 void PatternWindow::resizeEvent(QResizeEvent* ev)
 {
 	ui.listWidget->update();
@@ -3,6 +3,7 @@
 
 #include <QtWidgets/QMainWindow>
 #include "ui_patternwindow.h"
+#include "ImageDescriptor.h"
 class PatternLabelUI;
 class PatternImageInfo;
 class PatternWindow : public QMainWindow
@@ -21,6 +22,9 @@ public:
 	void removeSelectedPattern();
 protected:
 	void resizeEvent(QResizeEvent* ev);
+	// update the pattern descriptors and the one of the query image if it changed
+	// returns false if they cannot be used for ranking
+	bool updateQueryDescriptor(const PatternImageInfo& query);
 private:
 	Ui_PatternWindow ui;
 	int m_itemId_imgId;
@@ -29,6 +33,8 @@ protected:
 	QVector<QSharedPointer<QListWidgetItem>> m_icons;
 	PatternLabelUI* m_mainUI;
 	PatternImageInfo* m_lastInfo;
+	ldp::Matf m_queryDescriptor;
+	QString m_queryDescriptorName;
 };
 
 #endif // SEWINGEDITOR_H
@@ -0,0 +1,134 @@
+#include "ImageDescriptor.h"
+#include "ThreadPool.h"
+#include "conv\Resample.h"
+#include <QImageReader>
+#undef min
+#undef max
+namespace ldp
+{
+	// images are described on their downscaled version
+	const static int g_descriptorImageSize = 128;
+
+	void imageDescriptor(const QImage& srcImg, float* desc)
+	{
+		std::fill(desc, desc + ImageDescriptorDim, 0.f);
+		if (srcImg.isNull())
+			return;
+		QImage img = srcImg.convertToFormat(QImage::Format_RGB32);
+		if (img.width() > g_descriptorImageSize || img.height() > g_descriptorImageSize)
+		{
+			const QSize sz = img.size().scaled(g_descriptorImageSize, g_descriptorImageSize, Qt::KeepAspectRatio);
+			QImage thumb(std::max(1, sz.width()), std::max(1, sz.height()), QImage::Format_RGB32);
+			resampleImage(thumb.bits(), thumb.width(), thumb.height(), thumb.bytesPerLine(), img.constBits(),
+				img.width(), img.height(), img.bytesPerLine(), 4, ResampleArea);
+			img = thumb;
+		}
+		const int W = img.width(), H = img.height();
+		float* color = desc;
+		float* grad = desc + ImageDescriptorColorDim;
+
+		// color histogram and gray image
+		FloatImage gray, gx, gy;
+		gray.resize(W, H);
+		for (int y = 0; y < H; y++)
+		{
+			const QRgb* src = (const QRgb*)img.constScanLine(y);
+			for (int x = 0; x < W; x++)
+			{
+				const QRgb c = src[x];
+				color[((qRed(c) >> 6) << 4) | ((qGreen(c) >> 6) << 2) | (qBlue(c) >> 6)] += 1.f;
+				gray(x, y) = qGray(c) / 255.f;
+			}
+		} // end for y
+
+		// sobel gradients by the separable conv kernels
+		const float deriv[3] = { 0.5f, 0.f, -0.5f };
+		const float smooth[3] = { 0.25f, 0.5f, 0.25f };
+		gx = gray;
+		gy = gray;
+		const ldp::Int2 res(W, H);
+		conv_helper::conv2<float, 3>(gx.data(), deriv, res, 0);
+		conv_helper::conv2<float, 3>(gx.data(), smooth, res, 1);
+		conv_helper::conv2<float, 3>(gy.data(), smooth, res, 0);
+		conv_helper::conv2<float, 3>(gy.data(), deriv, res, 1);
+
+		// orientation histogram on 2x2 cells, weighted by the magnitude
+		const float binScale = 8.f / 3.14159265f;
+		for (int y = 0; y < H; y++)
+		{
+			const int cy = y * 2 / H;
+			for (int x = 0; x < W; x++)
+			{
+				const float dx = gx(x, y), dy = gy(x, y);
+				const float mag = sqrt(dx*dx + dy*dy);
+				if (mag < 1e-4f)
+					continue;
+				float theta = atan2(dy, dx);
+				if (theta < 0)
+					theta += 3.14159265f;
+				const int bin = std::min(7, int(theta * binScale));
+				const int cx = x * 2 / W;
+				grad[(cy * 2 + cx) * 8 + bin] += mag;
+			}
+		} // end for y
+
+		// hellinger + joint L2 normalization, each part weighted equally
+		for (int part = 0; part < 2; part++)
+		{
+			float* h = part == 0 ? color : grad;
+			const int n = part == 0 ? (int)ImageDescriptorColorDim : (int)ImageDescriptorGradDim;
+			float sum = 0;
+			for (int i = 0; i < n; i++)
+				sum += h[i];
+			if (sum <= 0)
+				continue;
+			// sqrt(h/sum) has unit L2 norm
+			const float scale = 1.f / sqrt(2.f);
+			for (int i = 0; i < n; i++)
+				h[i] = sqrt(h[i] / sum) * scale;
+		} // end for part
+	}
+
+	bool imageDescriptor(const QString& imgName, float* desc)
+	{
+		QImageReader reader(imgName);
+		QSize sz = reader.size();
+		if (sz.isValid() && (sz.width() > g_descriptorImageSize || sz.height() > g_descriptorImageSize))
+			reader.setScaledSize(sz.scaled(g_descriptorImageSize, g_descriptorImageSize, Qt::KeepAspectRatio));
+		QImage img = reader.read();
+		imageDescriptor(img, desc);
+		return !img.isNull();
+	}
+
+	void descriptorSimilarity(const Matf& D, const Matf& Q, Matf& S)
+	{
+		if (D.rows() != Q.rows())
+			throw std::exception("descriptorSimilarity: dimension not matched");
+		S.noalias() = D.transpose() * Q;
+	}
+
+	void descriptorKnn(const Matf& D, const Matf& Q, int k, Eigen::MatrixXi& ids, Matf& scores)
+	{
+		Matf S;
+		descriptorSimilarity(D, Q, S);
+		k = std::min(k, (int)D.cols());
+		ids.resize(k, Q.cols());
+		scores.resize(k, Q.cols());
+
+		ldp::parallelFor(0, (int)Q.cols(), 0, [&](int qb, int qe)
+		{
+			for (int q = qb; q < qe; q++)
+			{
+				std::vector<std::pair<float, int>> sid(S.rows());
+				for (int i = 0; i < (int)S.rows(); i++)
+					sid[i] = std::make_pair(-S(i, q), i);
+				std::partial_sort(sid.begin(), sid.begin() + k, sid.end());
+				for (int i = 0; i < k; i++)
+				{
+					ids(i, q) = sid[i].second;
+					scores(i, q) = -sid[i].first;
+				}
+			} // end for q
+		});
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "util.h"
+#include <QString>
+#include <QImage>
+
+namespace ldp
+{
+	// compact global image descriptor for visual similarity ranking:
+	//	64-d rgb color histogram, 4 bins per channel
+	//	32-d gradient orientation histogram, 8 unsigned orientations on 2x2 cells
+	// both parts are square-rooted (Hellinger) and jointly L2-normalized,
+	// thus the dot product of two descriptors is their similarity in [0, 1].
+	enum
+	{
+		ImageDescriptorColorDim = 64,
+		ImageDescriptorGradDim = 32,
+		ImageDescriptorDim = ImageDescriptorColorDim + ImageDescriptorGradDim,
+	};
+
+	// @desc: pre-allocated, of size ImageDescriptorDim
+	void imageDescriptor(const QImage& img, float* desc);
+
+	// decode downscaled and compute the descriptor, safe to be called from non-GUI threads
+	// returns false and fill zeros if the image cannot be read
+	bool imageDescriptor(const QString& imgName, float* desc);
+
+	// S = D^T * Q, the similarity of each query (column of Q) to each database column of D
+	void descriptorSimilarity(const Matf& D, const Matf& Q, Matf& S);
+
+	// batched k-nearest-neighbours by a single GEMM
+	// @ids, @scores: k x M, the k most similar columns of D for each query, best first
+	void descriptorKnn(const Matf& D, const Matf& Q, int k, Eigen::MatrixXi& ids, Matf& scores);
+}
@@ -0,0 +1,351 @@
+#include "ImageHash.h"
+#include "conv\Resample.h"
+#include <QImageReader>
+#include <QFile>
+#include <QDataStream>
+#include <algorithm>
+#include <math.h>
+namespace ldp
+{
+	// decoding size of the thumbnail, the pHash is calculated on its 32x32 version
+	const static int g_decodeSize = 64;
+	const static int g_pHashSize = 32;
+
+	// the lowest 8 rows of the DCT-II basis of size g_pHashSize
+	static struct PHashDctBasis
+	{
+		float c[8 * g_pHashSize];
+		PHashDctBasis()
+		{
+			for (int u = 0; u < 8; u++)
+			for (int x = 0; x < g_pHashSize; x++)
+				c[u*g_pHashSize + x] = (float)cos((2 * x + 1) * u * 3.14159265358979 / (2 * g_pHashSize));
+		}
+	} g_pHashBasis;
+
+	// the image scaled to w x h, each pixel averaging the area it covers
+	static QImage scaledRGB32(const QImage& img, int w, int h)
+	{
+		const QImage src = img.convertToFormat(QImage::Format_RGB32);
+		QImage s(w, h, QImage::Format_RGB32);
+		resampleImage(s.bits(), w, h, s.bytesPerLine(), src.constBits(), src.width(), src.height(),
+			src.bytesPerLine(), 4, ResampleArea);
+		return s;
+	}
+
+	// row-major gray values of an image scaled to w x h
+	static void grayThumbnail(const QImage& img, int w, int h, std::vector<float>& gray)
+	{
+		QImage s = scaledRGB32(img, w, h);
+		gray.resize(w*h);
+		for (int y = 0; y < h; y++)
+		{
+			const QRgb* src = (const QRgb*)s.constScanLine(y);
+			for (int x = 0; x < w; x++)
+				gray[y*w + x] = (float)qGray(src[x]);
+		}
+	}
+
+	ImageHash64 imageDHash(const QImage& img)
+	{
+		if (img.isNull())
+			return 0;
+		std::vector<float> gray;
+		grayThumbnail(img, 9, 8, gray);
+		ImageHash64 hash = 0;
+		for (int y = 0; y < 8; y++)
+		{
+			const float* row = gray.data() + y * 9;
+			for (int x = 0; x < 8; x++)
+			{
+				hash <<= 1;
+				if (row[x + 1] > row[x])
+					hash |= 1;
+			}
+		}
+		return hash;
+	}
+
+	ImageHash64 imagePHash(const QImage& img)
+	{
+		if (img.isNull())
+			return 0;
+		const int N = g_pHashSize;
+		std::vector<float> gray;
+		grayThumbnail(img, N, N, gray);
+
+		// D = C * G * C^T, only the top-left 8x8 block is needed
+		float tmp[8 * g_pHashSize], dct[64];
+		for (int u = 0; u < 8; u++)
+		{
+			const float* c = g_pHashBasis.c + u*N;
+			for (int x = 0; x < N; x++)
+			{
+				float s = 0;
+				for (int y = 0; y < N; y++)
+					s += c[y] * gray[y*N + x];
+				tmp[u*N + x] = s;
+			}
+		}
+		for (int u = 0; u < 8; u++)
+		for (int v = 0; v < 8; v++)
+		{
+			const float* c = g_pHashBasis.c + v*N;
+			float s = 0;
+			for (int x = 0; x < N; x++)
+				s += tmp[u*N + x] * c[x];
+			dct[u * 8 + v] = s;
+		}
+
+		// the DC term is excluded when computing the median
+		float ac[63];
+		std::copy(dct + 1, dct + 64, ac);
+		std::nth_element(ac, ac + 31, ac + 63);
+		const float median = ac[31];
+
+		ImageHash64 hash = 0;
+		for (int i = 0; i < 64; i++)
+		{
+			hash <<= 1;
+			if (dct[i] > median)
+				hash |= 1;
+		}
+		return hash;
+	}
+
+	ImageFingerprint imageFingerprint(const QImage& img)
+	{
+		ImageFingerprint fp;
+		if (img.isNull())
+			return fp;
+		QImage small = img;
+		if (img.width() > g_decodeSize || img.height() > g_decodeSize)
+			small = scaledRGB32(img, g_decodeSize, g_decodeSize);
+		fp.dHash = imageDHash(small);
+		fp.pHash = imagePHash(small);
+		return fp;
+	}
+
+	ImageFingerprint imageFingerprint(const QString& imgName)
+	{
+		QImageReader reader(imgName);
+		QSize sz = reader.size();
+		if (sz.isValid() && (sz.width() > g_decodeSize || sz.height() > g_decodeSize))
+			reader.setScaledSize(QSize(g_decodeSize, g_decodeSize));
+		QImage img = reader.read();
+		if (img.isNull())
+			return ImageFingerprint();
+		return imageFingerprint(img);
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////
+	void HashBKTree::insert(ImageHash64 hash, int id)
+	{
+		Node node;
+		node.hash = hash;
+		node.id = id;
+		if (m_nodes.empty())
+		{
+			m_nodes.push_back(node);
+			return;
+		}
+
+		int cur = 0;
+		while (1)
+		{
+			const int d = hammingDistance(m_nodes[cur].hash, hash);
+			int next = -1;
+			for (const auto& c : m_nodes[cur].children)
+			if (c.first == d)
+			{
+				next = c.second;
+				break;
+			}
+			if (next < 0)
+			{
+				m_nodes[cur].children.push_back(std::make_pair(d, (int)m_nodes.size()));
+				m_nodes.push_back(node);
+				return;
+			}
+			cur = next;
+		} // end while
+	}
+
+	void HashBKTree::query(ImageHash64 hash, int radius, std::vector<int>& ids)const
+	{
+		if (m_nodes.empty())
+			return;
+		std::vector<int> stack;
+		stack.push_back(0);
+		while (!stack.empty())
+		{
+			const Node& node = m_nodes[stack.back()];
+			stack.pop_back();
+			const int d = hammingDistance(node.hash, hash);
+			if (d <= radius)
+				ids.push_back(node.id);
+			// triangle inequality: only children with |dc - d| <= radius can contain matches
+			for (const auto& c : node.children)
+			if (c.first >= d - radius && c.first <= d + radius)
+				stack.push_back(c.second);
+		} // end while
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////
+	const static quint32 g_hashIndexMagic = 0x4c445048; // "LDPH"
+	const static quint32 g_hashIndexVersion = 2; // 2: thumbnails by the area filter of ldp::resampleImage()
+
+	inline QString hashIndexKey(const QString& group, const QString& key)
+	{
+		return group + '|' + key;
+	}
+
+	void ImageHashIndex::clear()
+	{
+		m_entries.clear();
+		m_keyMap.clear();
+		for (int i = 0; i < NumChunks; i++)
+			m_tables[i].clear();
+	}
+
+	int ImageHashIndex::find(const QString& group, const QString& key)const
+	{
+		auto iter = m_keyMap.find(hashIndexKey(group, key));
+		if (iter == m_keyMap.end())
+			return -1;
+		return iter.value();
+	}
+
+	int ImageHashIndex::insert(const ImageFingerprint& fp, const QString& group, const QString& key)
+	{
+		int id = find(group, key);
+		if (id >= 0)
+		{
+			if (m_entries[id].fp.pHash != fp.pHash)
+			{
+				removeFromTables(id);
+				m_entries[id].fp = fp;
+				addToTables(id);
+			}
+			m_entries[id].fp.dHash = fp.dHash;
+			return id;
+		}
+		Entry e;
+		e.fp = fp;
+		e.group = group;
+		e.key = key;
+		id = (int)m_entries.size();
+		m_entries.push_back(e);
+		m_keyMap.insert(hashIndexKey(group, key), id);
+		addToTables(id);
+		return id;
+	}
+
+	void ImageHashIndex::addToTables(int id)
+	{
+		const ImageHash64 h = m_entries[id].fp.pHash;
+		for (int i = 0; i < NumChunks; i++)
+			m_tables[i][chunk(h, i)].push_back(id);
+	}
+
+	void ImageHashIndex::removeFromTables(int id)
+	{
+		const ImageHash64 h = m_entries[id].fp.pHash;
+		for (int i = 0; i < NumChunks; i++)
+		{
+			auto iter = m_tables[i].find(chunk(h, i));
+			if (iter != m_tables[i].end())
+				iter.value().removeOne(id);
+		}
+	}
+
+	// all 16-bit values within hamming distance @r to @v, starting from bit @firstBit
+	static void enumerateChunkBall(unsigned short v, int r, int firstBit, std::vector<unsigned short>& out)
+	{
+		out.push_back(v);
+		if (r == 0)
+			return;
+		for (int b = firstBit; b < 16; b++)
+			enumerateChunkBall(v ^ (unsigned short)(1 << b), r - 1, b + 1, out);
+	}
+
+	void ImageHashIndex::query(const ImageFingerprint& fp, int radius, std::vector<int>& ids)const
+	{
+		ids.clear();
+		if (m_entries.empty() || radius < 0)
+			return;
+		const int subRadius = radius / NumChunks;
+		std::vector<unsigned short> probes;
+		for (int i = 0; i < NumChunks; i++)
+		{
+			probes.clear();
+			enumerateChunkBall(chunk(fp.pHash, i), subRadius, 0, probes);
+			for (auto v : probes)
+			{
+				auto iter = m_tables[i].find(v);
+				if (iter == m_tables[i].end())
+					continue;
+				for (int id : iter.value())
+					ids.push_back(id);
+			}
+		} // end for i
+		std::sort(ids.begin(), ids.end());
+		ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+		// verify and sort by distance
+		std::vector<std::pair<int, int>> distIds;
+		for (int id : ids)
+		{
+			const auto& e = m_entries[id].fp;
+			const int d = hammingDistance(e.pHash, fp.pHash);
+			if (d <= radius && hammingDistance(e.dHash, fp.dHash) <= radius)
+				distIds.push_back(std::make_pair(d, id));
+		}
+		std::sort(distIds.begin(), distIds.end());
+		ids.resize(distIds.size());
+		for (size_t i = 0; i < distIds.size(); i++)
+			ids[i] = distIds[i].second;
+	}
+
+	bool ImageHashIndex::save(QString filename)const
+	{
+		QFile file(filename);
+		if (!file.open(QIODevice::WriteOnly))
+			return false;
+		QDataStream stm(&file);
+		stm << g_hashIndexMagic << g_hashIndexVersion << (quint32)m_entries.size();
+		for (const auto& e : m_entries)
+			stm << (quint64)e.fp.pHash << (quint64)e.fp.dHash << e.group << e.key;
+		return stm.status() == QDataStream::Ok;
+	}
+
+	bool ImageHashIndex::load(QString filename)
+	{
+		clear();
+		QFile file(filename);
+		if (!file.open(QIODevice::ReadOnly))
+			return false;
+		QDataStream stm(&file);
+		quint32 magic = 0, version = 0, num = 0;
+		stm >> magic >> version >> num;
+		if (magic != g_hashIndexMagic || version != g_hashIndexVersion)
+			return false;
+		m_entries.reserve(num);
+		for (quint32 i = 0; i < num && stm.status() == QDataStream::Ok; i++)
+		{
+			quint64 p = 0, d = 0;
+			QString group, key;
+			stm >> p >> d >> group >> key;
+			ImageFingerprint fp;
+			fp.pHash = p;
+			fp.dHash = d;
+			insert(fp, group, key);
+		}
+		if (stm.status() != QDataStream::Ok)
+		{
+			clear();
+			return false;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vector>
+#include <QString>
+#include <QImage>
+#include <QHash>
+#include <QVector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace ldp
+{
+	typedef unsigned long long ImageHash64;
+
+	// perceptual fingerprint of an image
+	//	dHash: sign of horizontal gradients on a 9x8 gray thumbnail
+	//	pHash: sign of the low 8x8 DCT coefficients (w.r.t. their median) on a 32x32 gray thumbnail
+	struct ImageFingerprint
+	{
+		ImageHash64 dHash;
+		ImageHash64 pHash;
+		ImageFingerprint() :dHash(0), pHash(0) {}
+		bool isValid()const { return dHash != 0 || pHash != 0; }
+	};
+
+	ImageHash64 imageDHash(const QImage& img);
+	ImageHash64 imagePHash(const QImage& img);
+	ImageFingerprint imageFingerprint(const QImage& img);
+
+	// decode the image downscaled and compute its fingerprint
+	// it only uses QImage, thus is safe to be called from non-GUI threads
+	// returns an invalid fingerprint if the image cannot be read
+	ImageFingerprint imageFingerprint(const QString& imgName);
+
+	inline int hammingDistance(ImageHash64 a, ImageHash64 b)
+	{
+		ImageHash64 x = a ^ b;
+#if defined(_MSC_VER) && defined(_WIN64)
+		return (int)__popcnt64(x);
+#elif defined(__GNUC__)
+		return __builtin_popcountll(x);
+#else
+		x = x - ((x >> 1) & 0x5555555555555555ULL);
+		x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+		x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+		return (int)((x * 0x0101010101010101ULL) >> 56);
+#endif
+	}
+
+	// Burkhard-Keller tree over 64-bit hashes with hamming metric
+	// used to group near-duplicates without comparing all pairs.
+	class HashBKTree
+	{
+	public:
+		HashBKTree() {}
+
+		void clear() { m_nodes.clear(); }
+		int size()const { return (int)m_nodes.size(); }
+		void reserve(int n) { m_nodes.reserve(n); }
+
+		void insert(ImageHash64 hash, int id);
+
+		// all ids whose hash is within @radius to the given one, appended to @ids
+		void query(ImageHash64 hash, int radius, std::vector<int>& ids)const;
+	protected:
+		struct Node
+		{
+			ImageHash64 hash;
+			int id;
+			// (distance to this node, child node index)
+			std::vector<std::pair<int, int>> children;
+		};
+		std::vector<Node> m_nodes;
+	};
+
+	// persistent fingerprint index for cross-batch near-duplicate lookup
+	// each entry is identified by (group, key), E.G., (xml of the batch, relative image name).
+	// multi-index hashing: the pHash is split into 4 16-bit chunks, each having its own table;
+	// two hashes within distance r must share a chunk within distance r/4, so a query only
+	// probes the chunk values in that small ball, instead of scanning all entries.
+	class ImageHashIndex
+	{
+	public:
+		struct Entry
+		{
+			ImageFingerprint fp;
+			QString group;
+			QString key;
+		};
+	public:
+		ImageHashIndex() {}
+
+		void clear();
+		int size()const { return (int)m_entries.size(); }
+		const Entry& entry(int i)const { return m_entries[i]; }
+
+		// insert, or update the fingerprint if (group, key) already exists; return the entry id
+		int insert(const ImageFingerprint& fp, const QString& group, const QString& key);
+		int find(const QString& group, const QString& key)const;
+
+		// ids of entries with both pHash and dHash within @radius, sorted by pHash distance
+		// radius should be small (<= 11) to keep the number of probes low
+		void query(const ImageFingerprint& fp, int radius, std::vector<int>& ids)const;
+
+		bool save(QString filename)const;
+		bool load(QString filename);
+	protected:
+		void addToTables(int id);
+		void removeFromTables(int id);
+		static unsigned short chunk(ImageHash64 h, int i) { return (unsigned short)(h >> (16 * i)); }
+	protected:
+		enum{ NumChunks = 4 };
+		std::vector<Entry> m_entries;
+		QHash<QString, int> m_keyMap;
+		QHash<unsigned short, QVector<int>> m_tables[NumChunks];
+	};
+}
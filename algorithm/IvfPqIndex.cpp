@@ -0,0 +1,479 @@
+#include "IvfPqIndex.h"
+#include "ThreadPool.h"
+#include <QDataStream>
+#include <QFileInfo>
+#include <random>
+#include <queue>
+#undef min
+#undef max
+namespace ldp
+{
+	const static unsigned int g_ivfPqMagic = 0x4c445049; // "LDPI"
+	const static unsigned int g_ivfPqVersion = 1;
+
+	// the mapped file header, followed by
+	//	float centers[dim * nList], float codebooks[dim * NumCodes]
+	//	uint listOffsets[nList + 1], int ids[nVectors], uchar codes[nVectors * nSub]
+	// and the QStringList of keys at keysOffset.
+	struct IvfPqFileHeader
+	{
+		unsigned int magic;
+		unsigned int version;
+		unsigned int dim;
+		unsigned int nList;
+		unsigned int nSub;
+		unsigned int nVectors;
+		unsigned long long keysOffset;
+	};
+
+	// columns per block when assigning vectors to lists, bounding the temporary score matrix
+	const static int g_assignBlockSize = 4096;
+
+	inline QString ivfPqLogName(const QString& filename)
+	{
+		return filename + ".log";
+	}
+
+	IvfPqIndex::IvfPqIndex()
+	{
+		m_mapped = nullptr;
+		clear();
+	}
+
+	IvfPqIndex::~IvfPqIndex()
+	{
+		releaseMapping();
+	}
+
+	void IvfPqIndex::clear()
+	{
+		releaseMapping();
+		m_dim = 0;
+		m_nList = 0;
+		m_nSub = 0;
+		m_subDim = 0;
+		m_centers.resize(0, 0);
+		m_centerSqrNorms.resize(0);
+		m_codebooks.resize(0, 0);
+		m_keys.clear();
+		m_keyIds.clear();
+		m_listIds.clear();
+		m_listCodes.clear();
+		m_filename.clear();
+	}
+
+	void IvfPqIndex::releaseMapping()
+	{
+		if (m_file && m_mapped)
+			m_file->unmap(m_mapped);
+		m_file.reset();
+		m_mapped = nullptr;
+		m_mappedListOffsets = nullptr;
+		m_mappedIds = nullptr;
+		m_mappedCodes = nullptr;
+	}
+
+	void IvfPqIndex::train(const Matf& data, int nList, int nSubQuantizers, int maxTrainSamples)
+	{
+		const int dim = (int)data.rows();
+		const int nData = (int)data.cols();
+		if (nSubQuantizers <= 0 || dim % nSubQuantizers != 0)
+			throw std::exception("IvfPqIndex::train: dim must be divisible by the number of sub-quantizers");
+		const int nTrain = std::min(nData, maxTrainSamples);
+		if (nList <= 0 || nTrain < nList || nTrain < NumCodes)
+			throw std::exception("IvfPqIndex::train: too few training samples");
+
+		clear();
+		m_dim = dim;
+		m_nSub = nSubQuantizers;
+		m_subDim = dim / nSubQuantizers;
+
+		// a reproducible random subset
+		std::vector<int> perm(nData);
+		for (int i = 0; i < nData; i++)
+			perm[i] = i;
+		std::mt19937 rng(0);
+		std::shuffle(perm.begin(), perm.end(), rng);
+		Matf X(dim, nTrain);
+		for (int i = 0; i < nTrain; i++)
+			X.col(i) = data.col(perm[i]);
+
+		// coarse quantizer
+		std::vector<int> ids;
+		Matf centers;
+		kmeans(X, nList, ids, m_centers, 10);
+		m_centerSqrNorms = m_centers.colwise().squaredNorm().transpose();
+		for (int i = 0; i < nTrain; i++)
+			X.col(i) -= m_centers.col(ids[i]);
+
+		// product quantizer on the residuals
+		m_codebooks.resize(m_subDim, m_nSub * NumCodes);
+		for (int m = 0; m < m_nSub; m++)
+		{
+			Matf subX = X.middleRows(m * m_subDim, m_subDim);
+			kmeans(subX, NumCodes, ids, centers, 10);
+			m_codebooks.middleCols(m * NumCodes, NumCodes) = centers;
+		} // end for m
+
+		m_nList = nList;
+		m_listIds.resize(m_nList);
+		m_listCodes.resize(m_nList);
+	}
+
+	void IvfPqIndex::assignLists(const Matf& data, std::vector<int>& lists)const
+	{
+		// argmin_k |c_k|^2 - 2 c_k^T x, by blocked GEMM
+		const int n = (int)data.cols();
+		lists.resize(n);
+		Matf S;
+		for (int b = 0; b < n; b += g_assignBlockSize)
+		{
+			const int bn = std::min(g_assignBlockSize, n - b);
+			S.noalias() = m_centers.transpose() * data.middleCols(b, bn);
+			ldp::parallelFor(0, bn, 0, [&](int ib, int ie)
+			{
+				for (int i = ib; i < ie; i++)
+				{
+					int best = 0;
+					float bestDist = std::numeric_limits<float>::max();
+					for (int k = 0; k < m_nList; k++)
+					{
+						const float d = m_centerSqrNorms[k] - 2 * S(k, i);
+						if (d < bestDist)
+						{
+							bestDist = d;
+							best = k;
+						}
+					}
+					lists[b + i] = best;
+				} // end for i
+			});
+		} // end for b
+	}
+
+	void IvfPqIndex::encode(const float* residual, unsigned char* code)const
+	{
+		for (int m = 0; m < m_nSub; m++)
+		{
+			const float* r = residual + m * m_subDim;
+			int best = 0;
+			float bestDist = std::numeric_limits<float>::max();
+			for (int j = 0; j < NumCodes; j++)
+			{
+				const float* c = m_codebooks.data() + (m * NumCodes + j) * m_subDim;
+				float d = 0;
+				for (int t = 0; t < m_subDim; t++)
+					d += (r[t] - c[t]) * (r[t] - c[t]);
+				if (d < bestDist)
+				{
+					bestDist = d;
+					best = j;
+				}
+			} // end for j
+			code[m] = (unsigned char)best;
+		} // end for m
+	}
+
+	void IvfPqIndex::appendToList(int list, int id, const unsigned char* code)
+	{
+		m_listIds[list].push_back(id);
+		m_listCodes[list].insert(m_listCodes[list].end(), code, code + m_nSub);
+	}
+
+	void IvfPqIndex::add(const Matf& data, const QStringList& keys)
+	{
+		if (!isTrained())
+			throw std::exception("IvfPqIndex::add: not trained");
+		if (data.rows() != m_dim || data.cols() != keys.size())
+			throw std::exception("IvfPqIndex::add: size not matched");
+
+		// keys already indexed are skipped
+		std::vector<int> cols;
+		QStringList newKeys;
+		QHash<QString, int> batchKeys;
+		for (int i = 0; i < keys.size(); i++)
+		{
+			if (m_keyIds.contains(keys[i]) || batchKeys.contains(keys[i]))
+				continue;
+			batchKeys.insert(keys[i], i);
+			cols.push_back(i);
+			newKeys.push_back(keys[i]);
+		}
+		const int n = (int)cols.size();
+		if (n == 0)
+			return;
+		Matf X(m_dim, n);
+		for (int i = 0; i < n; i++)
+			X.col(i) = data.col(cols[i]);
+
+		std::vector<int> lists;
+		assignLists(X, lists);
+		std::vector<unsigned char> codes(n * m_nSub);
+		ldp::parallelFor(0, n, 0, [&](int ib, int ie)
+		{
+			for (int i = ib; i < ie; i++)
+			{
+				Vecf r = X.col(i) - m_centers.col(lists[i]);
+				encode(r.data(), codes.data() + i * m_nSub);
+			}
+		});
+
+		for (int i = 0; i < n; i++)
+		{
+			const int id = m_keys.size();
+			m_keys.push_back(newKeys[i]);
+			m_keyIds.insert(newKeys[i], id);
+			appendToList(lists[i], id, codes.data() + i * m_nSub);
+		}
+		if (!m_filename.isEmpty() && !appendLog(newKeys, lists, codes))
+			throw std::exception("IvfPqIndex::add: cannot append to the log file");
+	}
+
+	void IvfPqIndex::search(const float* query, int k, int nProbe, std::vector<int>& ids,
+		std::vector<float>& dists)const
+	{
+		ids.clear();
+		dists.clear();
+		if (!isTrained() || size() == 0 || k <= 0)
+			return;
+		nProbe = std::max(1, std::min(nProbe, m_nList));
+		Eigen::Map<const Vecf> q(query, m_dim);
+
+		// the nProbe nearest lists
+		Vecf coarse = m_centerSqrNorms - 2 * (m_centers.transpose() * q);
+		std::vector<std::pair<float, int>> lists(m_nList);
+		for (int l = 0; l < m_nList; l++)
+			lists[l] = std::make_pair(coarse[l], l);
+		std::partial_sort(lists.begin(), lists.begin() + nProbe, lists.end());
+
+		// max-heap of the k best (distance, id)
+		std::priority_queue<std::pair<float, int>> heap;
+		std::vector<float> lut(m_nSub * NumCodes);
+		Vecf r;
+		for (int p = 0; p < nProbe; p++)
+		{
+			const int l = lists[p].second;
+			r = q - m_centers.col(l);
+			for (int m = 0; m < m_nSub; m++)
+			{
+				const Eigen::Map<const Vecf> rm(r.data() + m * m_subDim, m_subDim);
+				Eigen::Map<Vecf> lm(lut.data() + m * NumCodes, NumCodes);
+				lm = (m_codebooks.middleCols(m * NumCodes, NumCodes).colwise() - rm).colwise().squaredNorm().transpose();
+			}
+
+			// the mapped part, then the part added after saving
+			for (int part = 0; part < 2; part++)
+			{
+				const int* listIds = nullptr;
+				const unsigned char* listCodes = nullptr;
+				int n = 0;
+				if (part == 0 && m_mapped)
+				{
+					listIds = m_mappedIds + m_mappedListOffsets[l];
+					listCodes = m_mappedCodes + size_t(m_mappedListOffsets[l]) * m_nSub;
+					n = int(m_mappedListOffsets[l + 1] - m_mappedListOffsets[l]);
+				}
+				else if (part == 1)
+				{
+					listIds = m_listIds[l].data();
+					listCodes = m_listCodes[l].data();
+					n = (int)m_listIds[l].size();
+				}
+				for (int i = 0; i < n; i++)
+				{
+					const unsigned char* code = listCodes + i * m_nSub;
+					float d = 0;
+					for (int m = 0; m < m_nSub; m++)
+						d += lut[m * NumCodes + code[m]];
+					if ((int)heap.size() < k)
+						heap.push(std::make_pair(d, listIds[i]));
+					else if (d < heap.top().first)
+					{
+						heap.pop();
+						heap.push(std::make_pair(d, listIds[i]));
+					}
+				} // end for i
+			} // end for part
+		} // end for p
+
+		ids.resize(heap.size());
+		dists.resize(heap.size());
+		for (int i = (int)heap.size() - 1; i >= 0; i--)
+		{
+			ids[i] = heap.top().second;
+			dists[i] = heap.top().first;
+			heap.pop();
+		}
+	}
+
+	bool IvfPqIndex::appendLog(const QStringList& keys, const std::vector<int>& lists,
+		const std::vector<unsigned char>& codes)const
+	{
+		QFile file(ivfPqLogName(m_filename));
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+			return false;
+		QDataStream stm(&file);
+		stm.setVersion(QDataStream::Qt_5_3);
+		for (int i = 0; i < keys.size(); i++)
+			stm << keys[i] << (quint32)lists[i]
+			<< QByteArray((const char*)codes.data() + i * m_nSub, m_nSub);
+		return stm.status() == QDataStream::Ok;
+	}
+
+	bool IvfPqIndex::save(QString filename)
+	{
+		if (!isTrained())
+			return false;
+
+		// move the mapped codes into memory, since the mapped file may be overwritten
+		// and the index should stay valid if saving failed.
+		if (m_mapped)
+		{
+			for (int l = 0; l < m_nList; l++)
+			{
+				const unsigned int b = m_mappedListOffsets[l], e = m_mappedListOffsets[l + 1];
+				m_listIds[l].insert(m_listIds[l].begin(), m_mappedIds + b, m_mappedIds + e);
+				m_listCodes[l].insert(m_listCodes[l].begin(), m_mappedCodes + size_t(b) * m_nSub,
+					m_mappedCodes + size_t(e) * m_nSub);
+			} // end for l
+		}
+		releaseMapping();
+		m_filename.clear();
+		std::vector<unsigned int> offsets(m_nList + 1, 0);
+		for (int l = 0; l < m_nList; l++)
+			offsets[l + 1] = offsets[l] + (unsigned int)m_listIds[l].size();
+
+		QFile file(filename);
+		if (!file.open(QIODevice::WriteOnly))
+			return false;
+		IvfPqFileHeader header;
+		header.magic = g_ivfPqMagic;
+		header.version = g_ivfPqVersion;
+		header.dim = m_dim;
+		header.nList = m_nList;
+		header.nSub = m_nSub;
+		header.nVectors = offsets[m_nList];
+		header.keysOffset = sizeof(header) + sizeof(float) * (m_centers.size() + m_codebooks.size())
+			+ sizeof(unsigned int) * offsets.size() + (sizeof(int) + m_nSub) * (unsigned long long)header.nVectors;
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)m_centers.data(), sizeof(float) * m_centers.size());
+		file.write((const char*)m_codebooks.data(), sizeof(float) * m_codebooks.size());
+		file.write((const char*)offsets.data(), sizeof(unsigned int) * offsets.size());
+		for (int l = 0; l < m_nList; l++)
+			file.write((const char*)m_listIds[l].data(), sizeof(int) * m_listIds[l].size());
+		for (int l = 0; l < m_nList; l++)
+			file.write((const char*)m_listCodes[l].data(), m_listCodes[l].size());
+		if (file.pos() != (qint64)header.keysOffset)
+			return false;
+		QDataStream stm(&file);
+		stm.setVersion(QDataStream::Qt_5_3);
+		stm << m_keys;
+		if (stm.status() != QDataStream::Ok)
+			return false;
+		file.close();
+
+		QFile::remove(ivfPqLogName(filename));
+		return open(filename);
+	}
+
+	bool IvfPqIndex::open(QString filename)
+	{
+		clear();
+		m_file.reset(new QFile(filename));
+		if (!m_file->open(QIODevice::ReadOnly) || m_file->size() < (qint64)sizeof(IvfPqFileHeader))
+		{
+			clear();
+			return false;
+		}
+		m_mapped = m_file->map(0, m_file->size());
+		if (!m_mapped)
+		{
+			clear();
+			return false;
+		}
+
+		// validate the layout before touching the sections
+		const IvfPqFileHeader& header = *(const IvfPqFileHeader*)m_mapped;
+		if (header.magic != g_ivfPqMagic || header.version != g_ivfPqVersion
+			|| header.nSub == 0 || header.dim % header.nSub != 0 || header.nList == 0)
+		{
+			clear();
+			return false;
+		}
+		const unsigned long long expectedKeysOffset = sizeof(header)
+			+ sizeof(float) * (unsigned long long)header.dim * (header.nList + NumCodes)
+			+ sizeof(unsigned int) * (header.nList + 1ull)
+			+ (sizeof(int) + header.nSub) * (unsigned long long)header.nVectors;
+		if (header.keysOffset != expectedKeysOffset || header.keysOffset > (unsigned long long)m_file->size())
+		{
+			clear();
+			return false;
+		}
+
+		m_dim = header.dim;
+		m_nList = header.nList;
+		m_nSub = header.nSub;
+		m_subDim = m_dim / m_nSub;
+		const float* fptr = (const float*)(m_mapped + sizeof(header));
+		m_centers = Eigen::Map<const Matf>(fptr, m_dim, m_nList);
+		m_centerSqrNorms = m_centers.colwise().squaredNorm().transpose();
+		fptr += m_centers.size();
+		m_codebooks = Eigen::Map<const Matf>(fptr, m_subDim, m_nSub * NumCodes);
+		fptr += m_codebooks.size();
+		m_mappedListOffsets = (const unsigned int*)fptr;
+		m_mappedIds = (const int*)(m_mappedListOffsets + m_nList + 1);
+		m_mappedCodes = (const unsigned char*)(m_mappedIds + header.nVectors);
+		m_listIds.resize(m_nList);
+		m_listCodes.resize(m_nList);
+
+		// the lists are ranges of the ids, ascending from 0 to nVectors, and the ids index the keys
+		bool layoutValid = m_mappedListOffsets[0] == 0 && m_mappedListOffsets[m_nList] == header.nVectors;
+		for (int l = 0; l < m_nList && layoutValid; l++)
+			layoutValid = m_mappedListOffsets[l] <= m_mappedListOffsets[l + 1]
+			&& m_mappedListOffsets[l + 1] <= header.nVectors;
+		for (unsigned int i = 0; i < header.nVectors && layoutValid; i++)
+			layoutValid = m_mappedIds[i] >= 0 && (unsigned int)m_mappedIds[i] < header.nVectors;
+		if (!layoutValid)
+		{
+			clear();
+			return false;
+		}
+
+		m_file->seek(header.keysOffset);
+		QDataStream stm(m_file.data());
+		stm.setVersion(QDataStream::Qt_5_3);
+		stm >> m_keys;
+		if (stm.status() != QDataStream::Ok || m_keys.size() != (int)header.nVectors)
+		{
+			clear();
+			return false;
+		}
+		for (int i = 0; i < m_keys.size(); i++)
+			m_keyIds.insert(m_keys[i], i);
+
+		// vectors added after the last save
+		QFile logFile(ivfPqLogName(filename));
+		if (logFile.exists() && logFile.open(QIODevice::ReadOnly))
+		{
+			QDataStream logStm(&logFile);
+			logStm.setVersion(QDataStream::Qt_5_3);
+			while (!logStm.atEnd())
+			{
+				QString key;
+				quint32 list = 0;
+				QByteArray code;
+				logStm >> key >> list >> code;
+				if (logStm.status() != QDataStream::Ok)
+					break;
+				if (list >= (quint32)m_nList || code.size() != m_nSub || m_keyIds.contains(key))
+					continue;
+				const int id = m_keys.size();
+				m_keys.push_back(key);
+				m_keyIds.insert(key, id);
+				appendToList(list, id, (const unsigned char*)code.constData());
+			} // end while
+		}
+		m_filename = filename;
+		return true;
+	}
+}
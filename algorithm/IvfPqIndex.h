@@ -0,0 +1,88 @@
+#pragma once
+
+#include "util.h"
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QFile>
+#include <QScopedPointer>
+
+namespace ldp
+{
+	// approximate nearest-neighbour index on float vectors with L2 distance
+	//	IVF: vectors are bucketed to the nearest of nList coarse centers (kmeans)
+	//	PQ: the residual to the center is split into M sub-vectors, each encoded by
+	//		the nearest of 256 codewords (kmeans per sub-space), thus M bytes per vector.
+	// a query only scans the codes in the nProbe nearest buckets, with per-bucket lookup
+	// tables of sub-distances; larger nProbe gives higher recall and slower queries.
+	//
+	// persistence:
+	//	<file>: centers, codebooks and bucketed codes, memory-mapped on open()
+	//	<file>.log: vectors added after the last save(), appended by add() and
+	//		read into memory on open(); save() merges them into <file>.
+	// each vector is identified by a string key, E.G., the pattern name.
+	class IvfPqIndex
+	{
+	public:
+		enum{ NumCodes = 256 };
+	public:
+		IvfPqIndex();
+		~IvfPqIndex();
+
+		void clear();
+		bool isTrained()const { return m_nList > 0; }
+		int dim()const { return m_dim; }
+		int numLists()const { return m_nList; }
+		int size()const { return m_keys.size(); }
+		const QString& key(int id)const { return m_keys[id]; }
+		bool contains(const QString& key)const { return m_keyIds.contains(key); }
+
+		// train on a random subset of @data (dim x N) of at most @maxTrainSamples columns
+		// @dim must be divisible by @nSubQuantizers; all added vectors are dropped.
+		void train(const Matf& data, int nList, int nSubQuantizers, int maxTrainSamples = 65536);
+
+		// encode and append the columns of @data, one key per column
+		// if the index was opened from or saved to a file, they are also appended to its log
+		void add(const Matf& data, const QStringList& keys);
+
+		// the (approximate) k nearest vectors of @query, sorted by squared L2 distance
+		void search(const float* query, int k, int nProbe, std::vector<int>& ids,
+			std::vector<float>& dists)const;
+
+		bool save(QString filename);
+		bool open(QString filename);
+		const QString& filename()const { return m_filename; }
+	protected:
+		void releaseMapping();
+		void assignLists(const Matf& data, std::vector<int>& lists)const;
+		void encode(const float* residual, unsigned char* code)const;
+		void appendToList(int list, int id, const unsigned char* code);
+		bool appendLog(const QStringList& keys, const std::vector<int>& lists,
+			const std::vector<unsigned char>& codes)const;
+	private:
+		IvfPqIndex(const IvfPqIndex&);
+		IvfPqIndex& operator=(const IvfPqIndex&);
+	protected:
+		int m_dim;
+		int m_nList;
+		int m_nSub;
+		int m_subDim;
+		Matf m_centers;				// dim x nList
+		Vecf m_centerSqrNorms;		// nList
+		Matf m_codebooks;			// subDim x (nSub * NumCodes), codeword j of sub-space m at column m*NumCodes+j
+		QStringList m_keys;
+		QHash<QString, int> m_keyIds;
+
+		// codes saved in the file, bucketed by list, pointing into the mapped memory
+		QScopedPointer<QFile> m_file;
+		unsigned char* m_mapped;
+		const unsigned int* m_mappedListOffsets;	// nList + 1
+		const int* m_mappedIds;
+		const unsigned char* m_mappedCodes;
+
+		// codes added after the file is saved
+		std::vector<std::vector<int>> m_listIds;
+		std::vector<std::vector<unsigned char>> m_listCodes;
+		QString m_filename;
+	};
+}
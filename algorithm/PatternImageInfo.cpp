@@ -2,7 +2,14 @@
 #include "util.h"
 #include <QFileinfo>
 #include <QDir>
-#include <QPixmapCache>
+#include <QImageReader>
+#include <QCache>
+#include <QMutex>
+
+// decoded images, by kb, up to about 2GB
+static QCache<QString, QImage> g_imageCache(1024 * 2047);
+static QMutex g_imageCacheMutex;
+
 PatternImageInfo::PatternImageInfo()
 {
 	setDefaultTypes();
@@ -44,22 +51,46 @@ QString PatternImageInfo::getImageName(int i)const
 	return m_imgNames.at(i);
 }
 
-QPixmap* PatternImageInfo::getImage(int i)const
+QImage PatternImageInfo::getImage(int i, QSize maxSize)const
 {
-	return getImage(getImageName(i));
+	return getImage(getImageName(i), maxSize);
 }
 
-QPixmap* PatternImageInfo::getImage(QString name)
+QImage PatternImageInfo::getImage(QString name, QSize maxSize)
 {
-	QPixmap* p = QPixmapCache::find(name);
-	if (p == nullptr)
+	const QString key = maxSize.isValid() ? name + QString().sprintf("|%dx%d", maxSize.width(), maxSize.height()) : name;
+	{
+		QMutexLocker lock(&g_imageCacheMutex);
+		const QImage* p = g_imageCache.object(name);
+		if (p == nullptr && key != name)
+			p = g_imageCache.object(key);
+		if (p)
+			return *p;
+	}
+
+	// decoded out of the lock, thus threads decode different images at the same time
+	QImageReader reader(name);
+	const QSize sz = reader.size();
+	const bool scaled = maxSize.isValid() && sz.isValid()
+		&& (sz.width() > maxSize.width() || sz.height() > maxSize.height());
+	if (scaled)
+		reader.setScaledSize(sz.scaled(maxSize, Qt::KeepAspectRatio));
+	QImage img = reader.read();
+
+	// the full image replaces the scaled ones of any size
+	QMutexLocker lock(&g_imageCacheMutex);
+	if (!scaled)
 	{
-		QPixmapCache::insert(name, QPixmap(name));
-		p = QPixmapCache::find(name);
-		if (p == nullptr)
-			throw std::exception("cache pixelmap failed!");
+		const QString prefix = name + "|";
+		const QStringList keys = g_imageCache.keys();
+		for (int i = 0; i < keys.size(); i++)
+		{
+			if (keys[i].startsWith(prefix))
+				g_imageCache.remove(keys[i]);
+		}
 	}
-	return p;
+	g_imageCache.insert(scaled ? key : name, new QImage(img), std::max(1, img.byteCount() / 1024));
+	return img;
 }
 
 void PatternImageInfo::clearImages()
@@ -295,9 +326,6 @@ bool PatternImageInfo::s_mapInitialized = PatternImageInfo::constructTypeMaps();
 
 bool PatternImageInfo::constructTypeMaps()
 {
-	// seems not larger than 2GB..32bit int
-	QPixmapCache::setCacheLimit(1024*2047); // kb
-
 	QString filename = "__attributes.xml";
 	bool r = constructTypeMaps_qxml(filename);
 	if (!r)
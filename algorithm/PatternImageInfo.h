@@ -7,7 +7,7 @@
 #include <qxml.h>
 #include <qxmlstream.h>
 #include "tinyxml\tinyxml.h"
-#include <QPixmap>
+#include <QImage>
 class PatternImageInfo
 {
 public:
@@ -17,7 +17,8 @@ public:
 	void clear();
 	int numImages()const;
 	QString getImageName(int i)const;
-	QPixmap* getImage(int i)const;
+	// see getImage(QString, QSize)
+	QImage getImage(int i, QSize maxSize = QSize())const;
 	void clearImages();
 	void addImage(const QString& name);
 	void setBaseName(const QString& name);
@@ -52,7 +53,13 @@ public:
 	static int numJdAttributes() { return (int)s_jd2typeMap.size(); }
 	static QPair<QString, QString> jdAttributeMapped(QString jdAttName, QString jdType);
 	static void addJdAttributeMap(QString jdAttName, QString attName, QString jdType, QString type);
-	static QPixmap* getImage(QString s);
+	// decoded by QImageReader, thus from any thread, and cached by name and size; the copies share the
+	// pixels, null if it cannot be read
+	// @maxSize: if valid and smaller than the image, decoded directly at the largest size within it keeping
+	// the aspect ratio, E.G., for icons and previews, in device pixels; unless the full image is cached
+	// already, which is returned as it costs nothing. an image within @maxSize is cached as the full one,
+	// replacing the scaled ones
+	static QImage getImage(QString s, QSize maxSize = QSize());
 	static void setPatternXmlName(QString s) { s_patternXml = s; }
 	static QString getPatternXmlName() { return s_patternXml; }
 protected:
@@ -0,0 +1,310 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#undef min
+#undef max
+
+#ifdef _MSC_VER
+#define LDP_THREAD_LOCAL __declspec(thread)
+#else
+#define LDP_THREAD_LOCAL __thread
+#endif
+
+namespace ldp
+{
+	//////////////////////////////////////////////////////////////////////////
+	// ScratchArena
+	const static size_t g_scratchMinBlockSize = 1 << 20;
+
+	ScratchArena::Scope::Scope(ScratchArena& arena) : m_arena(arena),
+		m_block(arena.m_block), m_offset(arena.m_offset)
+	{
+	}
+
+	ScratchArena::Scope::~Scope()
+	{
+		m_arena.m_block = m_block;
+		m_arena.m_offset = m_offset;
+	}
+
+	ScratchArena::ScratchArena() : m_block(0), m_offset(0)
+	{
+	}
+
+	ScratchArena::~ScratchArena()
+	{
+		for (size_t i = 0; i < m_blocks.size(); i++)
+			delete[] m_blocks[i].data;
+	}
+
+	void* ScratchArena::allocate(size_t bytes, size_t alignment)
+	{
+		for (; m_block < m_blocks.size(); m_block++, m_offset = 0)
+		{
+			const Block& b = m_blocks[m_block];
+			const size_t addr = (size_t)b.data + m_offset;
+			const size_t begin = m_offset + (alignment - addr % alignment) % alignment;
+			if (begin + bytes <= b.size)
+			{
+				m_offset = begin + bytes;
+				return b.data + begin;
+			}
+		} // end for m_block
+
+		// blocks grow geometrically, the old ones are kept for the outer scopes
+		Block b;
+		b.size = std::max(bytes + alignment, std::max(g_scratchMinBlockSize,
+			m_blocks.empty() ? 0 : m_blocks.back().size * 2));
+		b.data = new char[b.size];
+		m_blocks.push_back(b);
+		m_block = m_blocks.size() - 1;
+		m_offset = 0;
+		return allocate(bytes, alignment);
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// ThreadPool::TaskQueue
+	void ThreadPool::TaskQueue::push_back(const Task& task)
+	{
+		if (m_size == m_ring.size())
+		{
+			std::vector<Task> ring(std::max<size_t>(64, m_ring.size() * 2));
+			for (size_t i = 0; i < m_size; i++)
+				ring[i] = m_ring[(m_head + i) % m_ring.size()];
+			m_ring.swap(ring);
+			m_head = 0;
+		}
+		m_ring[(m_head + m_size) % m_ring.size()] = task;
+		m_size++;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// ThreadPool
+	static LDP_THREAD_LOCAL int s_currentWorker = -1;
+	static std::mutex g_threadPoolMutex;
+	static ThreadPool* g_threadPool = nullptr;
+
+	ThreadPool& ThreadPool::instance()
+	{
+		std::lock_guard<std::mutex> lock(g_threadPoolMutex);
+		// never destroyed: joining threads in static destructors may hang on exit
+		if (g_threadPool == nullptr)
+			g_threadPool = new ThreadPool(std::max(1, (int)std::thread::hardware_concurrency()));
+		return *g_threadPool;
+	}
+
+	int ThreadPool::currentWorker()
+	{
+		return s_currentWorker;
+	}
+
+	ThreadPool::ThreadPool(int numWorkers) : m_numQueued(0), m_maxThreads(numWorkers), m_stop(false)
+	{
+		for (int i = 0; i < numWorkers; i++)
+			m_workers.push_back(std::unique_ptr<Worker>(new Worker()));
+		for (int i = 0; i < numWorkers; i++)
+			m_workers[i]->thread = std::thread(&ThreadPool::workerLoop, this, i);
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+			m_stop = true;
+		}
+		m_sleepCv.notify_all();
+		m_parkCv.notify_all();
+		for (size_t i = 0; i < m_workers.size(); i++)
+			m_workers[i]->thread.join();
+	}
+
+	void ThreadPool::setMaxThreads(int n)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+			m_maxThreads = std::max(1, std::min(n, numWorkers()));
+		}
+		m_sleepCv.notify_all();
+		m_parkCv.notify_all();
+	}
+
+	void ThreadPool::wake()
+	{
+		// taking the lock orders this with the check of a worker going to sleep
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+		}
+		m_sleepCv.notify_one();
+	}
+
+	void ThreadPool::push(int worker, const Task& task)
+	{
+		if (worker >= 0)
+		{
+			std::lock_guard<std::mutex> lock(m_workers[worker]->mutex);
+			m_workers[worker]->tasks.push_back(task);
+		}
+		else
+		{
+			std::lock_guard<std::mutex> lock(m_injectMutex);
+			m_injected.push_back(task);
+		}
+		m_numQueued++;
+		wake();
+	}
+
+	bool ThreadPool::take(int worker, Task& task)
+	{
+		if (m_numQueued == 0)
+			return false;
+
+		// own tasks, newest first
+		{
+			Worker& w = *m_workers[worker];
+			std::lock_guard<std::mutex> lock(w.mutex);
+			if (!w.tasks.empty())
+			{
+				task = w.tasks.back();
+				w.tasks.pop_back();
+				m_numQueued--;
+				return true;
+			}
+		}
+
+		// tasks from out of the pool
+		{
+			std::lock_guard<std::mutex> lock(m_injectMutex);
+			if (!m_injected.empty())
+			{
+				task = m_injected.front();
+				m_injected.pop_front();
+				m_numQueued--;
+				return true;
+			}
+		}
+
+		// steal the oldest, thus biggest, task of the others
+		const int n = numWorkers();
+		for (int i = 1; i < n; i++)
+		{
+			Worker& w = *m_workers[(worker + i) % n];
+			std::lock_guard<std::mutex> lock(w.mutex);
+			if (!w.tasks.empty())
+			{
+				task = w.tasks.front();
+				w.tasks.pop_front();
+				m_numQueued--;
+				return true;
+			}
+		} // end for i
+		return false;
+	}
+
+	void ThreadPool::run(int worker, Task task)
+	{
+		Job& job = *task.job;
+
+		// split lazily, the second halves are left for the others to steal
+		while (task.end - task.begin > job.grain)
+		{
+			const int mid = task.begin + (task.end - task.begin) / 2;
+			Task right = { task.job, mid, task.end };
+			push(worker, right);
+			task.end = mid;
+		}
+
+		if (!job.failed)
+		{
+			try
+			{
+				(*job.body)(task.begin, task.end);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(job.mutex);
+				if (!job.failed)
+					job.error = std::current_exception();
+				job.failed = true;
+			}
+		}
+
+		if ((job.remaining -= task.end - task.begin) == 0)
+		{
+			// the waiter may destroy the job once done is set and the lock is released
+			std::lock_guard<std::mutex> lock(job.mutex);
+			job.done = true;
+			job.cv.notify_all();
+		}
+	}
+
+	void ThreadPool::workerLoop(int id)
+	{
+		s_currentWorker = id;
+		for (;;)
+		{
+			Task task;
+			if (id < m_maxThreads && take(id, task))
+			{
+				run(id, task);
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(m_sleepMutex);
+			if (m_stop)
+				return;
+			// workers above the limit wait apart, so that wake() never picks one of them
+			if (id >= m_maxThreads)
+				m_parkCv.wait(lock);
+			else if (m_numQueued == 0)
+				m_sleepCv.wait(lock);
+		} // end for
+	}
+
+	void ThreadPool::parallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body)
+	{
+		if (end <= begin)
+			return;
+		const int n = end - begin;
+		if (grain <= 0)
+			grain = std::max(1, n / (8 * m_maxThreads));
+
+		const int worker = currentWorker();
+
+		// a single chunk inside a task runs right away
+		if (worker >= 0 && n <= grain)
+		{
+			body(begin, end);
+			return;
+		}
+
+		Job job;
+		job.body = &body;
+		job.grain = grain;
+		job.remaining = n;
+		job.failed = false;
+		job.done = false;
+		Task root = { &job, begin, end };
+
+		if (worker >= 0)
+		{
+			// keep working while waiting, on this job or any other
+			run(worker, root);
+			while (job.remaining > 0)
+			{
+				Task task;
+				if (take(worker, task))
+					run(worker, task);
+				else
+					std::this_thread::yield();
+			} // end while
+		}
+		else
+			push(-1, root);
+
+		std::unique_lock<std::mutex> lock(job.mutex);
+		while (!job.done)
+			job.cv.wait(lock);
+		lock.unlock();
+
+		if (job.error)
+			std::rethrow_exception(job.error);
+	}
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <exception>
+
+namespace ldp
+{
+	// bump allocator of temporary memory, one per pool worker
+	// memory comes from blocks that are never moved or freed before destruction, thus pointers stay
+	// valid when nested tasks on the same worker allocate more; a Scope releases what is allocated
+	// inside it. only for POD types, nothing is constructed.
+	class ScratchArena
+	{
+	public:
+		class Scope
+		{
+		public:
+			Scope(ScratchArena& arena);
+			~Scope();
+		private:
+			Scope(const Scope&);
+			Scope& operator=(const Scope&);
+		private:
+			ScratchArena& m_arena;
+			size_t m_block;
+			size_t m_offset;
+		};
+	public:
+		ScratchArena();
+		~ScratchArena();
+
+		void* allocate(size_t bytes, size_t alignment = 64);
+		template<class T> T* allocate(size_t n){ return (T*)allocate(n * sizeof(T)); }
+	private:
+		ScratchArena(const ScratchArena&);
+		ScratchArena& operator=(const ScratchArena&);
+	private:
+		struct Block
+		{
+			char* data;
+			size_t size;
+		};
+		std::vector<Block> m_blocks;
+		size_t m_block;		// the block being allocated from
+		size_t m_offset;	// bytes used in it
+	};
+
+	// work-stealing thread pool shared by the algorithm layer
+	// each worker owns a deque of tasks: it pushes and pops at the back, while idle workers steal
+	// from the front of the others. parallelFor() splits its range lazily in halves down to the
+	// grain, thus big chunks are stolen first; nested parallelFor() calls from a task run on the
+	// same workers, which keep executing tasks while waiting, instead of spawning more threads.
+	class ThreadPool
+	{
+	public:
+		// created on first use, with one worker per hardware thread
+		static ThreadPool& instance();
+
+		// index of the calling worker in [0, numWorkers()), -1 for threads out of the pool
+		static int currentWorker();
+
+		int numWorkers()const { return (int)m_workers.size(); }
+
+		// runtime concurrency limit in [1, numWorkers()], workers above it stay idle
+		void setMaxThreads(int n);
+		int maxThreads()const { return m_maxThreads; }
+
+		// per-worker temporary memory
+		ScratchArena& scratch(int worker) { return m_workers[worker]->scratch; }
+
+		// scratch of the calling worker, only valid inside pool tasks
+		ScratchArena& scratch() { return scratch(currentWorker()); }
+
+		// body(b, e) on disjoint sub-ranges covering [begin, end), each of at most @grain elements
+		// bodies always run on the workers; it returns when all are done, rethrowing the first
+		// exception thrown by them.
+		// @grain: <= 0 for about 8 chunks per thread
+		void parallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body);
+	protected:
+		struct Job
+		{
+			const std::function<void(int, int)>* body;
+			int grain;
+			std::atomic<int> remaining;	// elements not yet processed
+			std::atomic<bool> failed;
+			std::exception_ptr error;
+			bool done;
+			std::mutex mutex;
+			std::condition_variable cv;
+		};
+		struct Task
+		{
+			Job* job;
+			int begin;
+			int end;
+		};
+		// double-ended queue in a ring which only grows, thus, unlike std::deque freeing and
+		// reallocating its blocks, pushing and popping allocates nothing once warm
+		class TaskQueue
+		{
+		public:
+			TaskQueue() : m_head(0), m_size(0){}
+			bool empty()const { return m_size == 0; }
+			Task& front() { return m_ring[m_head]; }
+			Task& back() { return m_ring[(m_head + m_size - 1) % m_ring.size()]; }
+			void push_back(const Task& task);
+			void pop_front() { m_head = (m_head + 1) % m_ring.size(); m_size--; }
+			void pop_back() { m_size--; }
+		private:
+			std::vector<Task> m_ring;
+			size_t m_head;
+			size_t m_size;
+		};
+		struct Worker
+		{
+			std::thread thread;
+			std::mutex mutex;
+			TaskQueue tasks;
+			ScratchArena scratch;
+		};
+	protected:
+		ThreadPool(int numWorkers);
+		~ThreadPool();
+		void workerLoop(int id);
+		void push(int worker, const Task& task);
+		bool take(int worker, Task& task);
+		void run(int worker, Task task);
+		void wake();
+	private:
+		ThreadPool(const ThreadPool&);
+		ThreadPool& operator=(const ThreadPool&);
+	protected:
+		std::vector<std::unique_ptr<Worker>> m_workers;
+		std::mutex m_injectMutex;
+		TaskQueue m_injected;		// tasks from threads out of the pool
+		std::atomic<int> m_numQueued;
+		std::atomic<int> m_maxThreads;
+		std::mutex m_sleepMutex;
+		std::condition_variable m_sleepCv;
+		std::condition_variable m_parkCv;
+		bool m_stop;
+	};
+
+	// ThreadPool::instance().parallelFor(), for lambdas
+	// @body is wrapped by reference, thus nothing is allocated for its captures
+	template<class F> inline void parallelFor(int begin, int end, int grain, const F& body)
+	{
+		ThreadPool::instance().parallelFor(begin, end, grain, std::function<void(int, int)>(std::cref(body)));
+	}
+}
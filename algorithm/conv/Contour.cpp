@@ -0,0 +1,248 @@
+#include "Contour.h"
+#include <algorithm>
+#include <climits>
+#include <unordered_map>
+namespace ldp
+{
+#undef min
+#undef max
+	// rows of cells per task as poisson_row_grain()
+	static int contour_row_grain(int width)
+	{
+		return std::max(1, 16384 / std::max(1, width));
+	}
+
+	// a step of a contour of @label through a cell, from the crossing @from of one of its sides to @to
+	// a crossing is the middle of the border between pixel (x, y) and its right (dir 0) or bottom (dir 1)
+	// neighbor, keyed by ((y + 1) * (width + 2) + x + 1) * 2 + dir, the padding pixels included
+	struct ContourSegment
+	{
+		int label;
+		int from;
+		int to;
+	};
+
+	static int contour_key(int x, int y, int dir, int width)
+	{
+		return ((y + 1) * (width + 2) + x + 1) * 2 + dir;
+	}
+
+	static ldp::Float2 contour_point(int key, int width)
+	{
+		const int p = key >> 1, x = p % (width + 2) - 1, y = p / (width + 2) - 1;
+		if (key & 1)
+			return ldp::Float2(x + 0.5f, y + 1.f);
+		return ldp::Float2(x + 1.f, y + 0.5f);
+	}
+
+	// the segments of the cell of top-left pixel (x, y), @id[4] of its pixels a, b, c, d clockwise from the
+	// top-left, -1 for the padding ones
+	// side k goes from pixel k to k + 1; a contour enters at the sides from a pixel out of the label to one
+	// in, and leaves at the sides from one in to one out, thus the label is always on the same side and
+	// the neighbor cell, running along the shared side the other way, continues from the same crossing.
+	// at a saddle, two pixels of the label at opposite corners, entering at side k leaves at side k - 1
+	// for them to be joined, or at side k + 1 for them to be split.
+	static void contour_cell(std::vector<ContourSegment>& segs, const int id[4], int x, int y, int width,
+		int background)
+	{
+		const int sides[4] = { contour_key(x, y, 0, width), contour_key(x + 1, y, 1, width),
+			contour_key(x, y + 1, 0, width), contour_key(x, y, 1, width) };
+		for (int k = 0; k < 4; k++)
+		{
+			const int label = id[k];
+			bool visited = label < 0 || label == background;
+			for (int j = 0; j < k && !visited; j++)
+				visited = id[j] == label;
+			if (visited)
+				continue;
+
+			int in = 0;
+			for (int j = 0; j < 4; j++)
+				in |= (id[j] == label) << j;
+			if (in == 15)
+				continue;
+			int step = 1;
+			if (in == 5 || in == 10)
+			{
+				// joined, unless the other diagonal is a smaller label, joined itself
+				const int other = id[in == 5 ? 1 : 0];
+				const bool otherJoined = other == id[in == 5 ? 3 : 2] && other >= 0 && other != background
+					&& other < label;
+				step = otherJoined ? 1 : 3;
+			}
+			for (int s = 0; s < 4; s++)
+			{
+				if ((in >> s & 1) || !(in >> ((s + 1) & 3) & 1))
+					continue;
+				int e = (s + step) & 3;
+				if (in != 5 && in != 10)
+				while (!(in >> e & 1) || (in >> ((e + 1) & 3) & 1))
+					e = (e + 1) & 3;
+				ContourSegment seg;
+				seg.label = label;
+				seg.from = sides[s];
+				seg.to = sides[e];
+				segs.push_back(seg);
+			} // end for s
+		} // end for k
+	}
+
+	static double contour_dist2(const ldp::Float2& p, const ldp::Float2& a, const ldp::Float2& b)
+	{
+		const double abx = b[0] - a[0], aby = b[1] - a[1], apx = p[0] - a[0], apy = p[1] - a[1];
+		const double len2 = abx * abx + aby * aby;
+		double t = len2 > 0 ? (apx * abx + apy * aby) / len2 : 0;
+		t = std::min(1.0, std::max(0.0, t));
+		const double dx = apx - t * abx, dy = apy - t * aby;
+		return dx * dx + dy * dy;
+	}
+
+	// Douglas-Peucker of the closed contour @pts[0, n) appended to @out, the vertex 0 and the farthest
+	// from it anchored; by an explicit stack, as contours of large regions have thousands of vertices
+	static void contour_simplify(std::vector<ldp::Float2>& out, const ldp::Float2* pts, int n, float tolerance)
+	{
+		int apex = 0;
+		double apexDist = -1;
+		for (int i = 1; i < n; i++)
+		{
+			const double dx = pts[i][0] - pts[0][0], dy = pts[i][1] - pts[0][1];
+			if (dx * dx + dy * dy > apexDist)
+			{
+				apexDist = dx * dx + dy * dy;
+				apex = i;
+			}
+		}
+		std::vector<char> keep(n, 0);
+		keep[0] = keep[apex] = 1;
+		const double tol2 = (double)tolerance * tolerance;
+		std::vector<std::pair<int, int>> stack;
+		stack.push_back(std::make_pair(0, apex));
+		stack.push_back(std::make_pair(apex, n));
+		while (!stack.empty())
+		{
+			const int first = stack.back().first, last = stack.back().second;
+			stack.pop_back();
+			const ldp::Float2& a = pts[first], &b = pts[last % n];
+			int best = -1;
+			double bestDist = tol2;
+			for (int i = first + 1; i < last; i++)
+			{
+				const double d = contour_dist2(pts[i], a, b);
+				if (d > bestDist)
+				{
+					bestDist = d;
+					best = i;
+				}
+			}
+			if (best < 0)
+				continue;
+			keep[best] = 1;
+			stack.push_back(std::make_pair(first, best));
+			stack.push_back(std::make_pair(best, last));
+		} // end while stack
+
+		const size_t begin = out.size();
+		for (int i = 0; i < n; i++)
+		if (keep[i])
+			out.push_back(pts[i]);
+		if (out.size() - begin < 3)
+		{
+			out.resize(begin);
+			out.insert(out.end(), pts, pts + n);
+		}
+	}
+
+	// links the segments of a label into closed contours
+	static void contour_link(LabelContours& lc, const ContourSegment* segs, int num, int width, float tolerance)
+	{
+		std::unordered_map<int, int> next;
+		next.reserve(num * 2);
+		for (int i = 0; i < num; i++)
+			next[segs[i].from] = i;
+		std::vector<char> visited(num, 0);
+		std::vector<ldp::Float2> pts;
+		for (int i = 0; i < num; i++)
+		{
+			if (visited[i])
+				continue;
+			pts.clear();
+			for (int s = i; !visited[s];)
+			{
+				visited[s] = 1;
+				pts.push_back(contour_point(segs[s].from, width));
+				auto it = next.find(segs[s].to);
+				if (it == next.end())
+					throw std::exception("extractLabelContours: open contour");
+				s = it->second;
+			}
+			const size_t begin = lc.verts.size();
+			if (tolerance < 0)
+				lc.verts.insert(lc.verts.end(), pts.begin(), pts.end());
+			else
+				contour_simplify(lc.verts, pts.data(), (int)pts.size(), tolerance);
+			lc.contourSizes.push_back(int(lc.verts.size() - begin));
+		} // end for i
+	}
+
+	void extractLabelContours(const MaskImage& ids, std::vector<LabelContours>& labels, float tolerance,
+		int background)
+	{
+		labels.clear();
+		const int width = ids.width(), height = ids.height();
+		if (width == 0 || height == 0)
+			return;
+		if ((long long)(width + 2) * (height + 2) * 2 > INT_MAX)
+			throw std::exception("extractLabelContours: mask too large");
+
+		// cells of the padded mask, top-left pixel in [-1, width) x [-1, height), scanned by chunks of rows
+		const int numRows = height + 1, grain = contour_row_grain(width);
+		const int numChunks = (numRows + grain - 1) / grain;
+		std::vector<std::vector<ContourSegment>> chunks(numChunks);
+		ldp::parallelFor(0, numChunks, 1, [&](int cb, int ce)
+		{
+			for (int c = cb; c < ce; c++)
+			{
+				std::vector<ContourSegment>& segs = chunks[c];
+				const int yb = c * grain - 1, ye = std::min(yb + grain, height);
+				for (int y = yb; y < ye; y++)
+				{
+					const unsigned char* r0 = y >= 0 ? ids.data_XY(0, y) : 0;
+					const unsigned char* r1 = y + 1 < height ? ids.data_XY(0, y + 1) : 0;
+					for (int x = -1; x < width; x++)
+					{
+						const int id[4] = {
+							r0 && x >= 0 ? r0[x] : -1, r0 && x + 1 < width ? r0[x + 1] : -1,
+							r1 && x + 1 < width ? r1[x + 1] : -1, r1 && x >= 0 ? r1[x] : -1 };
+						if (id[0] == id[1] && id[0] == id[2] && id[0] == id[3])
+							continue;
+						contour_cell(segs, id, x, y, width, background);
+					}
+				} // end for y
+			} // end for c
+		});
+
+		std::vector<ContourSegment> segs;
+		for (const auto& c : chunks)
+			segs.insert(segs.end(), c.begin(), c.end());
+		chunks.clear();
+		std::stable_sort(segs.begin(), segs.end(), [](const ContourSegment& a, const ContourSegment& b)->bool
+		{
+			return a.label < b.label;
+		});
+		std::vector<int> starts;
+		for (int i = 0; i < (int)segs.size(); i++)
+		if (i == 0 || segs[i].label != segs[i - 1].label)
+			starts.push_back(i);
+		starts.push_back((int)segs.size());
+
+		labels.resize(starts.size() - 1);
+		ldp::parallelFor(0, (int)labels.size(), 1, [&](int lb, int le)
+		{
+			for (int l = lb; l < le; l++)
+			{
+				labels[l].label = segs[starts[l]].label;
+				contour_link(labels[l], segs.data() + starts[l], starts[l + 1] - starts[l], width, tolerance);
+			}
+		});
+	}
+}
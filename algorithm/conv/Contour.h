@@ -0,0 +1,32 @@
+#pragma once
+#include "ImageData.h"
+#include <vector>
+namespace ldp
+{
+	// the outlines of one label of an id mask
+	// @contourSizes: the number of vertices of each closed contour, stored one after another in @verts,
+	// thus they are drawn or filled back by rasterizePolygons() of Rasterize.h
+	struct LabelContours
+	{
+		int label;
+		std::vector<ldp::Float2> verts;
+		std::vector<int> contourSizes;
+	};
+
+	// vector outlines of the regions of each id of a label mask, E.G., the "_label.png" ones
+	// marching squares over the pixel centers, the mask being padded by pixels of no label, thus every
+	// contour is closed; the vertices are at the middle of the pixel borders crossed, pixel (x, y)
+	// covering [x, x + 1) x [y, y + 1) as in rasterizePolygons(). holes are contours of the opposite
+	// orientation and pixels touching by a corner are joined, for two labels meeting at the corner the
+	// smaller one is joined and the other is split, thus the outlines never cross.
+	// the cells are scanned once for all the labels, the rows split among the threads, and the contours
+	// of each label are then linked and simplified in parallel by Douglas-Peucker within @tolerance
+	// pixels, < 0 to keep every vertex and 0 to only drop the collinear ones; contours simplified below
+	// a triangle are kept unsimplified.
+	// without simplification, filling the contours by FillEvenOdd or FillNonZero gives back the pixels
+	// of the label.
+	// @labels: one per id present in @ids other than @background, by increasing id
+	// @background: the id not outlined, < 0 for none
+	void extractLabelContours(const MaskImage& ids, std::vector<LabelContours>& labels,
+		float tolerance = 0.5f, int background = 0);
+}
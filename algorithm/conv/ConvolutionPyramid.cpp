@@ -5,6 +5,261 @@ namespace ldp
 #undef max
 	const static int g_zero_padding = 5;
 
+	// the kernels of convolve_boundary()
+	const static float g_boundary_kernel5x5[5] = { 0.1507f, 0.6836f, 1.0334f, 0.6836f, 0.1507f };
+	const static float g_boundary_kernel3x3[3] = { 0.0312f, 0.7753f, 0.0312f };
+	const static float g_boundary_up_mul = sqrt(0.0270f);
+	const static float g_boundary_kernel5x5up[5] = { g_boundary_up_mul * 0.1507f, g_boundary_up_mul * 0.6836f,
+		g_boundary_up_mul * 1.0334f, g_boundary_up_mul * 0.6836f, g_boundary_up_mul * 0.1507f };
+
+	// 0 for empty images
+	static int pyramid_levels(ldp::Int2 res)
+	{
+		if (res[0] <= 0 || res[1] <= 0)
+			return 0;
+		return std::max(1, (int)ceil(log((float)std::max(res[0], res[1])) / log(2.0f)));
+	}
+
+	// the next level is half of the padded one
+	static ldp::Int2 pyramid_down(ldp::Int2 res)
+	{
+		return (res + g_zero_padding * 2) / 2;
+	}
+
+	// floats of an image of @res pixels in the workspace, its rows are aligned
+	static size_t pyramid_view_size(ldp::Int2 res, int channels)
+	{
+		return (size_t)FloatImage::alignedPitch(res[0] * channels) * res[1];
+	}
+
+	static FloatImage pyramid_view(float* ptr, ldp::Int2 res, int channels)
+	{
+		return FloatImage(ptr, res[0] * channels, res[1], FloatImage::alignedPitch(res[0] * channels));
+	}
+
+	// floats of the workspace for an image of @res pixels, see layout()
+	static size_t pyramid_workspace_size(ldp::Int2 res, int channels, ldp::Int2& maxPadded)
+	{
+		const int nLevels = pyramid_levels(res);
+		maxPadded = res + g_zero_padding * 2;
+		size_t sz = 0;
+		for (int i = 1; i < nLevels; i++)
+		{
+			res = pyramid_down(res);
+			sz += pyramid_view_size(res, channels);
+			for (int k = 0; k < 2; k++)
+				maxPadded[k] = std::max(maxPadded[k], res[k] + g_zero_padding * 2);
+		}
+		return nLevels ? sz + 2 * pyramid_view_size(maxPadded, channels) : 0;
+	}
+
+	// the workspace base is aligned to the cache line, the sizes above keep it for each image
+	const static size_t g_workspace_align = 64 / sizeof(float);
+
+	// the filters along x of the rows below, the channels known at compile time when C > 0
+	template<int C> static void pyramid_decimate_x(float* dst, const float* row, int dstWidth,
+		int channels, const float* kernel5x5)
+	{
+		const int nc = C > 0 ? C : channels;
+		for (int x = 0; x < dstWidth; x++)
+		{
+			const float* r = row + 2 * x * nc;
+			float* d = dst + x * nc;
+			for (int c = 0; c < nc; c++)
+			{
+				d[c] = r[c - 2 * nc] * kernel5x5[4] + r[c - nc] * kernel5x5[3] + r[c] * kernel5x5[2]
+					+ r[c + nc] * kernel5x5[1] + r[c + 2 * nc] * kernel5x5[0];
+			}
+		}// end for x
+	}
+
+	template<int C> static void pyramid_upsample_x(float* up, const float* coarse, int paddedWidth,
+		int channels, const float* kernel5x5up)
+	{
+		const int nc = C > 0 ? C : channels;
+		for (int j = 0; j * 2 < paddedWidth; j++)
+		{
+			const float* r = coarse + j * nc;
+			float* u = up + 2 * j * nc;
+			for (int c = 0; c < nc; c++)
+			{
+				u[c] = r[c - nc] * kernel5x5up[4] + r[c] * kernel5x5up[2] + r[c + nc] * kernel5x5up[0];
+				u[c + nc] = r[c] * kernel5x5up[3] + r[c + nc] * kernel5x5up[1];
+			}
+		}// end for j
+	}
+
+	// row @y of an image as floats: the row itself, or decoded into @arena from the narrow storage
+	static const float* pyramid_row(const FloatImage& im, int y, float, float, ldp::ScratchArena&)
+	{
+		return im.data_XY(0, y);
+	}
+	static const float* pyramid_row(const HalfImage& im, int y, float, float, ldp::ScratchArena& arena)
+	{
+		float* row = arena.allocate<float>(im.width());
+		conv_helper::decode_row_simd(row, im.data_XY(0, y), im.width());
+		return row;
+	}
+	template<class T> static const float* pyramid_row(const ImageTemplate<T>& im, int y, float scale,
+		float offset, ldp::ScratchArena& arena)
+	{
+		float* row = arena.allocate<float>(im.width());
+		conv_helper::decode_row_simd(row, im.data_XY(0, y), im.width(), scale, offset);
+		return row;
+	}
+
+	// and back
+	static void pyramid_store_row(float* dst, const float* src, int num, float, float)
+	{
+		memcpy(dst, src, num * sizeof(float));
+	}
+	static void pyramid_store_row(half_float::half* dst, const float* src, int num, float, float)
+	{
+		conv_helper::encode_row_simd(dst, src, num);
+	}
+	template<class T> static void pyramid_store_row(T* dst, const float* src, int num, float scale, float offset)
+	{
+		conv_helper::encode_row_simd(dst, src, num, scale, offset);
+	}
+
+	// row @y of PadConvDecimate5x5() into @dst
+	// @scale, @offset: of imSrc in fixed point, see pyramid_row()
+	template<class T> static void pyramid_decimate_row(float* dst, const ImageTemplate<T>& imSrc,
+		float scale, float offset, int channels, int y, const float* kernel5x5, ldp::ScratchArena& arena)
+	{
+		ldp::ScratchArena::Scope scope(arena);
+		const int C = channels;
+		const ldp::Int2 res(imSrc.width() / C, imSrc.height());
+		const int paddedWidth = res[0] + g_zero_padding * 2;
+		const int dstWidth = paddedWidth / 2;
+
+		// the rows of imSrc under the kernel centered at 2y of the padded image
+		const float* rows[5];
+		float weights[5];
+		int nRows = 0;
+		for (int k = -2; k <= 2; k++)
+		{
+			const int sy = 2 * y + k - g_zero_padding;
+			if (sy < 0 || sy >= res[1])
+				continue;
+			rows[nRows] = pyramid_row(imSrc, sy, scale, offset, arena);
+			weights[nRows++] = kernel5x5[2 - k];
+		}
+		if (nRows == 0)
+		{
+			std::fill(dst, dst + dstWidth * C, 0.f);
+			return;
+		}
+
+		// a padded row filtered along y, with 2 more zero pixels at both ends for the kernel along x
+		// the channels are interleaved, thus filtered side by side
+		float* row = arena.allocate<float>((paddedWidth + 4) * C) + 2 * C;
+		std::fill(row - 2 * C, row + g_zero_padding * C, 0.f);
+		std::fill(row + (g_zero_padding + res[0]) * C, row + (paddedWidth + 2) * C, 0.f);
+		conv_helper::conv_rows_simd(row + g_zero_padding * C, rows, weights, nRows, res[0] * C);
+
+		// along x, at the even pixels only
+		switch (C)
+		{
+		case 1: pyramid_decimate_x<1>(dst, row, dstWidth, C, kernel5x5); break;
+		case 2: pyramid_decimate_x<2>(dst, row, dstWidth, C, kernel5x5); break;
+		case 3: pyramid_decimate_x<3>(dst, row, dstWidth, C, kernel5x5); break;
+		case 4: pyramid_decimate_x<4>(dst, row, dstWidth, C, kernel5x5); break;
+		default: pyramid_decimate_x<0>(dst, row, dstWidth, C, kernel5x5); break;
+		}
+	}
+
+	// row @y of the padded PadConvUpsampleAdd5x5() into @dst, from pixel @crop to the width - @crop
+	// @scale, @offset: see pyramid_decimate_row()
+	template<class T> static void pyramid_upsample_add_row(float* dst, const ImageTemplate<T>& imSrc,
+		float scale, float offset, const FloatImage* imCoarse, int channels, int y, int crop,
+		const float* kernel3x3, const float* kernel5x5up, ldp::ScratchArena& arena)
+	{
+		ldp::ScratchArena::Scope scope(arena);
+		const int C = channels;
+		const ldp::Int2 res(imSrc.width() / C, imSrc.height());
+		const int paddedWidth = res[0] + g_zero_padding * 2;
+		const float* rows[5];
+		float weights[5];
+
+		// conv(pad(imSrc), g_3x3) along y, into a padded row with a zero pixel at both ends
+		float* row = arena.allocate<float>((paddedWidth + 2) * C) + C;
+		std::fill(row - C, row + g_zero_padding * C, 0.f);
+		std::fill(row + (g_zero_padding + res[0]) * C, row + (paddedWidth + 1) * C, 0.f);
+		int nRows = 0;
+		for (int k = -1; k <= 1; k++)
+		{
+			const int sy = y + k - g_zero_padding;
+			if (sy < 0 || sy >= res[1])
+				continue;
+			rows[nRows] = pyramid_row(imSrc, sy, scale, offset, arena);
+			weights[nRows++] = kernel3x3[1 - k];
+		}
+		if (nRows)
+			conv_helper::conv_rows_simd(row + g_zero_padding * C, rows, weights, nRows, res[0] * C);
+		else
+			std::fill(row + g_zero_padding * C, row + (g_zero_padding + res[0]) * C, 0.f);
+
+		// conv(upscale(imCoarse), h2_5x5), zero without imCoarse
+		float* up = arena.allocate<float>((paddedWidth + 1) * C);
+		if (imCoarse == 0)
+			std::fill(up, up + paddedWidth * C, 0.f);
+		else
+		{
+			// along y: only the even rows 2n of the upscaled image are not zero, under the taps
+			// 2n - y in [-2, 2]; into a row with 2 zero pixels at both ends
+			const int coarseWidth = imCoarse->width() / C;
+			float* coarse = arena.allocate<float>((coarseWidth + 4) * C) + 2 * C;
+			std::fill(coarse - 2 * C, coarse, 0.f);
+			std::fill(coarse + coarseWidth * C, coarse + (coarseWidth + 2) * C, 0.f);
+			nRows = 0;
+			for (int n = std::max(0, (y - 1) / 2); n <= (y + 2) / 2 && n < imCoarse->height(); n++)
+			{
+				rows[nRows] = imCoarse->data_XY(0, n);
+				weights[nRows++] = kernel5x5up[2 + y - 2 * n];
+			}
+			if (nRows)
+				conv_helper::conv_rows_simd(coarse, rows, weights, nRows, coarseWidth * C);
+			else
+				std::fill(coarse, coarse + coarseWidth * C, 0.f);
+
+			// along x by phases: the even pixels take the taps -2, 0, 2, the odd ones -1, 1
+			switch (C)
+			{
+			case 1: pyramid_upsample_x<1>(up, coarse, paddedWidth, C, kernel5x5up); break;
+			case 2: pyramid_upsample_x<2>(up, coarse, paddedWidth, C, kernel5x5up); break;
+			case 3: pyramid_upsample_x<3>(up, coarse, paddedWidth, C, kernel5x5up); break;
+			case 4: pyramid_upsample_x<4>(up, coarse, paddedWidth, C, kernel5x5up); break;
+			default: pyramid_upsample_x<0>(up, coarse, paddedWidth, C, kernel5x5up); break;
+			}
+		}
+
+		// conv(pad(imSrc), g_3x3) along x, plus the upscaled row
+		for (int x = crop * C; x < (paddedWidth - crop) * C; x++)
+		{
+			dst[x - crop * C] = row[x - C] * kernel3x3[2] + row[x] * kernel3x3[1]
+				+ row[x + C] * kernel3x3[0] + up[x];
+		}// end for x
+	}
+
+	// a stage on the rows of a batch at once, task t being row t % maxRows of image t / maxRows
+	// @rows(p): rows of image p, 0 to skip it
+	// @body(p, y, arena): on row y of image p, with the worker scratch
+	template<class Rows, class Body> static void pyramid_for_each_row(int numImages, const Rows& rows,
+		const Body& body)
+	{
+		int maxRows = 0;
+		for (int p = 0; p < numImages; p++)
+			maxRows = std::max(maxRows, rows(p));
+		ldp::parallelFor(0, numImages * maxRows, 0, [&](int tb, int te)
+		{
+			ldp::ScratchArena& arena = ldp::ThreadPool::instance().scratch();
+			for (int t = tb; t < te; t++)
+			if (t % maxRows < rows(t / maxRows))
+				body(t / maxRows, t % maxRows, arena);
+		});
+	}
+
 	ConvolutionPyramid::ConvolutionPyramid()
 	{
 	}
@@ -13,81 +268,254 @@ namespace ldp
 	{
 	}
 
-	void ConvolutionPyramid::convolve_boundary(FloatImage& srcDst)
+	void ConvolutionPyramid::reserve(ldp::Int2 maxResolution, int numImages, int channels)
+	{
+		ldp::Int2 maxPadded;
+		const size_t sz = pyramid_workspace_size(maxResolution, channels, maxPadded) * numImages
+			+ g_workspace_align;
+		if (m_workspace.size() < sz)
+			m_workspace.resize(sz);
+	}
+
+	void ConvolutionPyramid::layout(int channels)
 	{
-		const float kernel5x5[5] = { 0.1507f, 0.6836f, 1.0334f, 0.6836f, 0.1507f };
-		const float kernel3x3[3] = { 0.0312f, 0.7753f, 0.0312f };
-		const float mul = sqrt(0.0270f);
-		const float kernel5x5up[5] = { mul * 0.1507f, mul * 0.6836f, mul * 1.0334f, mul * 0.6836f, mul * 0.1507f };
+		const int numImages = (int)m_pyramids.size();
+		ldp::Int2 maxPadded;
+		size_t sz = g_workspace_align;
+		for (int p = 0; p < numImages; p++)
+			sz += pyramid_workspace_size(m_pyramids[p].resolution, channels, maxPadded);
+		if (m_workspace.size() < sz)
+			m_workspace.resize(sz);
+
+		float* ptr = m_workspace.data();
+		ptr += (g_workspace_align - (size_t)ptr / sizeof(float) % g_workspace_align) % g_workspace_align;
+		// the levels are views: reserved first, since growing the vector may copy them
+		int numLevels = 0;
+		for (int p = 0; p < numImages; p++)
+			numLevels += std::max(0, pyramid_levels(m_pyramids[p].resolution) - 1);
+		m_levels.clear();
+		m_levels.reserve(numLevels);
+		for (int p = 0; p < numImages; p++)
+		{
+			ImagePyramid& pyr = m_pyramids[p];
+			ldp::Int2 res = pyr.resolution;
+			pyr.nLevels = pyramid_levels(res);
+			pyr.firstLevel = (int)m_levels.size();
+			pyr.buffers[0] = pyr.buffers[1] = 0;
+			if (pyr.nLevels == 0)
+				continue;
+
+			pyramid_workspace_size(res, channels, maxPadded);
+			for (int k = 0; k < 2; k++)
+			{
+				pyr.buffers[k] = ptr;
+				ptr += pyramid_view_size(maxPadded, channels);
+			}
 
-		PyramidConvolve(srcDst, kernel5x5, kernel3x3, kernel5x5up);
+			for (int i = 1; i < pyr.nLevels; i++)
+			{
+				res = pyramid_down(res);
+				m_levels.push_back(pyramid_view(ptr, res, channels));
+				ptr += pyramid_view_size(res, channels);
+			}
+		}// end for p
 	}
 
-	void ConvolutionPyramid::solve_poisson(FloatImage& srcDiv_dstVolume)
+	void ConvolutionPyramid::convolve_boundary(FloatImage& srcDst, int channels)
+	{
+		FloatImage* images = &srcDst;
+		convolve_boundary(&images, 1, channels);
+	}
+
+	void ConvolutionPyramid::convolve_boundary(FloatImage* const* images, int numImages, int channels)
+	{
+		PyramidConvolve(images, numImages, channels, g_boundary_kernel5x5, g_boundary_kernel3x3,
+			g_boundary_kernel5x5up);
+	}
+
+	void ConvolutionPyramid::convolve_boundary(HalfImage& srcDst, int channels)
+	{
+		HalfImage* images = &srcDst;
+		pyramidConvolve(&images, 1, channels, 1.f, 0.f, g_boundary_kernel5x5, g_boundary_kernel3x3,
+			g_boundary_kernel5x5up);
+	}
+
+	void ConvolutionPyramid::convolve_boundary(MaskImage& srcDst, float scale, float offset, int channels)
+	{
+		MaskImage* images = &srcDst;
+		pyramidConvolve(&images, 1, channels, scale, offset, g_boundary_kernel5x5, g_boundary_kernel3x3,
+			g_boundary_kernel5x5up);
+	}
+
+	void ConvolutionPyramid::convolve_boundary(UShortImage& srcDst, float scale, float offset, int channels)
 	{
-		throw std::exception("error: result of this method is incorrect");
-		const float kernel5x5[5] = { 0.15f, 0.5f, 0.7f, 0.5f, 0.15f };
-		const float kernel3x3[3] = { 0.175f, 0.547f, 0.175f };
+		UShortImage* images = &srcDst;
+		pyramidConvolve(&images, 1, channels, scale, offset, g_boundary_kernel5x5, g_boundary_kernel3x3,
+			g_boundary_kernel5x5up);
+	}
 
-		PyramidConvolve(srcDiv_dstVolume, kernel5x5, kernel3x3, kernel5x5);
+	void ConvolutionPyramid::solve_poisson(FloatImage& srcDiv_dstVolume)
+	{
+		// the pyramid kernels only approximate the inverse laplacian, the solver converges to it
+		m_poisson.solve(srcDiv_dstVolume);
 	}
 
 	void ConvolutionPyramid::PyramidConvolve(FloatImage& srcDst, const float* kernel5x5,
 		const float* kernel3x3, const float* kernel5x5up)
 	{
-		const ldp::Int2 res = srcDst.getResolution();
-		const int nMaxLevel = (int)ceil(log((float)std::max(res[0], std::max(res[1], res[2]))) / log(2.0f));
+		FloatImage* images = &srcDst;
+		PyramidConvolve(&images, 1, 1, kernel5x5, kernel3x3, kernel5x5up);
+	}
 
-		std::vector<FloatImage*> pyramid;
-		pyramid.resize(nMaxLevel);
-		pyramid[0] = &srcDst;
-		for (int k = 1; k < pyramid.size(); k++)
-			pyramid[k] = new FloatImage();
+	void ConvolutionPyramid::PyramidConvolve(FloatImage* const* images, int numImages, int channels,
+		const float* kernel5x5, const float* kernel3x3, const float* kernel5x5up)
+	{
+		pyramidConvolve(images, numImages, channels, 1.f, 0.f, kernel5x5, kernel3x3, kernel5x5up);
+	}
 
-		/// down---------------------------------
-		FloatImage imConv;
-		for (int i = 1; i < nMaxLevel; i++)
-		{
-			ZeroPadding5x5(imConv, *pyramid[i - 1]);
-			conv_helper::conv2<float, 5>(imConv.data(), kernel5x5, imConv.getResolution());
-			DownSamplex2(*pyramid[i], imConv);
-		}//i
-		imConv.clear();
+	template<class T> void ConvolutionPyramid::pyramidConvolve(ImageTemplate<T>* const* images, int numImages,
+		int channels, float scale, float offset, const float* kernel5x5, const float* kernel3x3,
+		const float* kernel5x5up)
+	{
+		if (channels < 1)
+			throw std::exception("PyramidConvolve: illegal channels");
+		for (int p = 0; p < numImages; p++)
+		if (images[p]->width() % channels)
+			throw std::exception("PyramidConvolve: width is not a multiple of channels");
 
-		/// up------------------------------------
+		// the levels but the images are views on the workspace, as the padded results of the up pass,
+		// alternately in the two buffers of each image
+		m_pyramids.resize(numImages);
+		for (int p = 0; p < numImages; p++)
+			m_pyramids[p].resolution = ldp::Int2(images[p]->width() / channels, images[p]->height());
+		layout(channels);
+		const int C = channels;
+		int maxLevels = 0;
+		for (int p = 0; p < numImages; p++)
+			maxLevels = std::max(maxLevels, m_pyramids[p].nLevels);
 
-		// on the coarse level
-		// imCurrent = conv(pad(imCurrent), g_3x3)
-		FloatImage imCurrent;
-		ZeroPadding5x5(imCurrent, *pyramid[nMaxLevel - 1]);
-		conv_helper::conv2<float, 3>(imCurrent.data(), kernel3x3, imCurrent.getResolution());
+		// level i > 0 of image p, and the padded result of the up pass on it, cropped at the finest level
+		auto level = [&](int p, int i)->FloatImage&
+		{
+			return m_levels[m_pyramids[p].firstLevel + i - 1];
+		};
+		auto levelResult = [&](int p, int i)->FloatImage
+		{
+			const int crop = i == 0 ? g_zero_padding : 0;
+			const ldp::Int2 res = i == 0 ? m_pyramids[p].resolution
+				: ldp::Int2(level(p, i).width() / C, level(p, i).height());
+			return pyramid_view(m_pyramids[p].buffers[i % 2], res + (g_zero_padding - crop) * 2, C);
+		};
 
-		FloatImage imTmpDown, imTmpUp;
-		for (int i = nMaxLevel - 2; i >= 0; i--)
+		// run as a pool task, thus the filters take their temporaries from the worker scratch
+		ldp::parallelFor(0, 1, 1, [&](int, int)
 		{
-			// imTmpDown = unpad(imCurrent)
-			imCurrent.subImageTo(imTmpDown, g_zero_padding, ldp::Int2(imCurrent.getResolution()) 
-				- g_zero_padding);
+			/// down---------------------------------
+			// pyramid[i] = downsample(conv(pad(pyramid[i-1]), h1_5x5)), the images decoded by rows
+			for (int i = 1; i < maxLevels; i++)
+			{
+				pyramid_for_each_row(numImages, [&](int p)
+				{
+					return i < m_pyramids[p].nLevels ? level(p, i).height() : 0;
+				}, [&](int p, int y, ldp::ScratchArena& arena)
+				{
+					if (i == 1)
+						pyramid_decimate_row(level(p, i).data_XY(0, y), *images[p], scale, offset, C, y,
+						kernel5x5, arena);
+					else
+						pyramid_decimate_row(level(p, i).data_XY(0, y), level(p, i - 1), 1.f, 0.f, C, y,
+						kernel5x5, arena);
+				});
+			}// end for i
 
-			// imTmpUp = conv(upscale(imTmpDown), h2_5x5)
-			imTmpUp.resize(pyramid[i]->getResolution() + g_zero_padding * 2);
-			VolumeUpscalex2_ZeroHalf(imTmpUp, imTmpDown);
-			conv_helper::conv2<float, 5>(imTmpUp.data(), kernel5x5up, imTmpUp.getResolution());
+			/// up------------------------------------
+			// imCurrent = conv(pad(pyramid[i]), g_3x3) + conv(upscale(unpad(imCurrent)), h2_5x5)
+			// the coarsest level has the first term only, the finest one is computed unpadded
+			for (int i = maxLevels - 1; i >= 0; i--)
+			{
+				pyramid_for_each_row(numImages, [&](int p)
+				{
+					return i < m_pyramids[p].nLevels ? levelResult(p, i).height() : 0;
+				}, [&](int p, int y, ldp::ScratchArena& arena)
+				{
+					const int crop = i == 0 ? g_zero_padding : 0;
+					const bool hasCoarse = i + 1 < m_pyramids[p].nLevels;
+					FloatImage imCoarse;
+					if (hasCoarse)
+					{
+						const ldp::Int2 pad(g_zero_padding * C, g_zero_padding);
+						FloatImage imCurrent = levelResult(p, i + 1);
+						imCurrent.subImage(pad, imCurrent.getResolution() - pad).swap(imCoarse);
+					}
+					if (i == 0)
+						pyramid_upsample_add_row(levelResult(p, i).data_XY(0, y), *images[p], scale, offset,
+						hasCoarse ? &imCoarse : 0, C, y + crop, crop, kernel3x3, kernel5x5up, arena);
+					else
+						pyramid_upsample_add_row(levelResult(p, i).data_XY(0, y), level(p, i), 1.f, 0.f,
+						hasCoarse ? &imCoarse : 0, C, y + crop, crop, kernel3x3, kernel5x5up, arena);
+				});
+			}// end for i
+
+			// the results back to the images, encoded
+			pyramid_for_each_row(numImages, [&](int p)
+			{
+				return m_pyramids[p].nLevels ? images[p]->height() : 0;
+			}, [&](int p, int y, ldp::ScratchArena&)
+			{
+				pyramid_store_row(images[p]->data_XY(0, y), levelResult(p, 0).data_XY(0, y), images[p]->width(),
+					scale, offset);
+			});
+		});
+	}
+
+	void ConvolutionPyramid::PadConvDecimate5x5(FloatImage& imDst, const FloatImage& imSrc,
+		const float* kernel5x5, int channels)
+	{
+		if (imDst.data() == imSrc.data())
+			throw std::exception("PadConvDecimate5x5: does not support inplace operation");
+		if (channels < 1 || imSrc.width() % channels)
+			throw std::exception("PadConvDecimate5x5: illegal channels");
 
-			// imCurrent = conv(pad(imCurrent), g_3x3)
-			ZeroPadding5x5(imCurrent, *pyramid[i]);
-			conv_helper::conv2<float, 3>(imCurrent.data(), kernel3x3, imCurrent.getResolution());
+		const ldp::Int2 low_res = (ldp::Int2(imSrc.width() / channels, imSrc.height()) + g_zero_padding * 2) / 2;
+		imDst.resize(low_res[0] * channels, low_res[1]);
 
-			// imCurrent += imTmpUp
-			AddImage(imCurrent, imTmpUp);
+		ldp::parallelFor(0, low_res[1], 0, [&](int yb, int ye)
+		{
+			ldp::ScratchArena& arena = ldp::ThreadPool::instance().scratch();
+			for (int y = yb; y < ye; y++)
+				pyramid_decimate_row(imDst.data_XY(0, y), imSrc, 1.f, 0.f, channels, y, kernel5x5, arena);
+		});
+	}
+
+	void ConvolutionPyramid::PadConvUpsampleAdd5x5(FloatImage& imDst, const FloatImage& imSrc,
+		const float* kernel3x3, const FloatImage* imCoarse, const float* kernel5x5up, int crop, int channels)
+	{
+		if (channels < 1 || imSrc.width() % channels || (imCoarse && imCoarse->width() % channels))
+			throw std::exception("PadConvUpsampleAdd5x5: illegal channels");
+		const ldp::Int2 padded_res = ldp::Int2(imSrc.width() / channels, imSrc.height()) + g_zero_padding * 2;
+		if (crop < 0 || crop * 2 > padded_res[0] || crop * 2 > padded_res[1])
+			throw std::exception("PadConvUpsampleAdd5x5: illegal crop");
+		if (imCoarse)
+		{
+			const ldp::Int2 coarse_res(imCoarse->width() / channels, imCoarse->height());
+			for (int k = 0; k < 2; k++)
+			if (coarse_res[k] * 2 != padded_res[k] && coarse_res[k] * 2 + 1 != padded_res[k])
+				throw std::exception("PadConvUpsampleAdd5x5: illegal size");
 		}
+		if (imDst.data() == imSrc.data() || (imCoarse && imDst.data() == imCoarse->data()))
+			throw std::exception("PadConvUpsampleAdd5x5: does not support inplace operation");
 
-		// unpad
-		imCurrent.subImageTo(srcDst, g_zero_padding, imCurrent.getResolution() - g_zero_padding);
+		imDst.resize((padded_res[0] - crop * 2) * channels, padded_res[1] - crop * 2);
 
-		/// free
-		for (int k = 1; k < pyramid.size(); k++)
-			delete pyramid[k];
+		ldp::parallelFor(crop, padded_res[1] - crop, 0, [&](int yb, int ye)
+		{
+			ldp::ScratchArena& arena = ldp::ThreadPool::instance().scratch();
+			for (int y = yb; y < ye; y++)
+			{
+				pyramid_upsample_add_row(imDst.data_XY(0, y - crop), imSrc, 1.f, 0.f, imCoarse, channels, y,
+					crop, kernel3x3, kernel5x5up, arena);
+			}
+		});
 	}
 
 	// A = A + B
@@ -96,11 +524,7 @@ namespace ldp
 		if (A.getResolution() != B.getResolution())
 			throw std::exception("AddImage: size mis-matched");
 
-		const unsigned int sz = A.getResolution()[0] * A.getResolution()[1];
-		float* dst = A.data();
-		const float* src = B.data();
-		for (int i = 0; i < sz; i++)
-			dst[i] += src[i];
+		A += B;
 	}
 
 	// C = unpad(A+B)
@@ -110,7 +534,7 @@ namespace ldp
 		if (res != B.getResolution())
 			throw std::exception("AddImageUnpad: size mis-matched");
 		ldp::Int2 dstRes = res - 5 * 2;
-		if (dstRes[0] < 0 || dstRes[1] < 0 || dstRes[2] < 0)
+		if (dstRes[0] < 0 || dstRes[1] < 0)
 			throw std::exception("AddImageUnpad: too small to unpad");
 
 		C.resize(dstRes);
@@ -129,9 +553,7 @@ namespace ldp
 
 	void ConvolutionPyramid::ZeroPadding5x5(FloatImage& dst, const FloatImage& src)
 	{
-		ldp::Int2 srcRes = src.getResolution();
-		dst.resize(srcRes + 5 * 2);
-		conv_helper::zero_padding2<float, 5>(dst.data(), src.data(), src.getResolution());
+		src.zeroPaddingTo(dst, 5);
 	}
 
 	void ConvolutionPyramid::DownSamplex2(FloatImage& imDst, const FloatImage& imSrc)
@@ -159,12 +581,12 @@ namespace ldp
 		for (int k = 0; k < 2; k++)
 		if (src_res[k] * 2 != dst_res[k] && src_res[k] * 2 + 1 != dst_res[k])
 			throw std::exception("VolumeUpscalex2: illegal size");
+		imDst.fill(0.f);
 
 		for (int y = 0; y < src_res[1]; y++)
 		{
 			const float* src_y_ptr = imSrc.data() + imSrc.stride_Y() * y;
 			float* dst_y_ptr = imDst.data() + imDst.stride_Y() * y * 2;
-			memset(dst_y_ptr + imDst.stride_Y(), 0, sizeof(float)*imDst.stride_Y());
 			for (int x = 0; x < src_res[0]; x++)
 			{
 				int x2 = (x << 1);
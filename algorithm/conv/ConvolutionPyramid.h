@@ -1,28 +1,67 @@
 #pragma once
 #include "ImageData.h"
+#include "PoissonSolver.h"
+#include <vector>
 namespace ldp
 {
+	// all the buffers of the pyramid live in one workspace, sized by the largest image so far and
+	// reused by the next calls, thus calling it per frame on images up to that size allocates nothing
 	class ConvolutionPyramid
 	{
 	public:
 		ConvolutionPyramid();
 		~ConvolutionPyramid();
 
+		// sizes the workspace for @numImages images up to @maxResolution pixels of @channels each;
+		// optional, it also grows on demand
+		void reserve(ldp::Int2 maxResolution, int numImages = 1, int channels = 1);
+
 	public:
 		// boundary interpolation
 		// assume the given volume has values at the boundary and 0 inside.
 		// then this method smoothly interpolate those boundary values inward
-		void convolve_boundary(FloatImage& srcDst);
+		// @channels: interleaved in the rows, E.G., 3 for r,g,b,r,g,b...; all of them go through one
+		//	traversal of the pyramid, side by side in the SIMD lanes
+		void convolve_boundary(FloatImage& srcDst, int channels = 1);
+
+		// the same on a batch of independent images of any sizes, E.G., the planes of a planar image
+		// or a set of masks; they share one traversal, each stage running on all of them in parallel
+		void convolve_boundary(FloatImage* const* images, int numImages, int channels = 1);
+
+		// the same on images in narrower storage: half floats, or fixed point as q * @scale + @offset.
+		// the pyramid runs in floats, the rows of the images are only converted when read or written,
+		// thus their memory traffic is halved or quartered
+		void convolve_boundary(HalfImage& srcDst, int channels = 1);
+		void convolve_boundary(MaskImage& srcDst, float scale, float offset = 0.f, int channels = 1);
+		void convolve_boundary(UShortImage& srcDst, float scale, float offset = 0.f, int channels = 1);
 
 		// solve a poisson equation with Neumann boundary conditions
 		// assume the input is the negative divergence of a given volume
-		// then the output is the reconstructed volume based on the input
+		// then the output is the reconstructed volume based on the input, of zero mean
+		// by the multigrid PoissonSolver, whose levels are kept too
 		void solve_poisson(FloatImage& srcDiv_dstVolume);
+		PoissonSolver& poissonSolver() { return m_poisson; }
 	public:
 		//imDst = imSrc conv Kernel (Kernel is implicitly defined by kernel5x5 (h1), kernel3x3 (g)), and kernel5x5up (h2);
-		static void PyramidConvolve(FloatImage& srcDst, const float* kernel5x5,
+		void PyramidConvolve(FloatImage& srcDst, const float* kernel5x5,
+			const float* kernel3x3, const float* kernel5x5up);
+		void PyramidConvolve(FloatImage* const* images, int numImages, int channels, const float* kernel5x5,
 			const float* kernel3x3, const float* kernel5x5up);
 
+		// imDst = DownSamplex2(conv(pad(imSrc), kernel5x5)), fused: only the retained samples are
+		// computed, with the padding as implicit zero borders
+		// @channels: interleaved in the rows, the width of the images is in floats
+		static void PadConvDecimate5x5(FloatImage& imDst, const FloatImage& imSrc, const float* kernel5x5,
+			int channels = 1);
+
+		// imDst = conv(pad(imSrc), kernel3x3) + conv(VolumeUpscalex2_ZeroHalf(imCoarse), kernel5x5up),
+		// fused: the upscaled image is filtered by phases, skipping its zeros, and added in the same pass
+		// @imCoarse: half the padded size of imSrc, or null for the first term only
+		// @crop: the border not computed, E.G., 5 for the unpadded result
+		// @channels: see PadConvDecimate5x5()
+		static void PadConvUpsampleAdd5x5(FloatImage& imDst, const FloatImage& imSrc, const float* kernel3x3,
+			const FloatImage* imCoarse, const float* kernel5x5up, int crop = 0, int channels = 1);
+
 		// dst = pad(src, 5)
 		static void ZeroPadding5x5(FloatImage& dst, const FloatImage& src);
 
@@ -38,5 +77,30 @@ namespace ldp
 
 		// C = unpad(A+B)
 		static void AddImageUnpad5x5(FloatImage& C, const FloatImage& A, const FloatImage& B);
+	protected:
+		// the pyramid of an image in a batch
+		struct ImagePyramid
+		{
+			ldp::Int2 resolution;	// of the image, in pixels
+			int nLevels;			// 0 for an empty image
+			int firstLevel;			// index of its level 1 in m_levels, level 0 being the image itself
+			float* buffers[2];		// of its largest padded level, for the results of the up pass
+		};
+
+		// views on the workspace for each image of m_pyramids, by their resolutions: its levels
+		// in m_levels, and two buffers
+		void layout(int channels);
+
+		// PyramidConvolve() on images of any storage, see convolve_boundary()
+		template<class T> void pyramidConvolve(ImageTemplate<T>* const* images, int numImages, int channels,
+			float scale, float offset, const float* kernel5x5, const float* kernel3x3, const float* kernel5x5up);
+	private:
+		ConvolutionPyramid(const ConvolutionPyramid&);
+		ConvolutionPyramid& operator=(const ConvolutionPyramid&);
+	protected:
+		std::vector<float> m_workspace;
+		std::vector<FloatImage> m_levels;
+		std::vector<ImagePyramid> m_pyramids;
+		PoissonSolver m_poisson;
 	};
 }
\ No newline at end of file
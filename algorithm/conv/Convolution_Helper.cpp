@@ -1,6 +1,1053 @@
 #include "Convolution_Helper.h"
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
 
+// MSVC emits intrinsics of any ISA regardless of /arch, other compilers need the ISA enabled
+#if defined(_MSC_VER) || (defined(__AVX2__) && defined(__FMA__) && defined(__F16C__))
+#define CONV_HELPER_HAS_AVX2
+#endif
+#if (defined(_MSC_VER) && _MSC_VER >= 1910) || (!defined(_MSC_VER) && defined(__AVX512F__))
+#define CONV_HELPER_HAS_AVX512
+#endif
+
+#pragma push_macro("min")
+#pragma push_macro("max")
+#undef min
+#undef max
 namespace conv_helper
 {
+	//////////////////////////////////////////////////////////////////////////
+	// cpu detection
+	static void cpuid(int info[4], int leaf, int subLeaf)
+	{
+#ifdef _MSC_VER
+		__cpuidex(info, leaf, subLeaf);
+#else
+		unsigned int a = 0, b = 0, c = 0, d = 0;
+		__cpuid_count(leaf, subLeaf, a, b, c, d);
+		info[0] = a; info[1] = b; info[2] = c; info[3] = d;
+#endif
+	}
+
+#if defined(CONV_HELPER_HAS_AVX2) || defined(CONV_HELPER_HAS_AVX512)
+	static unsigned long long xgetbv0()
+	{
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		unsigned int a = 0, d = 0;
+		__asm__ volatile("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+		return ((unsigned long long)d << 32) | a;
+#endif
+	}
+#endif
+
+	static SimdLevel detectSimdLevel()
+	{
+		int info[4];
+		cpuid(info, 0, 0);
+		const int nIds = info[0];
+		if (nIds < 1)
+			return SimdNone;
+		cpuid(info, 1, 0);
+		const bool sse2 = (info[3] & (1 << 26)) != 0;
+		if (!sse2)
+			return SimdNone;
+
+		// only the levels compiled in are looked for
+#if defined(CONV_HELPER_HAS_AVX2) || defined(CONV_HELPER_HAS_AVX512)
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		const bool fma = (info[2] & (1 << 12)) != 0;
+		const bool f16c = (info[2] & (1 << 29)) != 0;
+
+		// the OS must save the ymm/zmm states
+		const unsigned long long xcr0 = osxsave ? xgetbv0() : 0;
+		const bool osAvx = (xcr0 & 0x6) == 0x6;
+		bool avx2 = false;
+#ifdef CONV_HELPER_HAS_AVX512
+		const bool osAvx512 = (xcr0 & 0xe6) == 0xe6;
+		bool avx512 = false;
+#endif
+		if (nIds >= 7)
+		{
+			cpuid(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+#ifdef CONV_HELPER_HAS_AVX512
+			avx512 = (info[1] & (1 << 16)) != 0;
+#endif
+		}
+#ifdef CONV_HELPER_HAS_AVX512
+		if (avx && fma && f16c && avx2 && avx512 && osAvx && osAvx512)
+			return SimdAVX512;
+#endif
+#ifdef CONV_HELPER_HAS_AVX2
+		if (avx && fma && f16c && avx2 && osAvx)
+			return SimdAVX2;
+#endif
+#endif
+		return SimdSSE2;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// IEEE binary16, as F16C: rounded to nearest even, NaN kept quiet
+	static float half_to_float(unsigned short h)
+	{
+		const unsigned int sign = (unsigned int)(h & 0x8000) << 16;
+		const unsigned int e = (h >> 10) & 0x1f, m = h & 0x3ff;
+		unsigned int bits = sign;
+		if (e == 0x1f)
+			bits |= 0x7f800000 | (m << 13) | (m ? 0x400000 : 0);
+		else if (e)
+			bits |= ((e + 112) << 23) | (m << 13);
+		else if (m)
+		{
+			// subnormal, m * 2^-24 is exact
+			const float v = m * (1.f / 16777216.f);
+			memcpy(&bits, &v, sizeof(bits));
+			bits |= sign;
+		}
+		float f;
+		memcpy(&f, &bits, sizeof(f));
+		return f;
+	}
+
+	static unsigned short float_to_half(float f)
+	{
+		unsigned int x;
+		memcpy(&x, &f, sizeof(x));
+		const unsigned int sign = (x >> 16) & 0x8000;
+		x &= 0x7fffffff;
+		if (x >= 0x7f800000)
+			return (unsigned short)(sign | 0x7c00 | (x > 0x7f800000 ? 0x200 | ((x >> 13) & 0x3ff) : 0));
+		// 65520 and above round to infinity
+		if (x >= 0x477ff000)
+			return (unsigned short)(sign | 0x7c00);
+		unsigned int h, rem, half;
+		if (x >= 0x38800000)
+		{
+			// normal, the exponent rebiased, a carry of the rounding goes into it
+			h = (x >> 13) - (112 << 10);
+			rem = x & 0x1fff;
+			half = 0x1000;
+		}
+		else
+		{
+			// subnormal or zero: below 2^-25 they round to zero
+			if (x < 0x33000000)
+				return (unsigned short)sign;
+			const unsigned int shift = 126 - (x >> 23);
+			const unsigned int m = (x & 0x7fffff) | 0x800000;
+			h = m >> shift;
+			rem = m & ((1u << shift) - 1);
+			half = 1u << (shift - 1);
+		}
+		if (rem > half || (rem == half && (h & 1)))
+			h++;
+		return (unsigned short)(sign | h);
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// ISA traits, a vector of W floats
+	// the storage conversions: loadFixed/storeFixed from/to integers, the latter taking values already
+	// clamped to the range of the type and rounding them to nearest even
+	struct IsaScalar
+	{
+		typedef float V;
+		enum{ W = 1 };
+		static V load(const float* p){ return *p; }
+		static void store(float* p, V v){ *p = v; }
+		static V set1(float v){ return v; }
+		static V madd(V a, V b, V c){ return c + a * b; }
+		// b when unordered as _mm_max_ps/_mm_min_ps, thus a NaN clamped to a bound gives the bound
+		static V vmax(V a, V b){ return a > b ? a : b; }
+		static V vmin(V a, V b){ return a < b ? a : b; }
+		static V add(V a, V b){ return a + b; }
+		static V mul(V a, V b){ return a * b; }
+		// a where the bits of m are set, else b
+		static V blend(V m, V a, V b){ unsigned int bits; memcpy(&bits, &m, sizeof(bits)); return bits ? a : b; }
+		static V loadHalf(const unsigned short* p){ return half_to_float(*p); }
+		static void storeHalf(unsigned short* p, V v){ *p = float_to_half(v); }
+		static V loadFixed(const unsigned char* p){ return (float)*p; }
+		static V loadFixed(const unsigned short* p){ return (float)*p; }
+		static void storeFixed(unsigned char* p, V v){ *p = (unsigned char)(int)nearbyint(v); }
+		static void storeFixed(unsigned short* p, V v){ *p = (unsigned short)(int)nearbyint(v); }
+		// p[idx[i]] for each lane i
+		static V gather(const float* p, const int* idx){ return p[*idx]; }
+		static V sub(V a, V b){ return a - b; }
+		static V div(V a, V b){ return a / b; }
+		// rounded toward zero, for |v| < 2^31
+		static V trunc(V v){ return (float)(int)v; }
+		// idx = (int)y * pitch + (int)x * step for each lane, truncated
+		static void index(int* idx, V x, V y, int pitch, int step){ *idx = (int)y * pitch + (int)x * step; }
+	};
+
+	struct IsaSse2
+	{
+		typedef __m128 V;
+		enum{ W = 4 };
+		static V load(const float* p){ return _mm_loadu_ps(p); }
+		static void store(float* p, V v){ _mm_storeu_ps(p, v); }
+		static V set1(float v){ return _mm_set1_ps(v); }
+		// mul then add, bitwise the same as the scalar reference
+		static V madd(V a, V b, V c){ return _mm_add_ps(c, _mm_mul_ps(a, b)); }
+		static V vmax(V a, V b){ return _mm_max_ps(a, b); }
+		static V vmin(V a, V b){ return _mm_min_ps(a, b); }
+		static V add(V a, V b){ return _mm_add_ps(a, b); }
+		static V mul(V a, V b){ return _mm_mul_ps(a, b); }
+		static V blend(V m, V a, V b){ return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+		// no F16C
+		static V loadHalf(const unsigned short* p)
+		{
+			return _mm_setr_ps(half_to_float(p[0]), half_to_float(p[1]), half_to_float(p[2]), half_to_float(p[3]));
+		}
+		static void storeHalf(unsigned short* p, V v)
+		{
+			float f[W];
+			_mm_storeu_ps(f, v);
+			for (int k = 0; k < W; k++)
+				p[k] = float_to_half(f[k]);
+		}
+		static V loadFixed(const unsigned char* p)
+		{
+			int bits;
+			memcpy(&bits, p, sizeof(bits));
+			const __m128i zero = _mm_setzero_si128();
+			return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bits), zero), zero));
+		}
+		static V loadFixed(const unsigned short* p)
+		{
+			return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)p), _mm_setzero_si128()));
+		}
+		static void storeFixed(unsigned char* p, V v)
+		{
+			const __m128i i = _mm_cvtps_epi32(v);
+			const int bits = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(i, i), _mm_setzero_si128()));
+			memcpy(p, &bits, sizeof(bits));
+		}
+		static void storeFixed(unsigned short* p, V v)
+		{
+			// the pack is signed, thus shifted by 32768 through it
+			const __m128i i = _mm_sub_epi32(_mm_cvtps_epi32(v), _mm_set1_epi32(32768));
+			_mm_storel_epi64((__m128i*)p, _mm_xor_si128(_mm_packs_epi32(i, i), _mm_set1_epi16((short)0x8000)));
+		}
+		static V gather(const float* p, const int* idx)
+		{
+			return _mm_setr_ps(p[idx[0]], p[idx[1]], p[idx[2]], p[idx[3]]);
+		}
+		static V sub(V a, V b){ return _mm_sub_ps(a, b); }
+		static V div(V a, V b){ return _mm_div_ps(a, b); }
+		static V trunc(V v){ return _mm_cvtepi32_ps(_mm_cvttps_epi32(v)); }
+		// no 32-bit multiply
+		static void index(int* idx, V x, V y, int pitch, int step)
+		{
+			int ix[W], iy[W];
+			_mm_storeu_si128((__m128i*)ix, _mm_cvttps_epi32(x));
+			_mm_storeu_si128((__m128i*)iy, _mm_cvttps_epi32(y));
+			for (int k = 0; k < W; k++)
+				idx[k] = iy[k] * pitch + ix[k] * step;
+		}
+	};
+
+#ifdef CONV_HELPER_HAS_AVX2
+	struct IsaAvx2
+	{
+		typedef __m256 V;
+		enum{ W = 8 };
+		static V load(const float* p){ return _mm256_loadu_ps(p); }
+		static void store(float* p, V v){ _mm256_storeu_ps(p, v); }
+		static V set1(float v){ return _mm256_set1_ps(v); }
+		// fused, a single rounding, thus may differ from the reference by a few ulps
+		static V madd(V a, V b, V c){ return _mm256_fmadd_ps(a, b, c); }
+		static V vmax(V a, V b){ return _mm256_max_ps(a, b); }
+		static V vmin(V a, V b){ return _mm256_min_ps(a, b); }
+		static V add(V a, V b){ return _mm256_add_ps(a, b); }
+		static V mul(V a, V b){ return _mm256_mul_ps(a, b); }
+		static V blend(V m, V a, V b){ return _mm256_blendv_ps(b, a, m); }
+		static V loadHalf(const unsigned short* p){ return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)p)); }
+		static void storeHalf(unsigned short* p, V v)
+		{
+			_mm_storeu_si128((__m128i*)p, _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+		}
+		static V loadFixed(const unsigned char* p)
+		{
+			return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p)));
+		}
+		static V loadFixed(const unsigned short* p)
+		{
+			return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p)));
+		}
+		static void storeFixed(unsigned char* p, V v)
+		{
+			const __m256i i = _mm256_cvtps_epi32(v);
+			const __m128i w = _mm_packus_epi32(_mm256_castsi256_si128(i), _mm256_extracti128_si256(i, 1));
+			_mm_storel_epi64((__m128i*)p, _mm_packus_epi16(w, w));
+		}
+		static void storeFixed(unsigned short* p, V v)
+		{
+			const __m256i i = _mm256_cvtps_epi32(v);
+			_mm_storeu_si128((__m128i*)p, _mm_packus_epi32(_mm256_castsi256_si128(i), _mm256_extracti128_si256(i, 1)));
+		}
+		static V gather(const float* p, const int* idx)
+		{
+			return _mm256_i32gather_ps(p, _mm256_loadu_si256((const __m256i*)idx), 4);
+		}
+		static V sub(V a, V b){ return _mm256_sub_ps(a, b); }
+		static V div(V a, V b){ return _mm256_div_ps(a, b); }
+		static V trunc(V v){ return _mm256_round_ps(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+		static void index(int* idx, V x, V y, int pitch, int step)
+		{
+			const __m256i i = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvttps_epi32(y), _mm256_set1_epi32(pitch)),
+				_mm256_mullo_epi32(_mm256_cvttps_epi32(x), _mm256_set1_epi32(step)));
+			_mm256_storeu_si256((__m256i*)idx, i);
+		}
+	};
+#endif
+
+#ifdef CONV_HELPER_HAS_AVX512
+	struct IsaAvx512
+	{
+		typedef __m512 V;
+		enum{ W = 16 };
+		static V load(const float* p){ return _mm512_loadu_ps(p); }
+		static void store(float* p, V v){ _mm512_storeu_ps(p, v); }
+		static V set1(float v){ return _mm512_set1_ps(v); }
+		static V madd(V a, V b, V c){ return _mm512_fmadd_ps(a, b, c); }
+		static V vmax(V a, V b){ return _mm512_max_ps(a, b); }
+		static V vmin(V a, V b){ return _mm512_min_ps(a, b); }
+		static V add(V a, V b){ return _mm512_add_ps(a, b); }
+		static V mul(V a, V b){ return _mm512_mul_ps(a, b); }
+		static V blend(V m, V a, V b)
+		{
+			const __m512i mi = _mm512_castps_si512(m);
+			return _mm512_mask_blend_ps(_mm512_test_epi32_mask(mi, mi), b, a);
+		}
+		static V loadHalf(const unsigned short* p){ return _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)p)); }
+		static void storeHalf(unsigned short* p, V v)
+		{
+			_mm256_storeu_si256((__m256i*)p, _mm512_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+		}
+		static V loadFixed(const unsigned char* p)
+		{
+			return _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)p)));
+		}
+		static V loadFixed(const unsigned short* p)
+		{
+			return _mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)p)));
+		}
+		static void storeFixed(unsigned char* p, V v)
+		{
+			_mm_storeu_si128((__m128i*)p, _mm512_cvtepi32_epi8(_mm512_cvtps_epi32(v)));
+		}
+		static void storeFixed(unsigned short* p, V v)
+		{
+			_mm256_storeu_si256((__m256i*)p, _mm512_cvtepi32_epi16(_mm512_cvtps_epi32(v)));
+		}
+		static V gather(const float* p, const int* idx)
+		{
+			return _mm512_i32gather_ps(_mm512_loadu_si512(idx), p, 4);
+		}
+		static V sub(V a, V b){ return _mm512_sub_ps(a, b); }
+		static V div(V a, V b){ return _mm512_div_ps(a, b); }
+		static V trunc(V v){ return _mm512_roundscale_ps(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+		static void index(int* idx, V x, V y, int pitch, int step)
+		{
+			const __m512i i = _mm512_add_epi32(_mm512_mullo_epi32(_mm512_cvttps_epi32(y), _mm512_set1_epi32(pitch)),
+				_mm512_mullo_epi32(_mm512_cvttps_epi32(x), _mm512_set1_epi32(step)));
+			_mm512_storeu_si512(idx, i);
+		}
+	};
+#endif
+
+	//////////////////////////////////////////////////////////////////////////
+	// filter operations, tap k in [-L, R] is applied on src[x + k]
+	template<class Isa> struct ConvOp
+	{
+		typedef typename Isa::V V;
+		int L, R;
+		const float* kernel;
+		V taps[CONV_HELPER_MAX_SIMD_TAPS];	// broadcast once per call
+		ConvOp(const float* knl, int N) : L(N / 2 - (N % 2 == 0)), R(N / 2), kernel(knl)
+		{
+			for (int k = -L; k <= R; k++)
+				taps[k + L] = Isa::set1(kernel[R - k]);
+		}
+		V init()const{ return Isa::set1(0.f); }
+		V apply(V v, V s, int k)const{ return Isa::madd(s, taps[k + L], v); }
+		float scalarInit()const{ return 0.f; }
+		float scalarApply(float v, float s, int k)const{ return v + s * kernel[R - k]; }
+	};
+
+	template<class Isa> struct MaxOp
+	{
+		typedef typename Isa::V V;
+		int L, R;
+		MaxOp(int N) : L(N / 2 - (N % 2 == 0)), R(N / 2){}
+		V init()const{ return Isa::set1(std::numeric_limits<float>::lowest()); }
+		V apply(V v, V s, int)const{ return Isa::vmax(v, s); }
+		float scalarInit()const{ return std::numeric_limits<float>::lowest(); }
+		float scalarApply(float v, float s, int)const{ return s > v ? s : v; }
+	};
+
+	template<class Isa> struct MinOp
+	{
+		typedef typename Isa::V V;
+		int L, R;
+		MinOp(int N) : L(N / 2 - (N % 2 == 0)), R(N / 2){}
+		V init()const{ return Isa::set1(std::numeric_limits<float>::max()); }
+		V apply(V v, V s, int)const{ return Isa::vmin(v, s); }
+		float scalarInit()const{ return std::numeric_limits<float>::max(); }
+		float scalarApply(float v, float s, int)const{ return s < v ? s : v; }
+	};
+
+	// weighted sum of rows, tap i is applied on rows[i]
+	template<class Isa> struct WeightedSumOp
+	{
+		typedef typename Isa::V V;
+		const float* weights;
+		V taps[CONV_HELPER_MAX_SIMD_TAPS];
+		WeightedSumOp(const float* w, int n) : weights(w)
+		{
+			for (int i = 0; i < n; i++)
+				taps[i] = Isa::set1(weights[i]);
+		}
+		V init()const{ return Isa::set1(0.f); }
+		V apply(V v, V s, int i)const{ return Isa::madd(s, taps[i], v); }
+		float scalarInit()const{ return 0.f; }
+		float scalarApply(float v, float s, int i)const{ return v + s * weights[i]; }
+	};
+
+	// a contiguous row, vectorized along x in the middle part with 4 independent accumulators;
+	// borders are scalar
+	template<class Isa, class Op> static void filter_row(float* dst, const float* src, int num, const Op& op)
+	{
+		typedef typename Isa::V V;
+		const int L = op.L, R = op.R;
+		const int head_pos = std::min(num, R);
+		const int tail_pos = num - R;
+		const int tail_head_pos = std::max(head_pos, tail_pos);
+
+		for (int x = 0; x < head_pos; x++)
+		{
+			const int xb = std::max(-L, -x);
+			const int xe = std::min(num - x - 1, R);
+			float v = op.scalarInit();
+			for (int k = xb; k <= xe; k++)
+				v = op.scalarApply(v, src[k + x], k);
+			dst[x] = v;
+		}
+
+		const int W = Isa::W;
+		int x = R;
+		for (; x + 4 * W <= tail_pos; x += 4 * W)
+		{
+			V v0 = op.init(), v1 = v0, v2 = v0, v3 = v0;
+			for (int k = -L; k <= R; k++)
+			{
+				const float* s = src + x + k;
+				v0 = op.apply(v0, Isa::load(s), k);
+				v1 = op.apply(v1, Isa::load(s + W), k);
+				v2 = op.apply(v2, Isa::load(s + 2 * W), k);
+				v3 = op.apply(v3, Isa::load(s + 3 * W), k);
+			}
+			Isa::store(dst + x, v0);
+			Isa::store(dst + x + W, v1);
+			Isa::store(dst + x + 2 * W, v2);
+			Isa::store(dst + x + 3 * W, v3);
+		}
+		for (; x + W <= tail_pos; x += W)
+		{
+			V v = op.init();
+			for (int k = -L; k <= R; k++)
+				v = op.apply(v, Isa::load(src + x + k), k);
+			Isa::store(dst + x, v);
+		}
+		for (; x < tail_pos; x++)
+		{
+			float v = op.scalarInit();
+			for (int k = -L; k <= R; k++)
+				v = op.scalarApply(v, src[k + x], k);
+			dst[x] = v;
+		}
+
+		for (x = tail_head_pos; x < num; x++)
+		{
+			const int xb = std::max(-L, -x);
+			const int xe = std::min(num - x - 1, R);
+			float v = op.scalarInit();
+			for (int k = xb; k <= xe; k++)
+				v = op.scalarApply(v, src[k + x], k);
+			dst[x] = v;
+		}
+	}
+
+	// combine rows element-wise, vectorized along x with 4 independent accumulators
+	template<class Isa, class Op> static void filter_rows(float* dst, const float* const* rows,
+		int nRows, int num, const Op& op)
+	{
+		typedef typename Isa::V V;
+		const int W = Isa::W;
+		int x = 0;
+		for (; x + 4 * W <= num; x += 4 * W)
+		{
+			V v0 = op.init(), v1 = v0, v2 = v0, v3 = v0;
+			for (int i = 0; i < nRows; i++)
+			{
+				const float* src = rows[i] + x;
+				v0 = op.apply(v0, Isa::load(src), i);
+				v1 = op.apply(v1, Isa::load(src + W), i);
+				v2 = op.apply(v2, Isa::load(src + 2 * W), i);
+				v3 = op.apply(v3, Isa::load(src + 3 * W), i);
+			}
+			Isa::store(dst + x, v0);
+			Isa::store(dst + x + W, v1);
+			Isa::store(dst + x + 2 * W, v2);
+			Isa::store(dst + x + 3 * W, v3);
+		}
+		for (; x + W <= num; x += W)
+		{
+			V v = op.init();
+			for (int i = 0; i < nRows; i++)
+				v = op.apply(v, Isa::load(rows[i] + x), i);
+			Isa::store(dst + x, v);
+		}
+		for (; x < num; x++)
+		{
+			float v = op.scalarInit();
+			for (int i = 0; i < nRows; i++)
+				v = op.scalarApply(v, rows[i][x], i);
+			dst[x] = v;
+		}
+	}
+
+	// all bits set at the even entries, the lanes of one color from entry (x + phase) & 1
+	static const unsigned int g_rbLaneMask[33] =
+	{
+		~0u, 0, ~0u, 0, ~0u, 0, ~0u, 0, ~0u, 0, ~0u, 0, ~0u, 0, ~0u, 0,
+		~0u, 0, ~0u, 0, ~0u, 0, ~0u, 0, ~0u, 0, ~0u, 0, ~0u, 0, ~0u, 0, ~0u
+	};
+
+	// see rb_relax_row_simd(), the sums are in the same order on all ISAs, thus bitwise the same
+	template<class Isa> static void rb_relax_row(float* u, const float* up, const float* down,
+		const float* f, int nv, int phase, int num)
+	{
+		typedef typename Isa::V V;
+		const int W = Isa::W;
+
+		// the borders, with one neighbor less along x
+		for (int x = 0; x < num; x += std::max(1, num - 1))
+		{
+			const int n = nv + (x > 0) + (x + 1 < num);
+			if (((x + phase) & 1) || n == 0)
+				continue;
+			const float left = x > 0 ? u[x - 1] : 0.f, right = x + 1 < num ? u[x + 1] : 0.f;
+			u[x] = ((f[x] + left) + (right + (up[x] + down[x]))) * (1.f / n);
+		}
+
+		// the lanes updated only read the other color, which is kept, thus the next vectors are loaded
+		// before storing the current one, instead of reloading a part of it just stored
+		const float inv = 1.f / (nv + 2);
+		const V vInv = Isa::set1(inv);
+		int x = 1;
+		if (x + W < num)
+		{
+			V left = Isa::load(u + x - 1), center = Isa::load(u + x), right = Isa::load(u + x + 1);
+			for (;;)
+			{
+				const V s = Isa::add(Isa::add(Isa::load(f + x), left),
+					Isa::add(right, Isa::add(Isa::load(up + x), Isa::load(down + x))));
+				const V m = Isa::load((const float*)g_rbLaneMask + ((x + phase) & 1));
+				const V v = Isa::blend(m, Isa::mul(s, vInv), center);
+				const int xs = x;
+				x += W;
+				if (x + W < num)
+				{
+					left = Isa::load(u + x - 1);
+					center = Isa::load(u + x);
+					right = Isa::load(u + x + 1);
+					Isa::store(u + xs, v);
+				}
+				else
+				{
+					Isa::store(u + xs, v);
+					break;
+				}
+			} // end for
+		}
+		for (; x + 1 < num; x++)
+		if (((x + phase) & 1) == 0)
+			u[x] = ((f[x] + u[x - 1]) + (u[x + 1] + (up[x] + down[x]))) * inv;
+	}
+
+	// storage conversions, see decode_row_simd()/encode_row_simd(); the tails by the scalar ISA
+	template<class Isa> static void decode_half_row(float* dst, const unsigned short* src, int num)
+	{
+		int x = 0;
+		for (; x + Isa::W <= num; x += Isa::W)
+			Isa::store(dst + x, Isa::loadHalf(src + x));
+		for (; x < num; x++)
+			dst[x] = IsaScalar::loadHalf(src + x);
+	}
+
+	template<class Isa> static void encode_half_row(unsigned short* dst, const float* src, int num)
+	{
+		int x = 0;
+		for (; x + Isa::W <= num; x += Isa::W)
+			Isa::storeHalf(dst + x, Isa::load(src + x));
+		for (; x < num; x++)
+			IsaScalar::storeHalf(dst + x, src[x]);
+	}
+
+	template<class Isa, class T> static void decode_fixed_row(float* dst, const T* src, int num,
+		float scale, float offset)
+	{
+		typedef typename Isa::V V;
+		const V vScale = Isa::set1(scale), vOffset = Isa::set1(offset);
+		int x = 0;
+		for (; x + Isa::W <= num; x += Isa::W)
+			Isa::store(dst + x, Isa::add(Isa::mul(Isa::loadFixed(src + x), vScale), vOffset));
+		if (Isa::W > 1 && x < num)
+			decode_fixed_row<IsaScalar>(dst + x, src + x, num - x, scale, offset);
+	}
+
+	template<class Isa, class T> static void encode_fixed_row(T* dst, const float* src, int num,
+		float scale, float offset)
+	{
+		typedef typename Isa::V V;
+		const V vInv = Isa::set1(1.f / scale), vNegOffset = Isa::set1(-offset);
+		const V vZero = Isa::set1(0.f), vMax = Isa::set1((float)std::numeric_limits<T>::max());
+		int x = 0;
+		for (; x + Isa::W <= num; x += Isa::W)
+		{
+			const V v = Isa::mul(Isa::add(Isa::load(src + x), vNegOffset), vInv);
+			Isa::storeFixed(dst + x, Isa::vmin(Isa::vmax(v, vZero), vMax));
+		}
+		if (Isa::W > 1 && x < num)
+			encode_fixed_row<IsaScalar>(dst + x, src + x, num - x, scale, offset);
+	}
+
+	// see gather_row_simd(), two vectors at a time to overlap the latencies of the gathers
+	template<class Isa> static void gather_row(float* dst, const float* src, const int* offsets,
+		const float* weights, int taps, int step, int num)
+	{
+		typedef typename Isa::V V;
+		const int W = Isa::W;
+		int x = 0;
+		for (; x + 2 * W <= num; x += 2 * W)
+		{
+			V v0 = Isa::set1(0.f), v1 = v0;
+			const float* s = src;
+			const float* w = weights + x;
+			for (int k = 0; k < taps; k++, s += step, w += num)
+			{
+				v0 = Isa::madd(Isa::gather(s, offsets + x), Isa::load(w), v0);
+				v1 = Isa::madd(Isa::gather(s, offsets + x + W), Isa::load(w + W), v1);
+			}
+			Isa::store(dst + x, v0);
+			Isa::store(dst + x + W, v1);
+		}
+		for (; x < num; x++)
+		{
+			float v = 0.f;
+			for (int k = 0; k < taps; k++)
+				v += src[offsets[x] + k * step] * weights[k * num + x];
+			dst[x] = v;
+		}
+	}
+
+	static const float g_laneIndex[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+	// see warp_row_simd(), from point @begin; the same operations on all ISAs
+	template<class Isa> static void warp_row(float* dst, const float* src, int width, int height, int pitch,
+		int channels, const float* line, int begin, int num)
+	{
+		typedef typename Isa::V V;
+		const int W = Isa::W;
+		const V X0 = Isa::set1(line[0]), dX = Isa::set1(line[1]), Y0 = Isa::set1(line[2]), dY = Isa::set1(line[3]);
+		const V Z0 = Isa::set1(line[4]), dZ = Isa::set1(line[5]), zero = Isa::set1(0.f);
+		const V xMax = Isa::set1((float)(width - 1)), yMax = Isa::set1((float)(height - 1));
+
+		// the top-left pixel of the 4 sampled, its right and bottom neighbors being in the image
+		const V x0Max = Isa::set1((float)std::max(0, width - 2)), y0Max = Isa::set1((float)std::max(0, height - 2));
+		const int sx = width > 1 ? channels : 0, sy = height > 1 ? pitch : 0;
+
+		int idx[W];
+		float tmp[W];
+		int i = begin;
+		for (; i + W <= num; i += W)
+		{
+			const V t = Isa::add(Isa::set1((float)i), Isa::load(g_laneIndex));
+			const V z = Isa::madd(t, dZ, Z0);
+			const V x = Isa::vmin(Isa::vmax(Isa::div(Isa::madd(t, dX, X0), z), zero), xMax);
+			const V y = Isa::vmin(Isa::vmax(Isa::div(Isa::madd(t, dY, Y0), z), zero), yMax);
+			const V xi = Isa::vmin(Isa::trunc(x), x0Max), yi = Isa::vmin(Isa::trunc(y), y0Max);
+			const V fx = Isa::sub(x, xi), fy = Isa::sub(y, yi);
+			Isa::index(idx, xi, yi, pitch, channels);
+			for (int c = 0; c < channels; c++)
+			{
+				const float* s = src + c;
+				const V a = Isa::gather(s, idx), b = Isa::gather(s + sx, idx);
+				const V d = Isa::gather(s + sy, idx), e = Isa::gather(s + sx + sy, idx);
+				const V top = Isa::madd(fx, Isa::sub(b, a), a), bottom = Isa::madd(fx, Isa::sub(e, d), d);
+				const V v = Isa::madd(fy, Isa::sub(bottom, top), top);
+				if (channels == 1)
+					Isa::store(dst + i, v);
+				else
+				{
+					Isa::store(tmp, v);
+					for (int k = 0; k < W; k++)
+						dst[(i + k) * channels + c] = tmp[k];
+				}
+			} // end for c
+		}
+		if (Isa::W > 1 && i < num)
+			warp_row<IsaScalar>(dst, src, width, height, pitch, channels, line, i, num);
+	}
+
+	// see blend_label_row_simd(), x * (255 - a) / 255 rounded as (t + (t >> 8)) >> 8 for t = x * (255 - a) + 128,
+	// exact for x, a in [0, 255] and within 16 bits
+	static unsigned int blend_label_pixel(unsigned int s, unsigned int p)
+	{
+		const unsigned int ia = 255 - (p >> 24);
+		unsigned int d = 0;
+		for (int k = 0; k < 32; k += 8)
+		{
+			const unsigned int t = ((s >> k) & 0xff) * ia + 128;
+			d |= (((t + (t >> 8)) >> 8) + ((p >> k) & 0xff)) << k;
+		}
+		return d;
+	}
+
+	template<class Isa> struct LabelBlend
+	{
+		static void row(unsigned int* dst, const unsigned int* src, const unsigned char* labels,
+			const unsigned int* palette, int num)
+		{
+			for (int x = 0; x < num; x++)
+				dst[x] = blend_label_pixel(src[x], palette[labels[x]]);
+		}
+	};
+
+	// the channels of 2 pixels in 16-bit lanes: c * (255 - a) / 255, a broadcast from lanes 3 and 7 of @p
+	static __m128i blend_label_lanes(__m128i c, __m128i p)
+	{
+		const __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(p, 0xff), 0xff);
+		__m128i t = _mm_add_epi16(_mm_mullo_epi16(c, _mm_sub_epi16(_mm_set1_epi16(255), a)), _mm_set1_epi16(128));
+		return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+	}
+
+	template<> struct LabelBlend<IsaSse2>
+	{
+		static void row(unsigned int* dst, const unsigned int* src, const unsigned char* labels,
+			const unsigned int* palette, int num)
+		{
+			const __m128i zero = _mm_setzero_si128();
+			int x = 0;
+			for (; x + 4 <= num; x += 4)
+			{
+				const __m128i p = _mm_setr_epi32(palette[labels[x]], palette[labels[x + 1]],
+					palette[labels[x + 2]], palette[labels[x + 3]]);
+				const __m128i s = _mm_loadu_si128((const __m128i*)(src + x));
+				if (_mm_movemask_epi8(_mm_cmpeq_epi32(p, zero)) == 0xffff)
+				{
+					_mm_storeu_si128((__m128i*)(dst + x), s);
+					continue;
+				}
+				const __m128i lo = blend_label_lanes(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(p, zero));
+				const __m128i hi = blend_label_lanes(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(p, zero));
+				_mm_storeu_si128((__m128i*)(dst + x), _mm_add_epi8(_mm_packus_epi16(lo, hi), p));
+			}
+			LabelBlend<IsaScalar>::row(dst + x, src + x, labels + x, palette, num - x);
+		}
+	};
+
+#ifdef CONV_HELPER_HAS_AVX2
+	static __m256i blend_label_lanes(__m256i c, __m256i p)
+	{
+		const __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(p, 0xff), 0xff);
+		__m256i t = _mm256_add_epi16(_mm256_mullo_epi16(c, _mm256_sub_epi16(_mm256_set1_epi16(255), a)),
+			_mm256_set1_epi16(128));
+		return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+	}
+
+	// the unpacks and packs are within 128-bit lanes, thus cancel out
+	template<> struct LabelBlend<IsaAvx2>
+	{
+		static void row(unsigned int* dst, const unsigned int* src, const unsigned char* labels,
+			const unsigned int* palette, int num)
+		{
+			const __m256i zero = _mm256_setzero_si256();
+			int x = 0;
+			for (; x + 8 <= num; x += 8)
+			{
+				const unsigned char* l = labels + x;
+				const __m256i p = _mm256_setr_epi32(palette[l[0]], palette[l[1]], palette[l[2]], palette[l[3]],
+					palette[l[4]], palette[l[5]], palette[l[6]], palette[l[7]]);
+				const __m256i s = _mm256_loadu_si256((const __m256i*)(src + x));
+				if (_mm256_testz_si256(p, p))
+				{
+					_mm256_storeu_si256((__m256i*)(dst + x), s);
+					continue;
+				}
+				const __m256i lo = blend_label_lanes(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(p, zero));
+				const __m256i hi = blend_label_lanes(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(p, zero));
+				_mm256_storeu_si256((__m256i*)(dst + x), _mm256_add_epi8(_mm256_packus_epi16(lo, hi), p));
+			}
+			LabelBlend<IsaSse2>::row(dst + x, src + x, labels + x, palette, num - x);
+		}
+	};
+#endif
+
+#ifdef CONV_HELPER_HAS_AVX512
+	// bytes in 512 bits need AVX-512BW, the AVX2 code is used
+	template<> struct LabelBlend<IsaAvx512> : LabelBlend<IsaAvx2>{};
+#endif
+
+	//////////////////////////////////////////////////////////////////////////
+	// per-ISA entries
+	struct SimdKernels
+	{
+		int lanes;
+		void(*conv_row)(float*, const float*, const float*, int, int);
+		void(*max_row)(float*, const float*, int, int);
+		void(*min_row)(float*, const float*, int, int);
+		void(*conv_rows)(float*, const float* const*, const float*, int, int);
+		void(*max_rows)(float*, const float* const*, int, int);
+		void(*min_rows)(float*, const float* const*, int, int);
+		void(*rb_relax_row)(float*, const float*, const float*, const float*, int, int, int);
+		void(*decode_half_row)(float*, const unsigned short*, int);
+		void(*encode_half_row)(unsigned short*, const float*, int);
+		void(*decode_u8_row)(float*, const unsigned char*, int, float, float);
+		void(*decode_u16_row)(float*, const unsigned short*, int, float, float);
+		void(*encode_u8_row)(unsigned char*, const float*, int, float, float);
+		void(*encode_u16_row)(unsigned short*, const float*, int, float, float);
+		void(*gather_row)(float*, const float*, const int*, const float*, int, int, int);
+		void(*warp_row)(float*, const float*, int, int, int, int, const float*, int);
+		void(*blend_label_row)(unsigned int*, const unsigned int*, const unsigned char*, const unsigned int*, int);
+	};
+
+	// avoid the penalty of mixing AVX and legacy SSE code after returning
+	template<class Isa> inline void simd_leave(){}
+#ifdef CONV_HELPER_HAS_AVX2
+	template<> inline void simd_leave<IsaAvx2>(){ _mm256_zeroupper(); }
+#endif
+#ifdef CONV_HELPER_HAS_AVX512
+	template<> inline void simd_leave<IsaAvx512>(){ _mm256_zeroupper(); }
+#endif
+
+	template<class Isa> struct SimdEntries
+	{
+		static void conv_row(float* dst, const float* src, const float* kernel, int N, int num)
+		{
+			filter_row<Isa>(dst, src, num, ConvOp<Isa>(kernel, N));
+			simd_leave<Isa>();
+		}
+		static void max_row(float* dst, const float* src, int N, int num)
+		{
+			filter_row<Isa>(dst, src, num, MaxOp<Isa>(N));
+			simd_leave<Isa>();
+		}
+		static void min_row(float* dst, const float* src, int N, int num)
+		{
+			filter_row<Isa>(dst, src, num, MinOp<Isa>(N));
+			simd_leave<Isa>();
+		}
+		static void conv_rows(float* dst, const float* const* rows, const float* weights, int nRows, int num)
+		{
+			filter_rows<Isa>(dst, rows, nRows, num, WeightedSumOp<Isa>(weights, nRows));
+			simd_leave<Isa>();
+		}
+		static void max_rows(float* dst, const float* const* rows, int nRows, int num)
+		{
+			filter_rows<Isa>(dst, rows, nRows, num, MaxOp<Isa>(1));
+			simd_leave<Isa>();
+		}
+		static void min_rows(float* dst, const float* const* rows, int nRows, int num)
+		{
+			filter_rows<Isa>(dst, rows, nRows, num, MinOp<Isa>(1));
+			simd_leave<Isa>();
+		}
+		static void rb_relax_row(float* u, const float* up, const float* down, const float* f, int nv,
+			int phase, int num)
+		{
+			conv_helper::rb_relax_row<Isa>(u, up, down, f, nv, phase, num);
+			simd_leave<Isa>();
+		}
+		static void decode_half_row(float* dst, const unsigned short* src, int num)
+		{
+			conv_helper::decode_half_row<Isa>(dst, src, num);
+			simd_leave<Isa>();
+		}
+		static void encode_half_row(unsigned short* dst, const float* src, int num)
+		{
+			conv_helper::encode_half_row<Isa>(dst, src, num);
+			simd_leave<Isa>();
+		}
+		template<class T> static void decode_fixed_row(float* dst, const T* src, int num, float scale, float offset)
+		{
+			conv_helper::decode_fixed_row<Isa>(dst, src, num, scale, offset);
+			simd_leave<Isa>();
+		}
+		template<class T> static void encode_fixed_row(T* dst, const float* src, int num, float scale, float offset)
+		{
+			conv_helper::encode_fixed_row<Isa>(dst, src, num, scale, offset);
+			simd_leave<Isa>();
+		}
+		static void gather_row(float* dst, const float* src, const int* offsets, const float* weights,
+			int taps, int step, int num)
+		{
+			conv_helper::gather_row<Isa>(dst, src, offsets, weights, taps, step, num);
+			simd_leave<Isa>();
+		}
+		static void warp_row(float* dst, const float* src, int width, int height, int pitch, int channels,
+			const float* line, int num)
+		{
+			conv_helper::warp_row<Isa>(dst, src, width, height, pitch, channels, line, 0, num);
+			simd_leave<Isa>();
+		}
+		static void blend_label_row(unsigned int* dst, const unsigned int* src, const unsigned char* labels,
+			const unsigned int* palette, int num)
+		{
+			LabelBlend<Isa>::row(dst, src, labels, palette, num);
+			simd_leave<Isa>();
+		}
+		static SimdKernels table()
+		{
+			SimdKernels t = { Isa::W, conv_row, max_row, min_row, conv_rows, max_rows, min_rows,
+				rb_relax_row, decode_half_row, encode_half_row, decode_fixed_row<unsigned char>,
+				decode_fixed_row<unsigned short>, encode_fixed_row<unsigned char>, encode_fixed_row<unsigned short>,
+				gather_row, warp_row, blend_label_row };
+			return t;
+		}
+	};
+
+	static SimdKernels g_simdKernels[SimdAVX512 + 1] =
+	{
+		SimdEntries<IsaScalar>::table(),
+		SimdEntries<IsaSse2>::table(),
+#ifdef CONV_HELPER_HAS_AVX2
+		SimdEntries<IsaAvx2>::table(),
+#else
+		SimdEntries<IsaSse2>::table(),
+#endif
+#ifdef CONV_HELPER_HAS_AVX512
+		SimdEntries<IsaAvx512>::table(),
+#else
+		SimdEntries<IsaSse2>::table(),
+#endif
+	};
+
+	// detected once at startup
+	static const SimdLevel g_simdLevelSupported = detectSimdLevel();
+	static SimdLevel g_simdLevel = g_simdLevelSupported;
+
+	SimdLevel simdLevelSupported()
+	{
+		return g_simdLevelSupported;
+	}
+
+	SimdLevel simdLevel()
+	{
+		return g_simdLevel;
+	}
+
+	void setSimdLevel(SimdLevel level)
+	{
+		g_simdLevel = std::max(SimdNone, std::min(level, g_simdLevelSupported));
+	}
+
+	int simdLanes()
+	{
+		return g_simdKernels[g_simdLevel].lanes;
+	}
+
+	void conv_row_simd(float* dst, const float* src, const float* kernel, int N, int num)
+	{
+		g_simdKernels[g_simdLevel].conv_row(dst, src, kernel, N, num);
+	}
+
+	void max_row_simd(float* dst, const float* src, int N, int num)
+	{
+		g_simdKernels[g_simdLevel].max_row(dst, src, N, num);
+	}
+
+	void min_row_simd(float* dst, const float* src, int N, int num)
+	{
+		g_simdKernels[g_simdLevel].min_row(dst, src, N, num);
+	}
+
+	void conv_rows_simd(float* dst, const float* const* rows, const float* weights, int nRows, int num)
+	{
+		g_simdKernels[g_simdLevel].conv_rows(dst, rows, weights, nRows, num);
+	}
+
+	void max_rows_simd(float* dst, const float* const* rows, int nRows, int num)
+	{
+		g_simdKernels[g_simdLevel].max_rows(dst, rows, nRows, num);
+	}
+
+	void min_rows_simd(float* dst, const float* const* rows, int nRows, int num)
+	{
+		g_simdKernels[g_simdLevel].min_rows(dst, rows, nRows, num);
+	}
+
+	void rb_relax_row_simd(float* u, const float* up, const float* down, const float* f, int nv,
+		int phase, int num)
+	{
+		g_simdKernels[g_simdLevel].rb_relax_row(u, up, down, f, nv, phase, num);
+	}
+
+	void decode_row_simd(float* dst, const half_float::half* src, int num)
+	{
+		g_simdKernels[g_simdLevel].decode_half_row(dst, (const unsigned short*)src, num);
+	}
+
+	void decode_row_simd(float* dst, const unsigned char* src, int num, float scale, float offset)
+	{
+		g_simdKernels[g_simdLevel].decode_u8_row(dst, src, num, scale, offset);
+	}
+
+	void decode_row_simd(float* dst, const unsigned short* src, int num, float scale, float offset)
+	{
+		g_simdKernels[g_simdLevel].decode_u16_row(dst, src, num, scale, offset);
+	}
+
+	void encode_row_simd(half_float::half* dst, const float* src, int num)
+	{
+		g_simdKernels[g_simdLevel].encode_half_row((unsigned short*)dst, src, num);
+	}
+
+	void encode_row_simd(unsigned char* dst, const float* src, int num, float scale, float offset)
+	{
+		g_simdKernels[g_simdLevel].encode_u8_row(dst, src, num, scale, offset);
+	}
+
+	void encode_row_simd(unsigned short* dst, const float* src, int num, float scale, float offset)
+	{
+		g_simdKernels[g_simdLevel].encode_u16_row(dst, src, num, scale, offset);
+	}
+
+	void gather_row_simd(float* dst, const float* src, const int* offsets, const float* weights,
+		int taps, int step, int num)
+	{
+		g_simdKernels[g_simdLevel].gather_row(dst, src, offsets, weights, taps, step, num);
+	}
+
+	void warp_row_simd(float* dst, const float* src, int width, int height, int pitch, int channels,
+		const float* line, int num)
+	{
+		g_simdKernels[g_simdLevel].warp_row(dst, src, width, height, pitch, channels, line, num);
+	}
 
-}
\ No newline at end of file
+	void blend_label_row_simd(unsigned int* dst, const unsigned int* src, const unsigned char* labels,
+		const unsigned int* palette, int num)
+	{
+		g_simdKernels[g_simdLevel].blend_label_row(dst, src, labels, palette, num);
+	}
+}
+#pragma pop_macro("max")
+#pragma pop_macro("min")
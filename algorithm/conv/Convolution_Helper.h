@@ -1,17 +1,12 @@
 #pragma once
 
 #define CONV_HELPER_ENABLE_SSE
-#define CONV_HELPER_ENABLE_OMP 1
+#define CONV_HELPER_MAX_SIMD_TAPS 64
+#define CONV_HELPER_RING_BYTES (128 * 1024)
+#define CONV_HELPER_MORPH_BYTES 256
 
 #include "ldp_basic_vec.h"
-
-#ifdef CONV_HELPER_ENABLE_OMP
-#include <omp.h>
-#endif
-
-#ifdef CONV_HELPER_ENABLE_SSE
-#include <xmmintrin.h>      // __m128 data type and SSE functions
-#endif
+#include "ThreadPool.h"
 
 #pragma push_macro("min")
 #pragma push_macro("max")
@@ -19,6 +14,81 @@
 #undef max
 namespace conv_helper
 {
+	//////////////////////////////////////////////////////////////////////////
+	// float kernels with runtime CPU dispatch, implemented in Convolution_Helper.cpp
+	// the level is detected by cpuid once at startup; SimdNone runs the scalar code.
+	// SSE2 results are bitwise the same as the scalar templates below, while AVX2/AVX-512 use
+	// fused multiply-add and may differ by a few ulps in conv; max/min are always exact.
+	enum SimdLevel
+	{
+		SimdNone = 0,
+		SimdSSE2,
+		SimdAVX2,		// with FMA and F16C
+		SimdAVX512,
+	};
+
+	SimdLevel simdLevelSupported();
+	SimdLevel simdLevel();
+
+	// clamped to simdLevelSupported(), E.G., setSimdLevel(SimdNone) for reference results
+	void setSimdLevel(SimdLevel level);
+
+	// floats per vector of simdLevel(), 1 for SimdNone
+	int simdLanes();
+
+	// the same with conv/max_filter/min_filter below on a contiguous row, with dstStride 1
+	// @N: kernel size, no more than CONV_HELPER_MAX_SIMD_TAPS for conv
+	void conv_row_simd(float* dst, const float* src, const float* kernel, int N, int num);
+	void max_row_simd(float* dst, const float* src, int N, int num);
+	void min_row_simd(float* dst, const float* src, int N, int num);
+
+	// combine @nRows rows of @num elements, vectorized along the rows
+	//	conv: dst[x] = sum of rows[i][x] * weights[i], summed in the order of i;
+	//		@nRows no more than CONV_HELPER_MAX_SIMD_TAPS
+	//	max/min: dst[x] = max/min of rows[i][x]
+	void conv_rows_simd(float* dst, const float* const* rows, const float* weights, int nRows, int num);
+	void max_rows_simd(float* dst, const float* const* rows, int nRows, int num);
+	void min_rows_simd(float* dst, const float* const* rows, int nRows, int num);
+
+	// red-black gauss-seidel on a row of the 5-point laplacian, in place: only the elements x of one
+	// color, with x + @phase even, are set to (f + sum of their neighbors) / number of neighbors;
+	// the others, which they depend on, are kept bitwise, thus the vectors are blended per color.
+	// @up/@down: the rows above and below, zeros if absent, @nv of them being present
+	void rb_relax_row_simd(float* u, const float* up, const float* down, const float* f, int nv,
+		int phase, int num);
+
+	// rows in narrower storage, computed in floats; the same on all levels
+	//	half: by F16C on AVX2/AVX-512, rounded to nearest even
+	//	unsigned char/short: fixed point, the value being q * @scale + @offset; encoded rounded to
+	//		nearest even and saturated to the range of the type, NaN to 0
+	void decode_row_simd(float* dst, const half_float::half* src, int num);
+	void decode_row_simd(float* dst, const unsigned char* src, int num, float scale, float offset);
+	void decode_row_simd(float* dst, const unsigned short* src, int num, float scale, float offset);
+	void encode_row_simd(half_float::half* dst, const float* src, int num);
+	void encode_row_simd(unsigned char* dst, const float* src, int num, float scale, float offset);
+	void encode_row_simd(unsigned short* dst, const float* src, int num, float scale, float offset);
+
+	// gathered weighted sums, E.G., resampling a row by a table: vectorized along dst
+	//	dst[x] = sum of src[offsets[x] + k * step] * weights[k * num + x] for k in [0, @taps),
+	//	summed in the order of k; @taps of any number
+	void gather_row_simd(float* dst, const float* src, const int* offsets, const float* weights,
+		int taps, int step, int num);
+
+	// bilinear samples of an image of @channels interleaved, @pitch elements from a row to the next, along
+	// a line: point i in [0, @num) is at ((X0 + i * dX) / (Z0 + i * dZ), (Y0 + i * dY) / (Z0 + i * dZ)),
+	// @line being { X0, dX, Y0, dY, Z0, dZ }, with the pixel centers at integers and the points clamped
+	// to the image; dst[i * channels + c] is its channel c
+	void warp_row_simd(float* dst, const float* src, int width, int height, int pitch, int channels,
+		const float* line, int num);
+
+	// overlay of labels on pixels 0xAARRGGBB through a palette of 256 entries premultiplied by their alpha:
+	// dst[x] = src[x] * (255 - a) / 255 + palette[labels[x]] per channel, a being the alpha of the entry
+	// and the product rounded to nearest; integers, thus the same on all levels.
+	// the entries are loaded per pixel into the vectors, without gathers, and vectors of transparent
+	// entries only copy @src; @dst may be @src
+	void blend_label_row_simd(unsigned int* dst, const unsigned int* src, const unsigned char* labels,
+		const unsigned int* palette, int num);
+
 	// 3D volume padding by zeros
 	template<typename T, int N> void zero_padding3(T* dst, const T* src, ldp::Int3 srcRes)
 	{
@@ -73,6 +143,28 @@ namespace conv_helper
 		}// y
 	}
 
+	// dst[x][r] = src[r][x] for a block of @numRows x @numCols, in square tiles so that both sides
+	// are accessed by whole cache lines
+	template<typename T> void transpose(T* dst, size_t dstStride, const T* src, size_t srcStride,
+		int numRows, int numCols)
+	{
+		const int tile = 16;
+		for (int rb = 0; rb < numRows; rb += tile)
+		{
+			const int re = std::min(numRows, rb + tile);
+			for (int xb = 0; xb < numCols; xb += tile)
+			{
+				const int xe = std::min(numCols, xb + tile);
+				for (int x = xb; x < xe; x++)
+				{
+					T* d = dst + x * dstStride;
+					for (int r = rb; r < re; r++)
+						d[r] = src[r * srcStride + x];
+				}
+			}// end for xb
+		}// end for rb
+	}
+
 	// 1D max filter
 	template<typename T, int N> void max_filter(T* dst, const T* src,
 		int num, int dstStride)
@@ -168,8 +260,13 @@ namespace conv_helper
 		}
 	}
 
-#ifdef CONV_HELPER_ENABLE_SSE
-	template<int N> void max_filter_sse(float* dst, const float* src,
+	// 1D conv, the same with matlab conv(..., 'same')
+	//	assume:
+	//		the stride of src is 1 
+	//		the size of src @num
+	//		the size of dst @num
+	//		kernel size is @N
+	template<typename T, int N> void conv(T* dst, const T* src, const T* kernel,
 		int num, int dstStride)
 	{
 		const static int L = N / 2 - (N % 2 == 0);
@@ -178,33 +275,25 @@ namespace conv_helper
 		const int tail_pos = num - R;
 		const int tail_head_pos = std::max(head_pos, tail_pos);
 
-		__m128 s;
-
 		// the first few elements that does not fullfill the conv kernel
 		for (int x = 0; x < head_pos; x++)
 		{
 			const int xb = std::max(-L, -x);
 			const int xe = std::min(num - x - 1, R);
-			__m128 v = _mm_set_ps1(std::numeric_limits<float>::lowest());
+			T v = 0;
 			for (int k = xb; k <= xe; k++)
-			{
-				s = _mm_loadu_ps(src + (k + x) * 4);
-				v = _mm_max_ps(v, s);
-			}
-			_mm_storeu_ps(dst, v);
+				v += src[k + x] * kernel[R - k];
+			*dst = v;
 			dst += dstStride;
 		}
 
 		// middle elements that fullfills the conv kernel
 		for (int x = R; x < tail_pos; x++)
 		{
-			__m128 v = _mm_set_ps1(std::numeric_limits<float>::lowest());
+			T v = 0;
 			for (int k = -L; k <= R; k++)
-			{
-				s = _mm_loadu_ps(src + (k + x) * 4);
-				v = _mm_max_ps(v, s);
-			}
-			_mm_storeu_ps(dst, v);
+				v += src[k + x] * kernel[R - k];
+			*dst = v;
 			dst += dstStride;
 		}// end for x
 
@@ -213,429 +302,587 @@ namespace conv_helper
 		{
 			const int xb = std::max(-L, -x);
 			const int xe = std::min(num - x - 1, R);
-			__m128 v = _mm_set_ps1(std::numeric_limits<float>::lowest());
+			T v = 0;
 			for (int k = xb; k <= xe; k++)
-			{
-				s = _mm_loadu_ps(src + (k + x) * 4);
-				v = _mm_max_ps(v, s);
-			}
-			_mm_storeu_ps(dst, v);
+				v += src[k + x] * kernel[R - k];
+			*dst = v;
 			dst += dstStride;
 		}
 	}
 
-	template<int N> void min_filter_sse(float* dst, const float* src,
-		int num, int dstStride)
+	//////////////////////////////////////////////////////////////////////////
+	// separable filters used by conv3/max_filter3/min_filter3
+
+	// dst[x] = sum of rows[k - kb][x] * kernel[R - k] for k in [kb, ke], summed in the order of conv()
+	template<typename T, int N> void conv_rows(T* dst, const T* const* rows, const T* kernel,
+		int kb, int ke, int num)
 	{
-		const static int L = N / 2 - (N % 2 == 0);
 		const static int R = N / 2;
-		const int head_pos = std::min((int)num, R);
-		const int tail_pos = num - R;
-		const int tail_head_pos = std::max(head_pos, tail_pos);
-
-		__m128 s;
+		for (int x = 0; x < num; x++)
+			dst[x] = 0;
+		for (int k = kb; k <= ke; k++)
+		{
+			const T* src = rows[k - kb];
+			const T w = kernel[R - k];
+			for (int x = 0; x < num; x++)
+				dst[x] += src[x] * w;
+		}
+	}
 
-		// the first few elements that does not fullfill the conv kernel
-		for (int x = 0; x < head_pos; x++)
+	// filter operations on rows
+	//	row(): filter a contiguous row of @num elements
+	//	rows(): dst[x] = filter over rows[0..ke-kb][x], where rows[i] is (kb + i) rows from dst
+	template<typename T, int N> struct ConvFilter
+	{
+		const T* kernel;
+		ConvFilter(const T* knl) : kernel(knl){}
+		void row(T* dst, const T* src, int num)const
 		{
-			const int xb = std::max(-L, -x);
-			const int xe = std::min(num - x - 1, R);
-			__m128 v = _mm_set_ps1(std::numeric_limits<float>::max());
-			for (int k = xb; k <= xe; k++)
-			{
-				s = _mm_loadu_ps(src + (k + x) * 4);
-				v = _mm_min_ps(v, s);
-			}
-			_mm_storeu_ps(dst, v);
-			dst += dstStride;
+			conv<T, N>(dst, src, kernel, num, 1);
 		}
+		void rows(T* dst, const T* const* rows, int kb, int ke, int num)const
+		{
+			conv_rows<T, N>(dst, rows, kernel, kb, ke, num);
+		}
+	};
 
-		// middle elements that fullfills the conv kernel
-		for (int x = R; x < tail_pos; x++)
+	template<typename T, int N> struct MaxFilter
+	{
+		void row(T* dst, const T* src, int num)const
 		{
-			__m128 v = _mm_set_ps1(std::numeric_limits<float>::max());
-			for (int k = -L; k <= R; k++)
+			max_filter<T, N>(dst, src, num, 1);
+		}
+		void rows(T* dst, const T* const* rows, int kb, int ke, int num)const
+		{
+			for (int x = 0; x < num; x++)
+				dst[x] = std::numeric_limits<T>::lowest();
+			for (int k = kb; k <= ke; k++)
 			{
-				s = _mm_loadu_ps(src + (k + x) * 4);
-				v = _mm_min_ps(v, s);
+				const T* src = rows[k - kb];
+				for (int x = 0; x < num; x++)
+				if (src[x] > dst[x])
+					dst[x] = src[x];
 			}
-			_mm_storeu_ps(dst, v);
-			dst += dstStride;
-		}// end for x
+		}
+	};
 
-		// the last few elements that does not fullfill the conv kernel
-		for (int x = tail_head_pos; x < num; x++)
+	template<typename T, int N> struct MinFilter
+	{
+		void row(T* dst, const T* src, int num)const
 		{
-			const int xb = std::max(-L, -x);
-			const int xe = std::min(num - x - 1, R);
-			__m128 v = _mm_set_ps1(std::numeric_limits<float>::max());
-			for (int k = xb; k <= xe; k++)
+			min_filter<T, N>(dst, src, num, 1);
+		}
+		void rows(T* dst, const T* const* rows, int kb, int ke, int num)const
+		{
+			for (int x = 0; x < num; x++)
+				dst[x] = std::numeric_limits<T>::max();
+			for (int k = kb; k <= ke; k++)
 			{
-				s = _mm_loadu_ps(src + (k + x) * 4);
-				v = _mm_min_ps(v, s);
+				const T* src = rows[k - kb];
+				for (int x = 0; x < num; x++)
+				if (src[x] < dst[x])
+					dst[x] = src[x];
 			}
-			_mm_storeu_ps(dst, v);
-			dst += dstStride;
 		}
-	}
-#endif
+	};
 
-	// 3D max filter
-	// @dim: 
-	//		0, filter x; 
-	//		1, filter y; 
-	//		2, filter z;
-	//		-1[default], filter all directions
-	template<typename T, int N, int numThreads = 4> void max_filter3(
-		T* srcDst, ldp::Int3 res, int dim = -1)
+#ifdef CONV_HELPER_ENABLE_SSE
+	// float data goes to the SIMD kernels of simdLevel()
+	template<int N> struct ConvFilter<float, N>
 	{
-		T* dstPtr_000 = srcDst;
-		const int y_stride = res[0];;
-		const int z_stride = res[0] * res[1];
+		const static int R = N / 2;
+		const float* kernel;
+		ConvFilter(const float* knl) : kernel(knl){}
+		void row(float* dst, const float* src, int num)const
+		{
+			if (N <= CONV_HELPER_MAX_SIMD_TAPS)
+				conv_row_simd(dst, src, kernel, N, num);
+			else
+				conv<float, N>(dst, src, kernel, num, 1);
+		}
+		void rows(float* dst, const float* const* rows, int kb, int ke, int num)const
+		{
+			if (N > CONV_HELPER_MAX_SIMD_TAPS)
+				return conv_rows<float, N>(dst, rows, kernel, kb, ke, num);
+			float w[N];
+			for (int k = kb; k <= ke; k++)
+				w[k - kb] = kernel[R - k];
+			conv_rows_simd(dst, rows, w, ke - kb + 1, num);
+		}
+	};
 
-		if (dim < -1 || dim > 2)
-			throw std::exception("illegal input parameter @dim");
+	template<int N> struct MaxFilter<float, N>
+	{
+		void row(float* dst, const float* src, int num)const
+		{
+			max_row_simd(dst, src, N, num);
+		}
+		void rows(float* dst, const float* const* rows, int kb, int ke, int num)const
+		{
+			max_rows_simd(dst, rows, ke - kb + 1, num);
+		}
+	};
 
-		// allocate buffer for thread data
-		std::vector<T> tmpBuffers[numThreads];
-#ifdef CONV_HELPER_ENABLE_SSE
-		std::vector<__m128> tmpBuffers_sse[numThreads];
-#endif
-		for (int k = 0; k < numThreads; k++)
+	template<int N> struct MinFilter<float, N>
+	{
+		void row(float* dst, const float* src, int num)const
 		{
-			tmpBuffers[k].resize(std::max(res[0], std::max(res[1], res[2])));
-#ifdef CONV_HELPER_ENABLE_SSE
-			if (ldp::is_float<T>::value)
-				tmpBuffers_sse[k].resize(std::max(res[0], std::max(res[1], res[2])));
-#endif
+			min_row_simd(dst, src, N, num);
 		}
+		void rows(float* dst, const float* const* rows, int kb, int ke, int num)const
+		{
+			min_rows_simd(dst, rows, ke - kb + 1, num);
+		}
+	};
+#endif
 
-		if (dim == 0 || dim == -1)
+	// filter along the row index of a 2D slice in place, row r is at data + r * rowStride
+	// the slice is streamed through a ring of N rows, thus each element is read and written once
+	// and no column is gathered. only columns [cb, ce) of the output rows [rb, re) are written;
+	// the input rows out of [rb, re), which other threads may overwrite, are read from @halo:
+	// rows [rb - L, rb) followed by [re, re + R), clamped to the slice, @haloStride apart.
+	// @fuseRow: each row is filtered by op.row() when entering the ring, I.E., x and y in one pass
+	// @ring: N * (ce - cb)
+	template<typename T, int N, class Op> void filter_slice_rows(T* data, size_t rowStride, int numRows,
+		int cb, int ce, int rb, int re, const T* halo, int haloStride, bool fuseRow, T* ring, const Op& op)
+	{
+		const int L = N / 2 - (N % 2 == 0);
+		const int R = N / 2;
+		const int width = ce - cb;
+		const int hb = std::max(0, rb - L);
+		const int he = std::min(numRows, re + R);
+		const T* rows[N];
+
+		for (int r = hb; r < re + R; r++)
 		{
-			// max filtering along x direction
-#pragma omp parallel for num_threads(numThreads) if(CONV_HELPER_ENABLE_OMP)
-			for (int z = 0; z < res[2]; z++)
+			// bring row r into the ring
+			if (r < he)
 			{
-				std::vector<T>& tmpBuffer = tmpBuffers[omp_get_thread_num()];
-				T* dstPtr_00z = dstPtr_000 + z * z_stride;
-				for (int y = 0; y < res[1]; y++)
-				{
-					T* dstPtr = dstPtr_00z + y * y_stride;
-					for (int x = 0; x < res[0]; x++)
-						tmpBuffer[x] = dstPtr[x];
-					max_filter<T, N>(dstPtr, tmpBuffer.data(), res[0], 1);
-				}// end for y
-			}// end for z
-		}// end if dim == 0
+				const T* src = data + r * rowStride + cb;
+				if (r < rb)
+					src = halo + (r - hb) * haloStride + cb;
+				else if (r >= re)
+					src = halo + (rb - hb + r - re) * haloStride + cb;
+				T* slot = ring + (r % N) * width;
+				if (fuseRow)
+					op.row(slot, src, width);
+				else
+					memcpy(slot, src, width * sizeof(T));
+			}
 
-		if (dim == 1 || dim == -1)
+			// rows [o - L, o + R] are all in the ring now
+			const int o = r - R;
+			if (o < rb)
+				continue;
+			const int kb = std::max(-L, -o);
+			const int ke = std::min(numRows - o - 1, R);
+			for (int k = kb; k <= ke; k++)
+				rows[k - kb] = ring + ((o + k) % N) * width;
+			op.rows(data + o * rowStride + cb, rows, kb, ke, width);
+		}// end for r
+	}
+
+	// filter_rows3() with @nStrips strips, @halo to keep their border rows if more than one
+	template<typename T, int N, class Op> void filter_rows3_strips(T* base, size_t sliceStride,
+		int numSlices, size_t rowStride, int numRows, int width, bool fuseRow, const Op& op,
+		int nStrips, T* halo)
+	{
+		// the row filter needs whole rows
+		const int tileWidth = fuseRow ? width : std::max(64, (int)(CONV_HELPER_RING_BYTES / (N * sizeof(T))));
+		const int nTiles = (width + tileWidth - 1) / tileWidth;
+		const int L = N / 2 - (N % 2 == 0);
+		const int R = N / 2;
+		const int nHaloRows = L + R;
+
+		if (halo)
 		{
-			// max filtering along y direction
-#pragma omp parallel for num_threads(numThreads) if(CONV_HELPER_ENABLE_OMP)
-			for (int z = 0; z < res[2]; z++)
+			ldp::parallelFor(0, numSlices * nStrips, 0, [&](int stb, int ste)
 			{
-				std::vector<T>& tmpBuffer = tmpBuffers[omp_get_thread_num()];
-				T* dstPtr_00z = dstPtr_000 + z * z_stride;
-#ifdef CONV_HELPER_ENABLE_SSE
-				std::vector<__m128>& tmpBuffer_sse =
-					tmpBuffers_sse[omp_get_thread_num()];
-#endif
-				int x = 0;
-#ifdef CONV_HELPER_ENABLE_SSE
-				if (ldp::is_float<T>::value)
-				{
-					for (; x < res[0] - 3; x += 4)
-					{
-						T* dstPtr = dstPtr_00z + x;
-						for (int y = 0, y1 = 0; y < res[1]; y++, y1 += y_stride)
-							tmpBuffer_sse[y] = _mm_loadu_ps((float*)dstPtr + y1);
-						max_filter_sse<N>((float*)dstPtr, (const float*)tmpBuffer_sse.data(), res[1], y_stride);
-					}
-				}
-#endif
-				for (; x < res[0]; x++)
+				for (int st = stb; st < ste; st++)
 				{
-					T* dstPtr = dstPtr_00z + x;
-					for (int y = 0, y1 = 0; y < res[1]; y++, y1 += y_stride)
-						tmpBuffer[y] = dstPtr[y1];
-					max_filter<T, N>(dstPtr, tmpBuffer.data(), res[1], y_stride);
-				}// end for x
-			}// end for z
-		}// end if dim == 1
-
-		if ((dim == 2 || dim == -1)&&res[2]>1)
-		{
-			// max filtering along z direction
-#pragma omp parallel for num_threads(numThreads) if(CONV_HELPER_ENABLE_OMP)
-			for (int y = 0; y < res[1]; y++)
+					const int s = st / nStrips, t = st % nStrips;
+					const int rb = numRows * t / nStrips, re = numRows * (t + 1) / nStrips;
+					const T* slice = base + s * sliceStride;
+					T* dst = halo + (size_t)st * nHaloRows * width;
+					for (int r = std::max(0, rb - L); r < rb; r++, dst += width)
+						memcpy(dst, slice + r * rowStride, width * sizeof(T));
+					for (int r = re; r < std::min(numRows, re + R); r++, dst += width)
+						memcpy(dst, slice + r * rowStride, width * sizeof(T));
+				}// end for st
+			});
+		}
+
+		// one task per (slice, strip, tile), the ring is taken from the worker scratch
+		ldp::parallelFor(0, numSlices * nStrips * nTiles, 1, [&](int taskBegin, int taskEnd)
+		{
+			ldp::ScratchArena& arena = ldp::ThreadPool::instance().scratch();
+			ldp::ScratchArena::Scope scope(arena);
+			T* ring = arena.allocate<T>(N * std::min(width, tileWidth));
+			for (int task = taskBegin; task < taskEnd; task++)
 			{
-				std::vector<T>& tmpBuffer = tmpBuffers[omp_get_thread_num()];
-				T* dstPtr_00y = dstPtr_000 + y * y_stride;
-#ifdef CONV_HELPER_ENABLE_SSE
-				std::vector<__m128>& tmpBuffer_sse =
-					tmpBuffers_sse[omp_get_thread_num()];
-#endif
+				const int st = task / nTiles, c = task % nTiles;
+				const int s = st / nStrips, t = st % nStrips;
+				const int rb = numRows * t / nStrips, re = numRows * (t + 1) / nStrips;
+				const int cb = width * c / nTiles, ce = width * (c + 1) / nTiles;
+				const T* haloPtr = halo ? halo + (size_t)st * nHaloRows * width : 0;
+				filter_slice_rows<T, N>(base + s * sliceStride, rowStride, numRows, cb, ce, rb, re,
+					haloPtr, width, fuseRow, ring, op);
+			}// end for task
+		});
+	}
 
-				int x = 0;
-#ifdef CONV_HELPER_ENABLE_SSE
-				if (ldp::is_float<T>::value)
-				{
-					for (; x < res[0] - 3; x += 4)
-					{
-						T* dstPtr = dstPtr_00y + x;
-						for (int z = 0, z1 = 0; z < res[2]; z++, z1 += z_stride)
-							tmpBuffer_sse[z] = _mm_loadu_ps((float*)&dstPtr[z1]);
-						max_filter_sse<N>((float*)dstPtr, (const float*)tmpBuffer_sse.data(), res[2], z_stride);
-					}
-				}
-#endif
-				for (; x < res[0]; x++)
-				{
-					T* dstPtr = dstPtr_00y + x;
-					for (int z = 0, z1 = 0; z < res[2]; z++, z1 += z_stride)
-						tmpBuffer[z] = dstPtr[z1];
-					max_filter<T, N>(dstPtr, tmpBuffer.data(), res[2], z_stride);
-				}// end for x
-			}// end for y
-		}// end if dim == 2
+	// filter along the rows of @numSlices slices, @sliceStride apart, see filter_slice_rows()
+	// slices are split into strips of rows when there are fewer slices than threads, and into
+	// tiles of columns so that the ring fits in CONV_HELPER_RING_BYTES.
+	template<typename T, int N, class Op> void filter_rows3(T* base, size_t sliceStride,
+		int numSlices, size_t rowStride, int numRows, int width, bool fuseRow, const Op& op)
+	{
+		const int numThreads = ldp::ThreadPool::instance().maxThreads();
+		const int nStrips = numSlices >= numThreads ? 1 : std::max(1, std::min(
+			(numThreads + numSlices - 1) / numSlices, numRows / (4 * N)));
+		const int nHaloRows = N / 2 - (N % 2 == 0) + N / 2;
+
+		// the rows around the strip borders, before being overwritten
+		// taken from the worker scratch when called inside a pool task
+		const size_t haloSize = nStrips > 1 ? (size_t)numSlices * nStrips * nHaloRows * width : 0;
+		if (haloSize && ldp::ThreadPool::currentWorker() >= 0)
+		{
+			ldp::ScratchArena& arena = ldp::ThreadPool::instance().scratch();
+			ldp::ScratchArena::Scope scope(arena);
+			filter_rows3_strips<T, N>(base, sliceStride, numSlices, rowStride, numRows, width, fuseRow, op,
+				nStrips, arena.allocate<T>(haloSize));
+		}
+		else
+		{
+			std::vector<T> halo(haloSize);
+			filter_rows3_strips<T, N>(base, sliceStride, numSlices, rowStride, numRows, width, fuseRow, op,
+				nStrips, haloSize ? halo.data() : 0);
+		}
 	}
 
-	template<typename T, int N, int numThreads = 4> void min_filter3(
-		T* srcDst, ldp::Int3 res, int dim = -1)
+	// 3D separable filter by @op along x-y-z, in place
+	// the x and y passes are fused when filtering all directions
+	// @pitch: elements from a row to the next, res[0] if <= 0; slices are res[1] rows apart
+	template<typename T, int N, class Op> void separable_filter3(
+		T* srcDst, ldp::Int3 res, int dim, const Op& op, int pitch = 0)
 	{
-		T* dstPtr_000 = srcDst;
-		const int y_stride = res[0];;
-		const int z_stride = res[0] * res[1];
+		const size_t y_stride = pitch > 0 ? pitch : res[0];
+		const size_t z_stride = y_stride * res[1];
 
 		if (dim < -1 || dim > 2)
 			throw std::exception("illegal input parameter @dim");
 
-		// allocate buffer for thread data
-		std::vector<T> tmpBuffers[numThreads];
-#ifdef CONV_HELPER_ENABLE_SSE
-		std::vector<__m128> tmpBuffers_sse[numThreads];
-#endif
-		for (int k = 0; k < numThreads; k++)
-		{
-			tmpBuffers[k].resize(std::max(res[0], std::max(res[1], res[2])));
-#ifdef CONV_HELPER_ENABLE_SSE
-			if (ldp::is_float<T>::value)
-				tmpBuffers_sse[k].resize(std::max(res[0], std::max(res[1], res[2])));
-#endif
-		}
-
-		if (dim == 0 || dim == -1)
+		if (dim == 0)
 		{
-			// max filtering along x direction
-#pragma omp parallel for num_threads(numThreads) if(CONV_HELPER_ENABLE_OMP)
-			for (int z = 0; z < res[2]; z++)
+			// filtering along x direction
+			ldp::parallelFor(0, res[1] * res[2], 0, [&](int yzb, int yze)
 			{
-				std::vector<T>& tmpBuffer = tmpBuffers[omp_get_thread_num()];
-				T* dstPtr_00z = dstPtr_000 + z * z_stride;
-				for (int y = 0; y < res[1]; y++)
+				ldp::ScratchArena& arena = ldp::ThreadPool::instance().scratch();
+				ldp::ScratchArena::Scope scope(arena);
+				T* tmpBuffer = arena.allocate<T>(res[0]);
+				for (int yz = yzb; yz < yze; yz++)
 				{
-					T* dstPtr = dstPtr_00z + y * y_stride;
-					for (int x = 0; x < res[0]; x++)
-						tmpBuffer[x] = dstPtr[x];
-					min_filter<T, N>(dstPtr, tmpBuffer.data(), res[0], 1);
-				}// end for y
-			}// end for z
+					T* dstPtr = srcDst + yz * y_stride;
+					memcpy(tmpBuffer, dstPtr, res[0] * sizeof(T));
+					op.row(dstPtr, tmpBuffer, res[0]);
+				}// end for yz
+			});
 		}// end if dim == 0
 
+		// filtering along y direction, each z-slice
 		if (dim == 1 || dim == -1)
-		{
-			// max filtering along y direction
-#pragma omp parallel for num_threads(numThreads) if(CONV_HELPER_ENABLE_OMP)
-			for (int z = 0; z < res[2]; z++)
-			{
-				std::vector<T>& tmpBuffer = tmpBuffers[omp_get_thread_num()];
-				T* dstPtr_00z = dstPtr_000 + z * z_stride;
-#ifdef CONV_HELPER_ENABLE_SSE
-				std::vector<__m128>& tmpBuffer_sse =
-					tmpBuffers_sse[omp_get_thread_num()];
-#endif
-				int x = 0;
-#ifdef CONV_HELPER_ENABLE_SSE
-				if (ldp::is_float<T>::value)
-				{
-					for (; x < res[0] - 3; x += 4)
-					{
-						T* dstPtr = dstPtr_00z + x;
-						for (int y = 0, y1 = 0; y < res[1]; y++, y1 += y_stride)
-							tmpBuffer_sse[y] = _mm_loadu_ps((float*)dstPtr + y1);
-						min_filter_sse<N>((float*)dstPtr, (const float*)tmpBuffer_sse.data(), res[1], y_stride);
-					}
-				}
-#endif
-				for (; x < res[0]; x++)
-				{
-					T* dstPtr = dstPtr_00z + x;
-					for (int y = 0, y1 = 0; y < res[1]; y++, y1 += y_stride)
-						tmpBuffer[y] = dstPtr[y1];
-					min_filter<T, N>(dstPtr, tmpBuffer.data(), res[1], y_stride);
-				}// end for x
-			}// end for z
-		}// end if dim == 1
-
-		if ((dim == 2 || dim == -1) && res[2]>1)
-		{
-			// max filtering along z direction
-#pragma omp parallel for num_threads(numThreads) if(CONV_HELPER_ENABLE_OMP)
-			for (int y = 0; y < res[1]; y++)
-			{
-				std::vector<T>& tmpBuffer = tmpBuffers[omp_get_thread_num()];
-				T* dstPtr_00y = dstPtr_000 + y * y_stride;
-#ifdef CONV_HELPER_ENABLE_SSE
-				std::vector<__m128>& tmpBuffer_sse =
-					tmpBuffers_sse[omp_get_thread_num()];
-#endif
+			filter_rows3<T, N>(srcDst, z_stride, res[2], y_stride, res[1], res[0], dim == -1, op);
 
-				int x = 0;
-#ifdef CONV_HELPER_ENABLE_SSE
-				if (ldp::is_float<T>::value)
-				{
-					for (; x < res[0] - 3; x += 4)
-					{
-						T* dstPtr = dstPtr_00y + x;
-						for (int z = 0, z1 = 0; z < res[2]; z++, z1 += z_stride)
-							tmpBuffer_sse[z] = _mm_loadu_ps((float*)&dstPtr[z1]);
-						min_filter_sse<N>((float*)dstPtr, (const float*)tmpBuffer_sse.data(), res[2], z_stride);
-					}
-				}
-#endif
-				for (; x < res[0]; x++)
-				{
-					T* dstPtr = dstPtr_00y + x;
-					for (int z = 0, z1 = 0; z < res[2]; z++, z1 += z_stride)
-						tmpBuffer[z] = dstPtr[z1];
-					min_filter<T, N>(dstPtr, tmpBuffer.data(), res[2], z_stride);
-				}// end for x
-			}// end for y
-		}// end if dim == 2
+		// filtering along z direction, each y-slice
+		if ((dim == 2 || dim == -1) && res[2] > 1)
+			filter_rows3<T, N>(srcDst, y_stride, res[1], z_stride, res[2], res[0], false, op);
 	}
 
+	// 3D max filter
+	// @dim: 
+	//		0, filter x; 
+	//		1, filter y; 
+	//		2, filter z;
+	//		-1[default], filter all directions
+	// float data is filtered by the SIMD kernels of simdLevel()
+	// @pitch: see separable_filter3()
+	template<typename T, int N> void max_filter3(
+		T* srcDst, ldp::Int3 res, int dim = -1, int pitch = 0)
+	{
+		separable_filter3<T, N>(srcDst, res, dim, MaxFilter<T, N>(), pitch);
+	}
 
-	template<typename T, int N, int numThreads = 4> void max_filter2(
-		T* srcDst, ldp::Int2 res, int dim = -1)
+	template<typename T, int N> void min_filter3(
+		T* srcDst, ldp::Int3 res, int dim = -1, int pitch = 0)
 	{
-		max_filter3<T, N, numThreads>(srcDst, ldp::Int3(res[0], res[1], 1), dim);
+		separable_filter3<T, N>(srcDst, res, dim, MinFilter<T, N>(), pitch);
 	}
 
-	template<typename T, int N, int numThreads = 4> void min_filter2(
-		T* srcDst, ldp::Int2 res, int dim = -1)
+	template<typename T, int N> void max_filter2(
+		T* srcDst, ldp::Int2 res, int dim = -1, int pitch = 0)
 	{
-		min_filter3<T, N, numThreads>(srcDst, ldp::Int3(res[0], res[1], 1), dim);
+		max_filter3<T, N>(srcDst, ldp::Int3(res[0], res[1], 1), dim, pitch);
 	}
 
-	// 1D conv, the same with matlab conv(..., 'same')
-	//	assume:
-	//		the stride of src is 1 
-	//		the size of src @num
-	//		the size of dst @num
-	//		kernel size is @N
-	template<typename T, int N> void conv(T* dst, const T* src, const T* kernel,
-		int num, int dstStride)
+	template<typename T, int N> void min_filter2(
+		T* srcDst, ldp::Int2 res, int dim = -1, int pitch = 0)
 	{
-		const static int L = N / 2 - (N % 2 == 0);
-		const static int R = N / 2;
-		const int head_pos = std::min((int)num, R);
-		const int tail_pos = num - R;
-		const int tail_head_pos = std::max(head_pos, tail_pos);
+		min_filter3<T, N>(srcDst, ldp::Int3(res[0], res[1], 1), dim, pitch);
+	}
 
-		// the first few elements that does not fullfill the conv kernel
-		for (int x = 0; x < head_pos; x++)
+	//////////////////////////////////////////////////////////////////////////
+	// morphology by van Herk/Gil-Werman, O(1) per element for any window size
+	// the rows are cut into blocks of the window size W; with g the running max from the start of
+	// each block and h the one from its end, the window [o - L, o + R] spans at most two blocks and
+	// max over it is max(h[o - L], g[o + R]), I.E., 3 comparisons whatever the window. the window is
+	// clipped at the borders, the same as max_filter/min_filter.
+
+	// element-wise operations of the morphology: dst[x] = op(a[x], b[x]), dst may be a or b
+	template<typename T> struct MorphMax
+	{
+		void rows(T* dst, const T* a, const T* b, int num)const
 		{
-			const int xb = std::max(-L, -x);
-			const int xe = std::min(num - x - 1, R);
-			T v = 0;
-			for (int k = xb; k <= xe; k++)
-				v += src[k + x] * kernel[R - k];
-			*dst = v;
-			dst += dstStride;
+			for (int x = 0; x < num; x++)
+				dst[x] = a[x] > b[x] ? a[x] : b[x];
 		}
+	};
 
-		// middle elements that fullfills the conv kernel
-		for (int x = R; x < tail_pos; x++)
+	template<typename T> struct MorphMin
+	{
+		void rows(T* dst, const T* a, const T* b, int num)const
 		{
-			T v = 0;
-			for (int k = -L; k <= R; k++)
-				v += src[k + x] * kernel[R - k];
-			*dst = v;
-			dst += dstStride;
-		}// end for x
+			for (int x = 0; x < num; x++)
+				dst[x] = a[x] < b[x] ? a[x] : b[x];
+		}
+	};
 
-		// the last few elements that does not fullfill the conv kernel
-		for (int x = tail_head_pos; x < num; x++)
+	// any associative operation works the same, sums give box filters without the round-off that
+	// builds up along integral images: each output adds two partial sums of at most W elements
+	template<typename T> struct MorphSum
+	{
+		void rows(T* dst, const T* a, const T* b, int num)const
 		{
-			const int xb = std::max(-L, -x);
-			const int xe = std::min(num - x - 1, R);
-			T v = 0;
-			for (int k = xb; k <= xe; k++)
-				v += src[k + x] * kernel[R - k];
-			*dst = v;
-			dst += dstStride;
+			for (int x = 0; x < num; x++)
+				dst[x] = a[x] + b[x];
 		}
-	}
+	};
 
 #ifdef CONV_HELPER_ENABLE_SSE
-	template<int N> void conv_sse(float* dst, const float* src, const float* kernel,
-		int num, int dstStride)
+	template<> struct MorphMax<float>
 	{
-		const static int L = N / 2 - (N % 2 == 0);
-		const static int R = N / 2;
-		const int head_pos = std::min((int)num, R);
-		const int tail_pos = num - R;
-		const int tail_head_pos = std::max(head_pos, tail_pos);
-
-		__m128 s, knl;
+		void rows(float* dst, const float* a, const float* b, int num)const
+		{
+			const float* r[2] = { a, b };
+			max_rows_simd(dst, r, 2, num);
+		}
+	};
 
-		// the first few elements that do not fullfill the conv kernel
-		for (int x = 0; x < head_pos; x++)
+	template<> struct MorphMin<float>
+	{
+		void rows(float* dst, const float* a, const float* b, int num)const
 		{
-			const int xb = std::max(-L, -x);
-			const int xe = std::min(num - x - 1, R);
-			__m128 v = _mm_setzero_ps();
-			for (int k = xb; k <= xe; k++)
-			{
-				s = _mm_loadu_ps(src + (k + x) * 4);
-				knl = _mm_set_ps1(kernel[R - k]);
-				v = _mm_add_ps(v, _mm_mul_ps(s, knl));
-			}
-			_mm_storeu_ps(dst, v);
-			dst += dstStride;
+			const float* r[2] = { a, b };
+			min_rows_simd(dst, r, 2, num);
 		}
+	};
+#endif
 
-		// middle elements that fullfill the conv kernel
-		for (int x = R; x < tail_pos; x++)
+	// elements of a row segment handled at once, also the number of rows filtered together along x
+	template<typename T> inline int morph_lanes()
+	{
+		return std::max(1, CONV_HELPER_MORPH_BYTES / (int)sizeof(T));
+	}
+
+	// temporary elements needed by morph_slice_rows()
+	template<typename T> inline size_t morph_buffer_size(int numRows, int width, int size)
+	{
+		return (2 * (size_t)std::min(size, numRows) + 1) * width;
+	}
+
+	// morphology along the row index of a 2D slice in place, row r is at data + r * rowStride
+	// the rows are streamed block by block, each is read once and written once; the elements of a
+	// row are processed together by op.rows(), which is where the vectorization happens.
+	// @size: window size, L = size / 2 - (size % 2 == 0) before and R = size / 2 after
+	// @buffer: morph_buffer_size(numRows, width, size)
+	template<typename T, class Op> void morph_slice_rows(T* data, size_t rowStride, int numRows,
+		int width, int size, T* buffer, const Op& op)
+	{
+		const int L = size / 2 - (size % 2 == 0);
+		const int R = size / 2;
+		const int W = size;
+		const int B = std::min(W, numRows);
+		T* g = buffer + 2 * B * width;
+
+		// h of the rows in blocks k and k - 1 are kept, that is all the windows may span
+		const int lastRow = numRows - 1;
+		auto hRow = [&](int a)->T*
 		{
-			__m128 v = _mm_setzero_ps();
-			for (int k = -L; k <= R; k++)
+			const int k = a / W;
+			return buffer + ((k & 1) * B + a - k * W) * width;
+		};
+		auto output = [&](int o)
+		{
+			const int a = o - L;
+			const int b = std::min(o + R, lastRow);
+			T* dst = data + o * rowStride;
+			if (a < 0)
+				memcpy(dst, g, width * sizeof(T));
+			else if (a / W == b / W)
+				memcpy(dst, hRow(a), width * sizeof(T));
+			else
+				op.rows(dst, hRow(a), g, width);
+		};
+
+		for (int s = 0; s < numRows; s += W)
+		{
+			const int e = std::min(s + W, numRows);
+
+			// h of the block, from the input rows before they are overwritten
+			// rows written so far are before s - R
+			T* h = hRow(s);
+			memcpy(h + (e - 1 - s) * width, data + (e - 1) * rowStride, width * sizeof(T));
+			for (int r = e - 2; r >= s; r--)
+				op.rows(h + (r - s) * width, data + r * rowStride, h + (r + 1 - s) * width, width);
+
+			// g and the outputs whose window ends at row r
+			for (int r = s; r < e; r++)
 			{
-				s = _mm_loadu_ps(src + (k + x) * 4);
-				knl = _mm_set_ps1(kernel[R - k]);
-				v = _mm_add_ps(v, _mm_mul_ps(s, knl));
-			}
-			_mm_storeu_ps(dst, v);
-			dst += dstStride;
-		}// end for x
+				if (r == s)
+					memcpy(g, data + r * rowStride, width * sizeof(T));
+				else
+					op.rows(g, g, data + r * rowStride, width);
+				if (r - R >= 0)
+					output(r - R);
+			}// end for r
+		}// end for s
+
+		// windows clipped at the end, g is that of the last row
+		for (int o = std::max(0, numRows - R); o < numRows; o++)
+			output(o);
+	}
 
-		// the last few elements that do not fullfill the conv kernel
-		for (int x = tail_head_pos; x < num; x++)
+	// 3D morphology by @op with a box of @size, in place; the box is separable, thus it is done
+	// along x-y-z in turn, skipping the directions of size 1, E.G., (n, 1, 1) for a horizontal line
+	// along x, rows are transposed in groups of morph_lanes() so that they are filtered together
+	// by the same streaming as along y and z.
+	// @pitch: see separable_filter3()
+	template<typename T, class Op> void morph_filter3(T* srcDst, ldp::Int3 res, ldp::Int3 size, const Op& op,
+		int pitch = 0)
+	{
+		const size_t y_stride = pitch > 0 ? pitch : res[0];
+		const size_t z_stride = y_stride * res[1];
+		const int lanes = morph_lanes<T>();
+		const int numThreads = ldp::ThreadPool::instance().maxThreads();
+
+		for (int k = 0; k < 3; k++)
+		if (size[k] < 1)
+			throw std::exception("illegal morphology window size");
+		if (res[0] <= 0 || res[1] <= 0 || res[2] <= 0)
+			return;
+
+		// along x, groups of rows transposed into lanes
+		if (size[0] > 1)
 		{
-			const int xb = std::max(-L, -x);
-			const int xe = std::min(num - x - 1, R);
-			__m128 v = _mm_setzero_ps();
-			for (int k = xb; k <= xe; k++)
+			const int numRows = res[1] * res[2];
+			const int nGroups = (numRows + lanes - 1) / lanes;
+			ldp::parallelFor(0, nGroups, 1, [&](int gb, int ge)
 			{
-				s = _mm_loadu_ps(src + (k + x) * 4);
-				knl = _mm_set_ps1(kernel[R - k]);
-				v = _mm_add_ps(v, _mm_mul_ps(s, knl));
-			}
-			_mm_storeu_ps(dst, v);
-			dst += dstStride;
-		}
+				ldp::ScratchArena& arena = ldp::ThreadPool::instance().scratch();
+				ldp::ScratchArena::Scope scope(arena);
+				T* trans = arena.allocate<T>((size_t)res[0] * lanes);
+				T* buffer = arena.allocate<T>(morph_buffer_size<T>(res[0], lanes, size[0]));
+				for (int grp = gb; grp < ge; grp++)
+				{
+					const int rb = grp * lanes;
+					const int n = std::min(lanes, numRows - rb);
+					T* src = srcDst + rb * y_stride;
+					transpose(trans, n, src, y_stride, n, res[0]);
+					morph_slice_rows<T>(trans, n, res[0], n, size[0], buffer, op);
+					transpose(src, y_stride, trans, n, res[0], n);
+				}// end for grp
+			});
+		}// end if size[0]
+
+		// along y for each z-slice, and along z for each y-slice, in tiles of columns
+		for (int dim = 1; dim < 3; dim++)
+		{
+			if (size[dim] <= 1 || res[dim] <= 1)
+				continue;
+			const int numSlices = dim == 1 ? res[2] : res[1];
+			const size_t sliceStride = dim == 1 ? z_stride : y_stride;
+			const size_t rowStride = dim == 1 ? y_stride : z_stride;
+			const int numRows = res[dim];
+			const int width = res[0];
+
+			// the buffer fits in CONV_HELPER_RING_BYTES, with enough tiles for the threads; large windows
+			// exceed it rather than going below 4 * lanes columns, where the strided rows cost more
+			int tileWidth = (int)(CONV_HELPER_RING_BYTES / (morph_buffer_size<T>(numRows, 1, size[dim]) * sizeof(T)));
+			tileWidth = std::min(tileWidth, (int)((long long)width * numSlices / (4 * numThreads)));
+			tileWidth = std::min(width, std::max(4 * lanes, tileWidth));
+			const int nTiles = (width + tileWidth - 1) / tileWidth;
+
+			ldp::parallelFor(0, numSlices * nTiles, 1, [&](int taskBegin, int taskEnd)
+			{
+				ldp::ScratchArena& arena = ldp::ThreadPool::instance().scratch();
+				ldp::ScratchArena::Scope scope(arena);
+				T* buffer = arena.allocate<T>(morph_buffer_size<T>(numRows, tileWidth, size[dim]));
+				for (int task = taskBegin; task < taskEnd; task++)
+				{
+					const int s = task / nTiles, c = task % nTiles;
+					const int cb = width * c / nTiles, ce = width * (c + 1) / nTiles;
+					morph_slice_rows<T>(srcDst + s * sliceStride + cb, rowStride, numRows,
+						ce - cb, size[dim], buffer, op);
+				}// end for task
+			});
+		}// end for dim
 	}
-#endif
+
+	// 3D dilation/erosion with a box of @size, the same as max_filter3/min_filter3 with
+	// N = size[k] along each direction k, but for any size
+	// @pitch: see separable_filter3()
+	template<typename T> void dilate3(T* srcDst, ldp::Int3 res, ldp::Int3 size, int pitch = 0)
+	{
+		morph_filter3<T>(srcDst, res, size, MorphMax<T>(), pitch);
+	}
+
+	template<typename T> void erode3(T* srcDst, ldp::Int3 res, ldp::Int3 size, int pitch = 0)
+	{
+		morph_filter3<T>(srcDst, res, size, MorphMin<T>(), pitch);
+	}
+
+	// opening removes the bright structures smaller than the box, closing fills the dark ones
+	template<typename T> void opening3(T* srcDst, ldp::Int3 res, ldp::Int3 size, int pitch = 0)
+	{
+		erode3<T>(srcDst, res, size, pitch);
+		dilate3<T>(srcDst, res, size, pitch);
+	}
+
+	template<typename T> void closing3(T* srcDst, ldp::Int3 res, ldp::Int3 size, int pitch = 0)
+	{
+		dilate3<T>(srcDst, res, size, pitch);
+		erode3<T>(srcDst, res, size, pitch);
+	}
+
+	template<typename T> void dilate2(T* srcDst, ldp::Int2 res, ldp::Int2 size, int pitch = 0)
+	{
+		dilate3<T>(srcDst, ldp::Int3(res[0], res[1], 1), ldp::Int3(size[0], size[1], 1), pitch);
+	}
+
+	template<typename T> void erode2(T* srcDst, ldp::Int2 res, ldp::Int2 size, int pitch = 0)
+	{
+		erode3<T>(srcDst, ldp::Int3(res[0], res[1], 1), ldp::Int3(size[0], size[1], 1), pitch);
+	}
+
+	template<typename T> void opening2(T* srcDst, ldp::Int2 res, ldp::Int2 size, int pitch = 0)
+	{
+		opening3<T>(srcDst, ldp::Int3(res[0], res[1], 1), ldp::Int3(size[0], size[1], 1), pitch);
+	}
+
+	template<typename T> void closing2(T* srcDst, ldp::Int2 res, ldp::Int2 size, int pitch = 0)
+	{
+		closing3<T>(srcDst, ldp::Int3(res[0], res[1], 1), ldp::Int3(size[0], size[1], 1), pitch);
+	}
+
 	// 3D seperate-kernel convolution with 'same' output
 	// this method is the SAME as calling matlab convn(...,'same') along x-y-z 3 dims.
 	// @data:
@@ -647,248 +894,143 @@ namespace conv_helper
 	//		1, conv y; 
 	//		2, conv z;
 	//		-1[default], conv all directions
-	template<typename T, int N, int numThreads = 4> void conv3(T* srcDst, 
-		const T* kernel, ldp::Int3 res, int dim = -1)
+	// @pitch: see separable_filter3()
+	// float data with N <= CONV_HELPER_MAX_SIMD_TAPS is convolved by the SIMD kernels of simdLevel()
+	template<typename T, int N> void conv3(T* srcDst, 
+		const T* kernel, ldp::Int3 res, int dim = -1, int pitch = 0)
 	{
-		T* dstPtr_000 = srcDst;
-		const int y_stride = res[0];;
-		const int z_stride = res[0]*res[1];
-
-		if (dim < -1 || dim > 2)
-			throw std::exception("illegal input parameter @dim");
+		separable_filter3<T, N>(srcDst, res, dim, ConvFilter<T, N>(kernel), pitch);
+	}
 
-		// allocate buffer for thread data
-		std::vector<T> tmpBuffers[numThreads];
-#ifdef CONV_HELPER_ENABLE_SSE
-		std::vector<__m128> tmpBuffers_sse[numThreads];
-#endif
-		for (int k = 0; k < numThreads; k++)
-		{
-			tmpBuffers[k].resize(std::max(res[0], std::max(res[1], res[2])));
-#ifdef CONV_HELPER_ENABLE_SSE
-			if (ldp::is_float<T>::value)
-				tmpBuffers_sse[k].resize(std::max(res[0], std::max(res[1], res[2])));
-#endif
-		}
+	template<typename T, int N> void conv2(T* srcDst,
+		const T* kernel, ldp::Int2 res, int dim = -1, int pitch = 0)
+	{
+		conv3<T, N>(srcDst, kernel, ldp::Int3(res[0], res[1], 1), dim, pitch);
+	}
 
-		if (dim == 0 || dim == -1)
+	// 3D box filter, dst = sum of src over a box of @size around each element, clipped at the borders
+	// O(1) per element for any size, by the same blocks as the morphology with op = sum; the sums
+	// are accumulated in S, E.G., boxFilter3<unsigned char, int>() for masks
+	// @dst: may be the same memory as @src when S == T
+	// @pitch: of both @dst and @src, see separable_filter3()
+	template<typename T, typename S> void boxFilter3(S* dst, const T* src, ldp::Int3 res, ldp::Int3 size,
+		int pitch = 0)
+	{
+		const size_t y_stride = pitch > 0 ? pitch : res[0];
+		if ((const void*)dst != (const void*)src)
 		{
-			// conv along x direction
-#pragma omp parallel for num_threads(numThreads) if(CONV_HELPER_ENABLE_OMP)
-			for (int z = 0; z < res[2]; z++)
+			ldp::parallelFor(0, res[1] * res[2], 0, [&](int rb, int re)
 			{
-				std::vector<T>& tmpBuffer = tmpBuffers[omp_get_thread_num()];
-				T* dstPtr_00z = dstPtr_000 + z * z_stride;
-
-				for (int y = 0; y < res[1]; y++)
+				for (int r = rb; r < re; r++)
 				{
-					T* dstPtr = dstPtr_00z + y * y_stride;
+					S* dst_r = dst + r * y_stride;
+					const T* src_r = src + r * y_stride;
 					for (int x = 0; x < res[0]; x++)
-						tmpBuffer[x] = dstPtr[x];
-					conv<T, N>(dstPtr, tmpBuffer.data(), kernel, res[0], 1);
-				}// end for y
-			}// end for z
-		}// end if dim == 0
-
-		if (dim == 1 || dim == -1)
-		{
-			// conv along y direction
-#pragma omp parallel for num_threads(numThreads) if(CONV_HELPER_ENABLE_OMP)
-			for (int z = 0; z < res[2]; z++)
-			{
-				std::vector<T>& tmpBuffer = tmpBuffers[omp_get_thread_num()];
-#ifdef CONV_HELPER_ENABLE_SSE
-				std::vector<__m128>& tmpBuffer_sse =
-					tmpBuffers_sse[omp_get_thread_num()];
-#endif
-				T* dstPtr_00z = dstPtr_000 + z * z_stride;
-
-				int x = 0;
-#ifdef CONV_HELPER_ENABLE_SSE
-				if (ldp::is_float<T>::value)
-				{
-					for (; x < res[0] - 3; x += 4)
-					{
-						T* dstPtr = dstPtr_00z + x;
-						for (int y = 0, y1 = 0; y < res[1]; y++, y1 += y_stride)
-							tmpBuffer_sse[y] = _mm_loadu_ps((float*)dstPtr + y1);
-						conv_sse<N>(dstPtr, (const float*)tmpBuffer_sse.data(), kernel, res[1], y_stride);
-					}
+						dst_r[x] = (S)src_r[x];
 				}
-#endif
-				for (; x < res[0]; x++)
-				{
-					T* dstPtr = dstPtr_00z + x;
-					for (int y = 0, y1 = 0; y < res[1]; y++, y1 += y_stride)
-						tmpBuffer[y] = dstPtr[y1];
-					conv<T, N>(dstPtr, tmpBuffer.data(), kernel, res[1], y_stride);
-				}// end for x
-			}// end for z
-		}// end if dim == 1
-
-
-		if ((dim == 2 || dim == -1) && res[2]>1)
-		{
-			// conv along z direction
-#pragma omp parallel for num_threads(numThreads) if(CONV_HELPER_ENABLE_OMP)
-			for (int y = 0; y < res[1]; y++)
-			{
-				std::vector<T>& tmpBuffer = tmpBuffers[omp_get_thread_num()];
-#ifdef CONV_HELPER_ENABLE_SSE
-				std::vector<__m128>& tmpBuffer_sse =
-					tmpBuffers_sse[omp_get_thread_num()];
-#endif
-				T* dstPtr_00y = dstPtr_000 + y * y_stride;
+			});
+		}
+		morph_filter3<S>(dst, res, size, MorphSum<S>(), pitch);
+	}
 
-				int x = 0;
-#ifdef CONV_HELPER_ENABLE_SSE
-				if (ldp::is_float<T>::value)
-				{
-					for (; x < res[0] - 3; x += 4)
-					{
-						T* dstPtr = dstPtr_00y + x;
-						for (int z = 0, z1 = 0; z < res[2]; z++, z1 += z_stride)
-							tmpBuffer_sse[z] = _mm_loadu_ps((float*)&dstPtr[z1]);
-						conv_sse<N>((float*)dstPtr, (const float*)tmpBuffer_sse.data(), kernel, res[2], z_stride);
-					}
-				}
-#endif
-				for (; x < res[0]; x++)
-				{
-					T* dstPtr = dstPtr_00y + x;
-					for (int z = 0, z1 = 0; z < res[2]; z++, z1 += z_stride)
-						tmpBuffer[z] = dstPtr[z1];
-					conv<T, N>(dstPtr, tmpBuffer.data(), kernel, res[2], z_stride);
-				}// end for x
-			}// end for y
-		}// end if dim == 2
+	template<typename T, typename S> void boxFilter2(S* dst, const T* src, ldp::Int2 res, ldp::Int2 size,
+		int pitch = 0)
+	{
+		boxFilter3<T, S>(dst, src, ldp::Int3(res[0], res[1], 1), ldp::Int3(size[0], size[1], 1), pitch);
 	}
 
-	template<typename T, int N, int numThreads = 4> void conv2(T* srcDst,
-		const T* kernel, ldp::Int2 res, int dim = -1)
+	// cubic box of @boxSize, the sums in T
+	template<typename T> void boxFilter(T* dst, const T*src, int boxSize, ldp::Int3 res)
 	{
-		conv3<T, N, numThreads>(srcDst, kernel, ldp::Int3(res[0], res[1], 1), dim);
+		boxFilter3<T, T>(dst, src, res, ldp::Int3(boxSize, boxSize, boxSize));
 	}
 
-	// 3D box filter
-	// it is done by integral images
-	// temporary memroy will be allocated inside
-	template<typename T, int numThreads = 4> void boxFilter(T* dst, const T*src, int boxSize, ldp::Int3 res)
+	// number of elements of the clipped windows along a direction of @num elements
+	inline void box_counts(int* counts, int num, int size)
 	{
-		if (dst == src)
-			throw std::exception("boxFilter(): src and dst cannot be the same memory!");
-		std::vector<T> intImg((1+res[0]) * (1+res[1]) * (1+res[2]), 0);
-		const static int L = boxSize / 2 - (boxSize % 2 == 0);
-		const static int R = boxSize / 2;
-		const int stride_z_intg = (res[0] + 1)*(res[1] + 1);
-		const int stride_z_srcDst = res[0] * res[1];
+		const int L = size / 2 - (size % 2 == 0);
+		const int R = size / 2;
+		for (int i = 0; i < num; i++)
+			counts[i] = std::min(num - 1, i + R) - std::max(0, i - L) + 1;
+	}
 
-		// integral along z
-#pragma omp parallel for num_threads(numThreads) if(CONV_HELPER_ENABLE_OMP)
-		for (int y = 0; y < res[1]; y++)
-		{
-			const T* src_y = src + y*res[0];
-			T* intg_y = intImg.data() + (y + 1)*(res[0] + 1);
-			for (int z = 0; z < res[2]; z++)
-			{
-				const T* src_z = src_y + z*stride_z_srcDst;
-				T* intg_z = intg_y + (z + 1)*stride_z_intg;
-				const T* intg_z_prev = intg_z - stride_z_intg;
-				for (int x = 0; x < res[0]; x++)
-					intg_z[x + 1] = intg_z_prev[x + 1] + src_z[x];
-			}// z
-		}// y
+	// local mean and variance over the clipped box of @size, E.G., for guided filtering
+	// the values are shifted by their global mean before being summed, thus the variance,
+	// E[x^2] - E[x]^2, does not lose the float precision on large values
+	// @mean, @var: may be the same memory as @src when T is float
+	// @pitch: of all the three, see separable_filter3()
+	template<typename T> void boxMeanVar3(float* mean, float* var, const T* src, ldp::Int3 res, ldp::Int3 size,
+		int pitch = 0)
+	{
+		const size_t y_stride = pitch > 0 ? pitch : res[0];
+		const int numRows = res[1] * res[2];
+		if (numRows <= 0 || res[0] <= 0)
+			return;
 
-		// diff along z
-#pragma omp parallel for num_threads(numThreads) if(CONV_HELPER_ENABLE_OMP)
-		for (int y = 0; y < res[1]; y++)
+		std::vector<double> rowSums(numRows, 0);
+		ldp::parallelFor(0, numRows, 0, [&](int rb, int re)
 		{
-			T* dst_y = dst + y*res[0];
-			const T* intg_y = intImg.data() + (y + 1)*(res[0] + 1);
-			for (int z = 0; z < res[2]; z++)
+			for (int r = rb; r < re; r++)
 			{
-				T* dst_z = dst_y + z*stride_z_srcDst;
-				const T* intg_z_after = intg_y + std::min(z + R + 1, res[2])*stride_z_intg;
-				const T* intg_z_prev = intg_y + std::max(z - L, 0)*stride_z_intg;
+				const T* src_r = src + r * y_stride;
+				double s = 0;
 				for (int x = 0; x < res[0]; x++)
-					dst_z[x] = intg_z_after[x + 1] - intg_z_prev[x + 1];
-			}// z
-		}// y
-
-		// integral along y
-#pragma omp parallel for num_threads(numThreads) if(CONV_HELPER_ENABLE_OMP)
-		for (int z = 0; z < res[2]; z++)
+					s += src_r[x];
+				rowSums[r] = s;
+			}
+		});
+		double total = 0;
+		for (int r = 0; r < numRows; r++)
+			total += rowSums[r];
+		const float offset = (float)(total / ((double)numRows * res[0]));
+
+		// var is written first, @mean may be @src
+		ldp::parallelFor(0, numRows, 0, [&](int rb, int re)
 		{
-			const T* dst_z = dst + z*stride_z_srcDst;
-			T* intg_z = intImg.data() + (z + 1)*stride_z_intg;
-			for (int y = 0; y < res[1]; y++)
+			for (int r = rb; r < re; r++)
 			{
-				const T* dst_y = dst_z + y*res[0];
-				T* intg_y = intg_z + (y+1)*(res[0]+1);
-				const T* intg_y_prev = intg_y - (res[0]+1);
+				const T* src_r = src + r * y_stride;
+				float* mean_r = mean + r * y_stride;
+				float* var_r = var + r * y_stride;
 				for (int x = 0; x < res[0]; x++)
-					intg_y[x+1] = intg_y_prev[x+1] + dst_y[x];
-			}// y
-		}// z
+				{
+					const float v = (float)src_r[x] - offset;
+					var_r[x] = v * v;
+					mean_r[x] = v;
+				}
+			}
+		});
+		morph_filter3<float>(mean, res, size, MorphSum<float>(), pitch);
+		morph_filter3<float>(var, res, size, MorphSum<float>(), pitch);
 
-		// diff along y
-#pragma omp parallel for num_threads(numThreads) if(CONV_HELPER_ENABLE_OMP)
-		for (int z = 0; z < res[2]; z++)
+		std::vector<int> counts[3];
+		for (int k = 0; k < 3; k++)
 		{
-			T* dst_z = dst + z*stride_z_srcDst;
-			const T* intg_z = intImg.data() + (z + 1)*stride_z_intg;
-			for (int y = 0; y < res[1]; y++)
-			{
-				T* dst_y = dst_z + y*res[0];
-				const T* intg_y_after = intg_z + std::min(y + R + 1, res[1])*(res[0] + 1);
-				const T* intg_y_prev = intg_z + std::max(y - L, 0)*(res[0] + 1);
-				for (int x = 0; x < res[0]; x++)
-					dst_y[x] = intg_y_after[x + 1] - intg_y_prev[x + 1];
-			}// y
-		}// z
-
-		// integral along x
-#pragma omp parallel for num_threads(numThreads) if(CONV_HELPER_ENABLE_OMP)
-		for (int z = 0; z < res[2]; z++)
+			counts[k].resize(res[k]);
+			box_counts(counts[k].data(), res[k], size[k]);
+		}
+		ldp::parallelFor(0, numRows, 0, [&](int rb, int re)
 		{
-			const T* dst_z = dst + z*stride_z_srcDst;
-			T* intg_z = intImg.data() + (z + 1)*stride_z_intg;
-			for (int y = 0; y < res[1]; y++)
+			for (int r = rb; r < re; r++)
 			{
-				const T* dst_y = dst_z + y*res[0];
-				T* intg_y = intg_z + (y + 1)*(res[0] + 1);
+				const int cyz = counts[1][r % res[1]] * counts[2][r / res[1]];
+				float* mean_r = mean + r * y_stride;
+				float* var_r = var + r * y_stride;
 				for (int x = 0; x < res[0]; x++)
-					intg_y[x+1] = intg_y[x] + dst_y[x];
-			}// y
-		}// z
-
-		// diff along x
-		const int pos[] = { std::min(L, res[0]), std::max(0, res[0] - R - 1) };
-#pragma omp parallel for num_threads(numThreads) if(CONV_HELPER_ENABLE_OMP)
-		for (int z = 0; z < res[2]; z++)
-		{
-			T* dst_z = dst + z*stride_z_srcDst;
-			const T* intg_z = intImg.data() + (z + 1)*stride_z_intg;
-			for (int y = 0; y < res[1]; y++)
-			{
-				T* dst_y = dst_z + y*res[0];
-				const T* intg_y = intg_z + (y + 1)*(res[0] + 1);
-				for (int x = 0; x < pos[0]; x++)
-				{
-					int prev = std::max(x - L, 0);
-					int after = std::min(x + R + 1, res[0]);
-					dst_y[x] = intg_y[after] - intg_y[prev];
-				}
-				for (int x = pos[0]; x < pos[1]; x++)
-					dst_y[x] = intg_y[x + R + 1] - intg_y[x - L];
-				for (int x = pos[1]; x < res[0]; x++)
 				{
-					int prev = std::max(x - L, 0);
-					int after = std::min(x + R + 1, res[0]);
-					dst_y[x] = intg_y[after] - intg_y[prev];
+					const float invCount = 1.f / (counts[0][x] * cyz);
+					const float m = mean_r[x] * invCount;
+					var_r[x] = std::max(0.f, var_r[x] * invCount - m * m);
+					mean_r[x] = m + offset;
 				}
-			}// y
-		}// z
+			}// end for r
+		});
+	}
+
+	template<typename T> void boxMeanVar2(float* mean, float* var, const T* src, ldp::Int2 res, ldp::Int2 size,
+		int pitch = 0)
+	{
+		boxMeanVar3<T>(mean, var, src, ldp::Int3(res[0], res[1], 1), ldp::Int3(size[0], size[1], 1), pitch);
 	}
 }
 #pragma pop_macro("max")
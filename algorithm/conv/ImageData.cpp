@@ -1,108 +1,285 @@
 #include "ImageData.h"
 #include <iostream>
 #include <fstream>
+#include <type_traits>
 namespace ldp
 {
+	//==========================================================================
+	/// storage conversions
+	template<class D, class S, class Convert> static void convert_image(ImageTemplate<D>& dst,
+		const ImageTemplate<S>& src, const Convert& convert)
+	{
+		dst.resize(src.getResolution());
+		ldp::parallelFor(0, src.height(), 0, [&](int yb, int ye)
+		{
+			for (int y = yb; y < ye; y++)
+				convert(dst.data_XY(0, y), src.data_XY(0, y), src.width());
+		});
+	}
+
+	void convertImage(FloatImage& dst, const HalfImage& src)
+	{
+		convert_image(dst, src, [](float* d, const half_float::half* s, int n)
+		{
+			conv_helper::decode_row_simd(d, s, n);
+		});
+	}
+
+	void convertImage(HalfImage& dst, const FloatImage& src)
+	{
+		convert_image(dst, src, [](half_float::half* d, const float* s, int n)
+		{
+			conv_helper::encode_row_simd(d, s, n);
+		});
+	}
+
+	void convertImage(FloatImage& dst, const MaskImage& src, float scale, float offset)
+	{
+		convert_image(dst, src, [&](float* d, const unsigned char* s, int n)
+		{
+			conv_helper::decode_row_simd(d, s, n, scale, offset);
+		});
+	}
+
+	void convertImage(MaskImage& dst, const FloatImage& src, float scale, float offset)
+	{
+		convert_image(dst, src, [&](unsigned char* d, const float* s, int n)
+		{
+			conv_helper::encode_row_simd(d, s, n, scale, offset);
+		});
+	}
+
+	void convertImage(FloatImage& dst, const UShortImage& src, float scale, float offset)
+	{
+		convert_image(dst, src, [&](float* d, const unsigned short* s, int n)
+		{
+			conv_helper::decode_row_simd(d, s, n, scale, offset);
+		});
+	}
+
+	void convertImage(UShortImage& dst, const FloatImage& src, float scale, float offset)
+	{
+		convert_image(dst, src, [&](unsigned short* d, const float* s, int n)
+		{
+			conv_helper::encode_row_simd(d, s, n, scale, offset);
+		});
+	}
+
 	//==========================================================================
 	/// bwdist: the same with matlab's
 	//		using the linear-time Euclidean distance transform method
 
 	////////// Functions F and Sep for the SDT labelling
-	inline int bwdist_sqr(int u)
+	// squared distances in 64 bits, they overflow int beyond 46340 pixels
+	typedef long long bwdist_int;
+	inline bwdist_int bwdist_sqr(int u)
 	{
-		return u*u;
+		return (bwdist_int)u*u;
 	}
-	inline int bwdist_F(int u, int i, int gi2)
+	inline bwdist_int bwdist_F(int u, int i, bwdist_int gi2)
 	{
-		return (u - i)*(u - i) + gi2;
+		return (bwdist_int)(u - i)*(u - i) + gi2;
 	}
-	inline int bwdist_Sep(int i, int u, int gi2, int gu2)
+	inline bwdist_int bwdist_Sep(int i, int u, bwdist_int gi2, bwdist_int gu2)
 	{
-		return (u*u - i*i + gu2 - gi2) / (2 * (u - i));
+		return ((bwdist_int)u*u - (bwdist_int)i*i + gu2 - gi2) / (2 * (u - i));
 	}
 	/////////
 
-	void bwdist(const MaskImage& mask, FloatImage& distMap)
-	{
-		typedef ImageTemplate<int> VolumeInt;
-		VolumeInt tmpXVolume, tmpXYVolume;
-		const ldp::Int2 resolution = mask.getResolution();
-		const int inf = resolution[0] + resolution[1];
+	// columns handled together in phase y: a cache line of the float and int rows transposed, and two of
+	// the bwdist_int squared distances
+	const static int g_bwdistColumnBlock = 16;
 
-		// phase x-----------------------------------------------------
-		tmpXVolume.resize(mask.getResolution());
+	// phase y on a contiguous column of @n elements
+	// @g: squared distances to the nearest feature of each row, along x
+	// @fx: x of that feature, -1 if none, only used with @idx
+	// @dist: euclidean distance
+	// @idx: y * width + x of the nearest feature, -1 if none; may be null
+	static void bwdist_column(const bwdist_int* g, const int* fx, int n, int width,
+		float* dist, int* idx, int* s, int* t)
+	{
+		int q = 0;
+		s[0] = 0;
+		t[0] = 0;
 
-#pragma omp parallel for
-		for (int y = 0; y < resolution[1]; y++)
+		//Forward Scan
+		for (int u = 1; u < n; u++)
 		{
-			if (mask(0, y) == 0)
-				tmpXVolume(0, y) = 0;
-			else
-				tmpXVolume(0, y) = inf;
+			while (q >= 0 && (bwdist_F(t[q], s[q], g[s[q]]) > bwdist_F(t[q], u, g[u])))
+				q--;
 
-			// Forward scan
-			for (int x = 1; x < resolution[0]; x++)
+			if (q < 0)
 			{
-				if (mask(x, y) == 0)
-					tmpXVolume(x, y) = 0;
-				else
-					tmpXVolume(x, y) = 1 + tmpXVolume(x - 1, y);
+				q = 0;
+				s[0] = u;
+			}
+			else
+			{
+				const bwdist_int w = 1 + bwdist_Sep(s[q], u, g[s[q]], g[u]);
+				if (w < n)
+				{
+					q++;
+					s[q] = u;
+					t[q] = (int)w;
+				}
 			}
+		}
 
-			//Backward scan
-			for (int x = resolution[0] - 2; x >= 0; x--)
-			if (tmpXVolume(x + 1, y) < tmpXVolume(x, y))
-				tmpXVolume(x, y) = 1 + tmpXVolume(x + 1, y);
-		}// end for y
+		//Backward Scan
+		for (int u = n - 1; u >= 0; --u)
+		{
+			dist[u] = sqrt((float)bwdist_F(u, s[q], g[s[q]]));
+			if (idx)
+				idx[u] = fx[s[q]] < 0 ? -1 : s[q] * width + fx[s[q]];
+			if (u == t[q])
+				q--;
+		}
+	}
 
-		// phase y-----------------------------------------------------
-		tmpXYVolume.resize(mask.getResolution());
+	// a block of distances as stored in the map, converted into @buffer for the half floats
+	static const float* bwdist_store(const float* dist, float*, int)
+	{
+		return dist;
+	}
+	static const half_float::half* bwdist_store(const float* dist, half_float::half* buffer, int num)
+	{
+		conv_helper::encode_row_simd(buffer, dist, num);
+		return buffer;
+	}
+
+	// the transform for the features of value @feature in @mask, I.E., 0 for matlab's bwdist(~mask)
+	// the distances are computed in floats, whatever their storage D
+	template<class D> static void bwdist_transform(const MaskImage& mask, bool feature,
+		ImageTemplate<D>& distMap, IntImage* nearestIdx)
+	{
+		const ldp::Int2 resolution = mask.getResolution();
+		const int width = resolution[0], height = resolution[1];
+		const int inf = width + height;
+		distMap.resize(mask.getResolution());
+		if (nearestIdx)
+			nearestIdx->resize(mask.getResolution());
+		if (width == 0 || height == 0)
+			return;
+
+		// phase x-----------------------------------------------------
+		// squared distance to the nearest feature in the row, and its x
+		ImageTemplate<bwdist_int> sqrXDist;
+		IntImage featureX;
+		sqrXDist.resize(mask.getResolution());
+		if (nearestIdx)
+			featureX.resize(mask.getResolution());
+		ldp::parallelFor(0, height, 0, [&](int yb, int ye)
 		{
-			std::vector<int> s(resolution[1]), t(resolution[1]);
-			for (int x = 0; x < resolution[0]; x++)
+			ldp::ScratchArena& arena = ldp::ThreadPool::instance().scratch();
+			ldp::ScratchArena::Scope scope(arena);
+			int* nearestX = arena.allocate<int>(width);
+			for (int y = yb; y < ye; y++)
 			{
-				int q = 0, w = 0;
-				s[0] = 0;
-				t[0] = 0;
+				const unsigned char* m = mask.data_XY(0, y);
+
+				// Forward scan
+				int last = -1;
+				for (int x = 0; x < width; x++)
+				{
+					if ((m[x] != 0) == feature)
+						last = x;
+					nearestX[x] = last;
+				}
 
-				//Forward Scan
-				for (int u = 1; u < resolution[1]; u++)
+				//Backward scan
+				int next = -1;
+				for (int x = width - 1; x >= 0; x--)
 				{
-					while (q >= 0 && (bwdist_F(t[q], s[q], bwdist_sqr(tmpXVolume(x, s[q]))) >
-						bwdist_F(t[q], u, bwdist_sqr(tmpXVolume(x, u)))))
-						q--;
-
-					if (q < 0)
-					{
-						q = 0;
-						s[0] = u;
-					}
-					else
-					{
-						w = 1 + bwdist_Sep(s[q], u, bwdist_sqr(tmpXVolume(x, s[q])),
-							bwdist_sqr(tmpXVolume(x, u)));
-						if (w < resolution[1])
-						{
-							q++;
-							s[q] = u;
-							t[q] = w;
-						}
-					}
+					if ((m[x] != 0) == feature)
+						next = x;
+					if (next >= 0 && (nearestX[x] < 0 || next - x < x - nearestX[x]))
+						nearestX[x] = next;
 				}
 
-				//Backward Scan
-				for (int u = resolution[1] - 1; u >= 0; --u)
+				bwdist_int* g = sqrXDist.data_XY(0, y);
+				for (int x = 0; x < width; x++)
+					g[x] = bwdist_sqr(nearestX[x] < 0 ? inf : x - nearestX[x]);
+				if (nearestIdx)
+					memcpy(featureX.data_XY(0, y), nearestX, width * sizeof(int));
+			}// end for y
+		});
+
+		// phase y-----------------------------------------------------
+		// blocks of columns are transposed to be contiguous, and back with the results
+		const int nBlocks = (width + g_bwdistColumnBlock - 1) / g_bwdistColumnBlock;
+		ldp::parallelFor(0, nBlocks, 1, [&](int bb, int be)
+		{
+			ldp::ScratchArena& arena = ldp::ThreadPool::instance().scratch();
+			ldp::ScratchArena::Scope scope(arena);
+			const int blockSize = g_bwdistColumnBlock * height;
+			int* s = arena.allocate<int>(height);
+			int* t = arena.allocate<int>(height);
+			bwdist_int* g = arena.allocate<bwdist_int>(blockSize);
+			float* dist = arena.allocate<float>(blockSize);
+			D* stored = std::is_same<D, float>::value ? 0 : arena.allocate<D>(blockSize);
+			int* fx = nearestIdx ? arena.allocate<int>(blockSize) : 0;
+			int* idx = nearestIdx ? arena.allocate<int>(blockSize) : 0;
+			for (int b = bb; b < be; b++)
+			{
+				const int xb = b * g_bwdistColumnBlock;
+				const int nx = std::min(g_bwdistColumnBlock, width - xb);
+				conv_helper::transpose(g, height, sqrXDist.data() + xb, sqrXDist.stride_Y(), height, nx);
+				if (nearestIdx)
+					conv_helper::transpose(fx, height, featureX.data() + xb, featureX.stride_Y(), height, nx);
+				for (int c = 0; c < nx; c++)
 				{
-					tmpXYVolume(x, u) = bwdist_F(u, s[q], bwdist_sqr(tmpXVolume(x, s[q])));
-					if (u == t[q])
-						q--;
+					bwdist_column(g + c * height, fx ? fx + c * height : 0, height, width,
+						dist + c * height, idx ? idx + c * height : 0, s, t);
 				}
-			}// end for x
-		}// end for z
+				conv_helper::transpose(distMap.data() + xb, distMap.stride_Y(),
+					bwdist_store(dist, stored, nx * height), height, nx, height);
+				if (nearestIdx)
+					conv_helper::transpose(nearestIdx->data() + xb, nearestIdx->stride_Y(), idx, height, nx, height);
+			}// end for b
+		});
+	}
 
-		distMap.resize(tmpXYVolume.getResolution());
-		for (int y = 0; y < resolution[1]; y++)
-		for (int x = 0; x < resolution[0]; x++)
-			distMap(x, y) = sqrt((float)tmpXYVolume(x, y));
+	void bwdist(const MaskImage& mask, FloatImage& distMap)
+	{
+		bwdist_transform(mask, false, distMap, 0);
+	}
+
+	void bwdist(const MaskImage& mask, FloatImage& distMap, IntImage& nearestIdx)
+	{
+		bwdist_transform(mask, false, distMap, &nearestIdx);
+	}
+
+	void bwdist(const MaskImage& mask, HalfImage& distMap)
+	{
+		bwdist_transform(mask, false, distMap, 0);
+	}
+
+	template<class D> static void bwdist_signed(const MaskImage& mask, ImageTemplate<D>& distMap)
+	{
+		ImageTemplate<D> outside;
+		bwdist_transform(mask, false, distMap, 0);
+		bwdist_transform(mask, true, outside, 0);
+		ldp::parallelFor(0, mask.height(), 0, [&](int yb, int ye)
+		{
+			for (int y = yb; y < ye; y++)
+			{
+				const unsigned char* m = mask.data_XY(0, y);
+				D* d = distMap.data_XY(0, y);
+				const D* o = outside.data_XY(0, y);
+				for (int x = 0; x < mask.width(); x++)
+				if (m[x] == 0)
+					d[x] = -o[x];
+			}
+		});
+	}
+
+	void bwdistSigned(const MaskImage& mask, FloatImage& distMap)
+	{
+		bwdist_signed(mask, distMap);
+	}
+
+	void bwdistSigned(const MaskImage& mask, HalfImage& distMap)
+	{
+		bwdist_signed(mask, distMap);
 	}
 }// namespace mpu
\ No newline at end of file
@@ -8,34 +8,125 @@
 #undef max
 namespace ldp
 {
+	// 2D image of POD pixels
+	// rows are stride_Y() elements apart and the first pixel is 64-byte aligned; resize() leaves the
+	// pixels uninitialized and keeps the memory when it is large enough.
+	// an image either owns its memory or is a view on memory of another image or of the caller,
+	// created by the view constructor or subImage(); a view must not outlive that memory.
+	// copies always own their memory, while assigning to a view of the same size writes through it.
 	template<typename T>
 	class ImageTemplate
 	{
 	public:
-		ImageTemplate(){}
+		enum{ Alignment = 64 };
+	public:
+		ImageTemplate() : m_storage(0), m_capacity(0), m_data(0), m_resolution(0, 0), m_pitch(0){}
+		// view on @data, @pitch elements from a row to the next, @width if <= 0
+		ImageTemplate(T* data, int width, int height, int pitch = 0) : m_storage(0), m_capacity(0),
+			m_data(data), m_resolution(width, height), m_pitch(pitch > 0 ? pitch : width){}
+		ImageTemplate(const ImageTemplate& rhs) : m_storage(0), m_capacity(0), m_data(0),
+			m_resolution(0, 0), m_pitch(0)
+		{
+			resize(rhs.m_resolution);
+			copyFrom(rhs);
+		}
+		ImageTemplate(ImageTemplate&& rhs) : m_storage(rhs.m_storage), m_capacity(rhs.m_capacity),
+			m_data(rhs.m_data), m_resolution(rhs.m_resolution), m_pitch(rhs.m_pitch)
+		{
+			rhs.m_storage = 0;
+			rhs.m_capacity = 0;
+			rhs.m_data = 0;
+			rhs.m_resolution = 0;
+			rhs.m_pitch = 0;
+		}
 		~ImageTemplate(){ clear(); }
 
+		ImageTemplate& operator = (const ImageTemplate& rhs)
+		{
+			if (this == &rhs)
+				return *this;
+			if (m_resolution == rhs.m_resolution)
+				copyFrom(rhs);
+			else
+			{
+				// @rhs may be a view on this
+				ImageTemplate tmp(rhs);
+				swap(tmp);
+			}
+			return *this;
+		}
+		// views are never adopted nor replaced, the pixels are copied instead as above
+		ImageTemplate& operator = (ImageTemplate&& rhs)
+		{
+			if (isView() || rhs.isView())
+				return *this = (const ImageTemplate&)rhs;
+			if (this != &rhs)
+			{
+				clear();
+				swap(rhs);
+			}
+			return *this;
+		}
+		void swap(ImageTemplate& rhs)
+		{
+			std::swap(m_storage, rhs.m_storage);
+			std::swap(m_capacity, rhs.m_capacity);
+			std::swap(m_data, rhs.m_data);
+			std::swap(m_resolution, rhs.m_resolution);
+			std::swap(m_pitch, rhs.m_pitch);
+		}
+
 		//=================================================================
 		void clear()
 		{
-			m_data.clear();
+			delete[] m_storage;
+			m_storage = 0;
+			m_capacity = 0;
+			m_data = 0;
 			m_resolution = 0;
+			m_pitch = 0;
 		}
-		void resize(unsigned short  x, unsigned short  y)
+		// the pixels are not initialized
+		// @pitch: elements from a row to the next, @x if <= 0, E.G., alignedPitch(x) for aligned rows
+		// nothing changes for the same size and pitch, or pitch <= 0, thus views can be resized to
+		// their own size; a view of another size becomes an owning image
+		void resize(int x, int y, int pitch = 0)
 		{
-			m_resolution = ldp::UShort2(x, y);
-			m_data.resize(x*y);
+			if (x < 0 || y < 0)
+				throw std::exception("negative image size!");
+			if (x == width() && y == height() && (pitch <= 0 || pitch == m_pitch))
+				return;
+			if (pitch < x)
+				pitch = x;
+			const size_t num = (size_t)pitch * y;
+			if (isView() || num > m_capacity)
+			{
+				clear();
+				m_storage = new char[num * sizeof(T) + Alignment - 1];
+				m_capacity = num;
+				m_data = (T*)(((size_t)m_storage + Alignment - 1) / Alignment * Alignment);
+			}
+			m_resolution = ldp::Int2(x, y);
+			m_pitch = pitch;
 		}
-		void resize(ldp::UShort2 p)
+		void resize(ldp::Int2 p, int pitch = 0)
 		{
-			resize(p[0], p[1]);
+			resize(p[0], p[1], pitch);
 		}
 		void fill(T v)
 		{
-			std::fill(m_data.begin(), m_data.end(), v);
+			for (int y = 0; y < height(); y++)
+				std::fill(data_XY(0, y), data_XY(0, y) + width(), v);
+		}
+
+		// the smallest pitch of at least @width elements with all rows aligned
+		static int alignedPitch(int width)
+		{
+			const int n = std::max(1, (int)(Alignment / sizeof(T)));
+			return (width + n - 1) / n * n;
 		}
 
-		ldp::UShort2 size()const
+		ldp::Int2 size()const
 		{
 			return m_resolution;
 		}
@@ -50,11 +141,17 @@ namespace ldp
 			return m_resolution[1];
 		}
 
+		// not owning its memory
+		bool isView()const{ return m_data != 0 && m_storage == 0; }
+
+		// no gap between the rows
+		bool isContiguous()const{ return m_pitch == width() || height() <= 1; }
+
 		//=================================================================
 		/// data access methods
-		ldp::UShort2 getResolution()const{ return m_resolution; }
+		ldp::Int2 getResolution()const{ return m_resolution; }
 		int stride_X()const{ return 1; }
-		int stride_Y()const{ return m_resolution[0]; }
+		int stride_Y()const{ return m_pitch; }
 
 		bool contains(ldp::Int2 idx)const
 		{
@@ -63,15 +160,15 @@ namespace ldp
 		}
 
 		// get the value from the data array
-		T& operator()(ldp::UShort2 p){ return (*this)(p[0], p[1]); }
-		const T& operator()(ldp::UShort2 p)const { return (*this)(p[0], p[1]); }
-		T& operator()(unsigned short  x, unsigned short  y)
+		T& operator()(ldp::Int2 p){ return (*this)(p[0], p[1]); }
+		const T& operator()(ldp::Int2 p)const { return (*this)(p[0], p[1]); }
+		T& operator()(int x, int y)
 		{
-			return m_data[y*m_resolution[0] + x];
+			return m_data[(size_t)y * m_pitch + x];
 		}
-		const T& operator()(unsigned short x, unsigned short  y)const
+		const T& operator()(int x, int y)const
 		{
-			return m_data[y*m_resolution[0] + x];
+			return m_data[(size_t)y * m_pitch + x];
 		}
 
 		T bilinear_at(ldp::Float2 p)const
@@ -80,7 +177,7 @@ namespace ldp
 			ldp::Float2 d = p - ldp::Float2(p0);
 			int inc[2] = { p0[0]<m_resolution[0] - 1, p0[1]<m_resolution[1] - 1 };
 
-			const int y_stride = stride_Y();
+			const size_t y_stride = stride_Y();
 
 			const T* data_y0 = data() + y_stride * p0[1];
 			const T* data_y1 = data_y0 + y_stride * inc[1];
@@ -97,18 +194,44 @@ namespace ldp
 			return c;
 		}
 
-		T *data(){ return m_data.data(); }
-		const T *data()const{ return m_data.data(); }
+		T *data(){ return m_data; }
+		const T *data()const{ return m_data; }
 
-		T *data_XY(ldp::UShort2 p){ return &(*this)(p); }
-		const T *data_XY(ldp::UShort2 p)const{ return &(*this)(p); }
-		T *data_XY(unsigned short x, unsigned short y){ return &(*this)(x, y); }
-		const T *data_XY(unsigned short x, unsigned short y)const{ return &(*this)(x, y); }
+		T *data_XY(ldp::Int2 p){ return &(*this)(p); }
+		const T *data_XY(ldp::Int2 p)const{ return &(*this)(p); }
+		T *data_XY(int x, int y){ return &(*this)(x, y); }
+		const T *data_XY(int x, int y)const{ return &(*this)(x, y); }
+
+		// view on the pixels in [begin, end), clipped to the image, no pixel is copied
+		ImageTemplate subImage(ldp::Int2 begin, ldp::Int2 end)
+		{
+			for (int k = 0; k < 2; k++)
+			{
+				begin[k] = std::max(begin[k], 0);
+				end[k] = std::min(end[k], (int)m_resolution[k]);
+				if (end[k] <= begin[k])
+					return ImageTemplate();
+			}
+			return ImageTemplate(data_XY(begin), end[0] - begin[0], end[1] - begin[1], m_pitch);
+		}
+		const ImageTemplate subImage(ldp::Int2 begin, ldp::Int2 end)const
+		{
+			return const_cast<ImageTemplate*>(this)->subImage(begin, end);
+		}
+
+		// copy the pixels of @rhs, of the same size, into this image or the memory viewed
+		void copyFrom(const ImageTemplate& rhs)
+		{
+			if (rhs.m_resolution != m_resolution)
+				throw std::exception("copyFrom: size mis-matched");
+			for (int y = 0; y < height(); y++)
+				memmove(data_XY(0, y), rhs.data_XY(0, y), width() * sizeof(T));
+		}
 
 		// fill in the patch with given data memory and given size/pos
 		// dst must be of size patchSize*patchSize*patchSize
 		template <int patchSize>
-		void getPatch(T* dst, const ldp::UShort2& patch_x0y0)const
+		void getPatch(T* dst, const ldp::Int2& patch_x0y0)const
 		{
 			const T* src = data_XY(patch_x0y0);
 			const int stride_y = stride_Y();
@@ -119,7 +242,7 @@ namespace ldp
 				src += stride_y;
 			}
 		}
-		void getPatch(T* dst, const ldp::UShort2& patch_x0y0, int patchSize)const
+		void getPatch(T* dst, const ldp::Int2& patch_x0y0, int patchSize)const
 		{
 			switch (patchSize)
 			{
@@ -161,7 +284,7 @@ namespace ldp
 				break;
 			}
 		}
-		void setPatch(const T* src, const ldp::UShort2& patch_x0y0, int patchSize)
+		void setPatch(const T* src, const ldp::Int2& patch_x0y0, int patchSize)
 		{
 			T* dst = data_XY(patch_x0y0);
 			const int stride_y = stride_Y();
@@ -173,7 +296,7 @@ namespace ldp
 				dst += stride_y;
 			}
 		}
-		void fillPatch(T v, const ldp::UShort2& patch_x0y0, int patchSize)
+		void fillPatch(T v, const ldp::Int2& patch_x0y0, int patchSize)
 		{
 			T* dst = data_XY(patch_x0y0);
 			const int stride_y = stride_Y();
@@ -186,93 +309,51 @@ namespace ldp
 		}
 
 		/// convolutions
+		// max/min over the (2 * radius + 1)^2 square around each pixel, clipped at the borders
 		void convolve_max(int radius)
 		{
-			switch (radius)
-			{
-			default:
-				throw std::exception("non-supported convolve-max radius!");
-				break;
-			case 0:
-				return;
-			case 1:
-				return conv_helper::max_filter2<T, 3>(data(), m_resolution);
-			case 2:
-				return conv_helper::max_filter2<T, 5>(data(), m_resolution);
-			case 3:
-				return conv_helper::max_filter2<T, 7>(data(), m_resolution);
-			case 4:
-				return conv_helper::max_filter2<T, 9>(data(), m_resolution);
-			case 5:
-				return conv_helper::max_filter2<T, 11>(data(), m_resolution);
-			case 6:
-				return conv_helper::max_filter2<T, 13>(data(), m_resolution);
-			case 7:
-				return conv_helper::max_filter2<T, 15>(data(), m_resolution);
-			case 8:
-				return conv_helper::max_filter2<T, 17>(data(), m_resolution);
-			case 9:
-				return conv_helper::max_filter2<T, 19>(data(), m_resolution);
-			case 10:
-				return conv_helper::max_filter2<T, 21>(data(), m_resolution);
-			case 11:
-				return conv_helper::max_filter2<T, 23>(data(), m_resolution);
-			case 12:
-				return conv_helper::max_filter2<T, 25>(data(), m_resolution);
-			case 13:
-				return conv_helper::max_filter2<T, 27>(data(), m_resolution);
-			case 14:
-				return conv_helper::max_filter2<T, 29>(data(), m_resolution);
-			case 15:
-				return conv_helper::max_filter2<T, 31>(data(), m_resolution);
-			case 16:
-				return conv_helper::max_filter2<T, 33>(data(), m_resolution);
-			case 17:
-				return conv_helper::max_filter2<T, 35>(data(), m_resolution);
-			case 18:
-				return conv_helper::max_filter2<T, 37>(data(), m_resolution);
-			case 19:
-				return conv_helper::max_filter2<T, 39>(data(), m_resolution);
-			case 20:
-				return conv_helper::max_filter2<T, 41>(data(), m_resolution);
-			case 21:
-				return conv_helper::max_filter2<T, 43>(data(), m_resolution);
-			case 22:
-				return conv_helper::max_filter2<T, 45>(data(), m_resolution);
-			case 23:
-				return conv_helper::max_filter2<T, 47>(data(), m_resolution);
-			case 24:
-				return conv_helper::max_filter2<T, 49>(data(), m_resolution);
-			}
+			dilate(ldp::Int2(radius, radius));
 		}
 		void convolve_min(int radius)
 		{
-			switch (radius)
-			{
-			default:
-				throw std::exception("non-supported convolve-max radius!");
-				break;
-			case 0:
-				return;
-			case 1:
-				return conv_helper::min_filter2<T, 3>(data(), m_resolution);
-			case 2:
-				return conv_helper::min_filter2<T, 5>(data(), m_resolution);
-			case 3:
-				return conv_helper::min_filter2<T, 7>(data(), m_resolution);
-			case 4:
-				return conv_helper::min_filter2<T, 9>(data(), m_resolution);
-			case 5:
-				return conv_helper::min_filter2<T, 11>(data(), m_resolution);
-			case 6:
-				return conv_helper::min_filter2<T, 13>(data(), m_resolution);
-			case 7:
-				return conv_helper::min_filter2<T, 15>(data(), m_resolution);
-			case 8:
-				return conv_helper::min_filter2<T, 17>(data(), m_resolution);
-			case 9:
-				return conv_helper::min_filter2<T, 19>(data(), m_resolution);
-			}
+			erode(ldp::Int2(radius, radius));
+		}
+
+		/// morphology with a (2 * radius[0] + 1) x (2 * radius[1] + 1) rectangle, clipped at the borders
+		// the cost per pixel does not depend on the radius; a radius of 0 skips that direction,
+		// E.G., (r, 0) is a horizontal line
+		void dilate(ldp::Int2 radius)
+		{
+			conv_helper::dilate2<T>(data(), m_resolution, windowSize(radius), stride_Y());
+		}
+		void erode(ldp::Int2 radius)
+		{
+			conv_helper::erode2<T>(data(), m_resolution, windowSize(radius), stride_Y());
+		}
+		void opening(ldp::Int2 radius)
+		{
+			conv_helper::opening2<T>(data(), m_resolution, windowSize(radius), stride_Y());
+		}
+		void closing(ldp::Int2 radius)
+		{
+			conv_helper::closing2<T>(data(), m_resolution, windowSize(radius), stride_Y());
+		}
+
+		/// box filters over a (2 * radius[0] + 1) x (2 * radius[1] + 1) rectangle, clipped at the borders
+		// the cost per pixel does not depend on the radius
+		// sums, accumulated in S; dst may be *this
+		template<typename S> void boxFilter(ImageTemplate<S>& dst, ldp::Int2 radius)const
+		{
+			dst.resize(m_resolution, stride_Y());
+			conv_helper::boxFilter2<T, S>(dst.data(), data(), m_resolution, windowSize(radius), stride_Y());
+		}
+		// local mean and variance, E.G., for guided filtering
+		void boxMeanVar(ImageTemplate<float>& mean, ImageTemplate<float>& var, ldp::Int2 radius)const
+		{
+			mean.resize(m_resolution, stride_Y());
+			var.resize(m_resolution, stride_Y());
+			conv_helper::boxMeanVar2<T>(mean.data(), var.data(), data(), m_resolution, windowSize(radius),
+				stride_Y());
 		}
 
 		// the same with matlab conv(...,'same')
@@ -284,31 +365,31 @@ namespace ldp
 				throw std::exception("non-supported convolve kernelsize!");
 				break;
 			case 1:
-				return conv_helper::conv2<T, 1>(data(), kernel, m_resolution);
+				return conv_helper::conv2<T, 1>(data(), kernel, m_resolution, -1, stride_Y());
 			case 2:										
-				return conv_helper::conv2<T, 2>(data(), kernel, m_resolution);
+				return conv_helper::conv2<T, 2>(data(), kernel, m_resolution, -1, stride_Y());
 			case 3:										
-				return conv_helper::conv2<T, 3>(data(), kernel, m_resolution);
+				return conv_helper::conv2<T, 3>(data(), kernel, m_resolution, -1, stride_Y());
 			case 4:										
-				return conv_helper::conv2<T, 4>(data(), kernel, m_resolution);
+				return conv_helper::conv2<T, 4>(data(), kernel, m_resolution, -1, stride_Y());
 			case 5:									
-				return conv_helper::conv2<T, 5>(data(), kernel, m_resolution);
+				return conv_helper::conv2<T, 5>(data(), kernel, m_resolution, -1, stride_Y());
 			case 6:										
-				return conv_helper::conv2<T, 6>(data(), kernel, m_resolution);
+				return conv_helper::conv2<T, 6>(data(), kernel, m_resolution, -1, stride_Y());
 			case 7:										
-				return conv_helper::conv2<T, 7>(data(), kernel, m_resolution);
+				return conv_helper::conv2<T, 7>(data(), kernel, m_resolution, -1, stride_Y());
 			case 8:										
-				return conv_helper::conv2<T, 8>(data(), kernel, m_resolution);
+				return conv_helper::conv2<T, 8>(data(), kernel, m_resolution, -1, stride_Y());
 			case 9:										
-				return conv_helper::conv2<T, 9>(data(), kernel, m_resolution);
+				return conv_helper::conv2<T, 9>(data(), kernel, m_resolution, -1, stride_Y());
 			case 10:
-				return conv_helper::conv2<T, 10>(data(), kernel, m_resolution);
+				return conv_helper::conv2<T, 10>(data(), kernel, m_resolution, -1, stride_Y());
 			case 11:
-				return conv_helper::conv2<T, 11>(data(), kernel, m_resolution);
+				return conv_helper::conv2<T, 11>(data(), kernel, m_resolution, -1, stride_Y());
 			case 12:
-				return conv_helper::conv2<T, 12>(data(), kernel, m_resolution);
+				return conv_helper::conv2<T, 12>(data(), kernel, m_resolution, -1, stride_Y());
 			case 13:
-				return conv_helper::conv2<T, 13>(data(), kernel, m_resolution);
+				return conv_helper::conv2<T, 13>(data(), kernel, m_resolution, -1, stride_Y());
 			}
 		}
 
@@ -321,8 +402,8 @@ namespace ldp
 				int src_y = abs(y - radius);
 				if (src_y >= m_resolution[1])
 					src_y = std::max(0, 2 * (int)m_resolution[1] - 2 - src_y);
-				const T* src_y_ptr = data() + stride_Y() * src_y;
-				T* dst_y_ptr = rhs.data() + rhs.stride_Y() * y;
+				const T* src_y_ptr = data_XY(0, src_y);
+				T* dst_y_ptr = rhs.data_XY(0, y);
 				for (int x = 0; x < rhs.m_resolution[0]; x++)
 				{
 					int src_x = abs(x - radius);
@@ -339,16 +420,16 @@ namespace ldp
 
 			for (int y = 0; y < rhs.m_resolution[1]; y++)
 			{
-				T* dst_y_ptr = rhs.data() + rhs.stride_Y() * y;
+				T* dst_y_ptr = rhs.data_XY(0, y);
 
 				int src_y = y - radius;
 				if (src_y >= m_resolution[1] || src_y < 0)
 				{
-					memset(dst_y_ptr, 0, sizeof(T) * m_resolution[0]);
+					memset(dst_y_ptr, 0, sizeof(T) * rhs.m_resolution[0]);
 					continue;
 				}
 
-				const T* src_y_ptr = data() + stride_Y() * src_y;
+				const T* src_y_ptr = data_XY(0, src_y);
 				for (int x = 0; x < rhs.m_resolution[0]; x++)
 				{
 					int src_x = x - radius;
@@ -360,83 +441,112 @@ namespace ldp
 			}// y
 		}
 
+		// copy of the pixels in [begin, end), clipped to the image
 		void subImageTo(ImageTemplate<T>& rhs, ldp::Int2 begin, ldp::Int2 end)const
 		{
-			for (int k = 0; k < 2; k++)
-			{
-				begin[k] = std::max(begin[k], 0);
-				end[k] = std::min(end[k], (int)m_resolution[k]);
-				if (end[k] <= begin[k])
-				{
-					rhs.clear();
-					return;
-				}
-			}
-			rhs.resize(ldp::Int2(end)-ldp::Int2(begin));
-
-			for (int y = 0; y < rhs.m_resolution[1]; y++)
-			{
-				const T* src_y_ptr = stride_Y() * (y + begin[1]) + data() + begin[0];
-				T* dst_y_ptr = rhs.stride_Y() * y + rhs.data();
-				for (int x = 0; x < rhs.m_resolution[0]; x++)
-					dst_y_ptr[x] = src_y_ptr[x];
-			}// y
+			rhs = subImage(begin, end);
 		}
 
-		void subImageFrom(ImageTemplate<T>& rhs, ldp::Int2 begin, ldp::Int2 end)
+		// copy @rhs into the pixels from @begin, clipped to [begin, end) and to the image
+		void subImageFrom(const ImageTemplate<T>& rhs, ldp::Int2 begin, ldp::Int2 end)
 		{
+			ldp::Int2 b, e;
 			for (int k = 0; k < 2; k++)
 			{
-				begin[k] = std::max(begin[k], 0);
-				end[k] = std::min(end[k], (int)m_resolution[k]);
-				if (end[k] <= begin[k])
+				b[k] = std::max(begin[k], 0);
+				e[k] = std::min(std::min(end[k], begin[k] + rhs.getResolution()[k]), m_resolution[k]);
+				if (e[k] <= b[k])
 					return;
 			}
-
-			for (int y = 0; y < rhs.m_resolution[1]; y++)
-			{
-				T* dst_y_ptr = stride_Y() * (y + begin[1]) + rhs.data() + begin[0];
-				const T* src_y_ptr = rhs.stride_Y() * y + data();
-				for (int x = 0; x < rhs.m_resolution[0]; x++)
-					dst_y_ptr[x] = src_y_ptr[x];
-			}// y
+			subImage(b, e).copyFrom(rhs.subImage(b - begin, e - begin));
 		}
 
 		ImageTemplate<T>& operator += (const ImageTemplate<T>& rhs)
 		{
 			assert(width() == rhs.width() && height() == rhs.height());
-			for (size_t i = 0; i < m_data.size(); i++)
-				m_data[i] += rhs.m_data[i];
+			for (int y = 0; y < height(); y++)
+			{
+				T* dst = data_XY(0, y);
+				const T* src = rhs.data_XY(0, y);
+				for (int x = 0; x < width(); x++)
+					dst[x] += src[x];
+			}
 			return *this;
 		}
 		ImageTemplate<T>& operator -= (const ImageTemplate<T>& rhs)
 		{
 			assert(width() == rhs.width() && height() == rhs.height());
-			for (size_t i = 0; i < m_data.size(); i++)
-				m_data[i] -= rhs.m_data[i];
+			for (int y = 0; y < height(); y++)
+			{
+				T* dst = data_XY(0, y);
+				const T* src = rhs.data_XY(0, y);
+				for (int x = 0; x < width(); x++)
+					dst[x] -= src[x];
+			}
 			return *this;
 		}
 		typename type_promote<T, T>::type sum()const
 		{
 			typename type_promote<T, T>::type s = 0;
-			for (size_t i = 0; i < m_data.size(); i++)
-				s += m_data[i];
+			for (int y = 0; y < height(); y++)
+			{
+				const T* src = data_XY(0, y);
+				for (int x = 0; x < width(); x++)
+					s += src[x];
+			}
 			return s;
 		}
 	protected:
-		ldp::UShort2 m_resolution;
-		std::vector<T> m_data;
+		static ldp::Int2 windowSize(ldp::Int2 radius)
+		{
+			if (radius[0] < 0 || radius[1] < 0)
+				throw std::exception("negative window radius!");
+			return radius * 2 + 1;
+		}
+	protected:
+		char* m_storage;			// owned memory, null for views
+		size_t m_capacity;			// elements in m_storage
+		T* m_data;					// the first pixel
+		ldp::Int2 m_resolution;
+		int m_pitch;				// elements from a row to the next
 	};
 
 	typedef ImageTemplate<unsigned char> MaskImage;
+	// pixels 0xAARRGGBB, as QImage::Format_RGB32
+	typedef ImageTemplate<unsigned int> Rgb32Image;
 	typedef ImageTemplate<int> IntImage;
 	typedef ImageTemplate<unsigned short> KinectDepthImage;
+	typedef ImageTemplate<unsigned short> UShortImage;
+	typedef ImageTemplate<half_float::half> HalfImage;
 	typedef ImageTemplate<float> FloatImage;
 	typedef ImageTemplate<double> DoubleImage;
 
+	/// storage conversions, see conv_helper::decode_row_simd() and encode_row_simd()
+	// half floats take half the memory of floats, with 11 significant bits up to 65504
+	// MaskImage/UShortImage keep the values in fixed point as q * @scale + @offset
+	void convertImage(FloatImage& dst, const HalfImage& src);
+	void convertImage(HalfImage& dst, const FloatImage& src);
+	void convertImage(FloatImage& dst, const MaskImage& src, float scale, float offset = 0.f);
+	void convertImage(MaskImage& dst, const FloatImage& src, float scale, float offset = 0.f);
+	void convertImage(FloatImage& dst, const UShortImage& src, float scale, float offset = 0.f);
+	void convertImage(UShortImage& dst, const FloatImage& src, float scale, float offset = 0.f);
+
 	/// bwdist: the same with matlab's
 	//		using the linear-time Euclidean distance transform method
+	//		distance of each pixel to the nearest zero pixel of @mask
 	void bwdist(const MaskImage& mask, FloatImage& distMap);
+
+	// also the nearest zero pixel, y * width + x, as matlab's [D, IDX] = bwdist(...); -1 if none
+	void bwdist(const MaskImage& mask, FloatImage& distMap, IntImage& nearestIdx);
+
+	// the distances stored in half floats, within a relative error of 2^-11, thus of half a pixel up
+	// to 1024 pixels away
+	void bwdist(const MaskImage& mask, HalfImage& distMap);
+
+	// signed distance: pixels in the mask (nonzero) get the distance to the nearest pixel out of it,
+	// and pixels out of the mask the negative distance to the nearest one in it
+	void bwdistSigned(const MaskImage& mask, FloatImage& distMap);
+	void bwdistSigned(const MaskImage& mask, HalfImage& distMap);
 }
 #pragma pop_macro("max")
 #pragma pop_macro("min")
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include "Overlay.h"
+#include <algorithm>
+namespace ldp
+{
+#undef min
+#undef max
+	LabelOverlay::LabelOverlay()
+	{
+		for (int i = 0; i < 256; i++)
+		{
+			m_colors[i] = 0;
+			m_alphas[i] = 0;
+			m_palette[i] = 0;
+		}
+		m_opacity = 1.f;
+		m_hovered = -1;
+		m_hoveredAlpha = 0;
+		m_allDirty = true;
+	}
+
+	LabelOverlay::~LabelOverlay()
+	{
+	}
+
+	void LabelOverlay::setImages(const Rgb32Image& image, const MaskImage& ids)
+	{
+		if (image.size() != ids.size())
+			throw std::exception("LabelOverlay: the image and the ids of different sizes");
+		m_image = image;
+		m_ids = ids;
+		m_frame.resize(image.size());
+		m_allDirty = true;
+
+		// the ids in each tile, a row of tiles per task
+		const int tilesX = (width() + TileSize - 1) / TileSize, tilesY = (height() + TileSize - 1) / TileSize;
+		m_tileLabels.assign((size_t)tilesX * tilesY * 4, 0);
+		ldp::parallelFor(0, tilesY, 1, [&](int tb, int te)
+		{
+			for (int ty = tb; ty < te; ty++)
+			for (int y = ty * TileSize; y < std::min(height(), (ty + 1) * TileSize); y++)
+			{
+				const unsigned char* row = m_ids.data_XY(0, y);
+				for (int x = 0; x < width(); x++)
+				{
+					unsigned long long* bits = &m_tileLabels[((size_t)ty * tilesX + x / TileSize) * 4];
+					bits[row[x] >> 6] |= 1ull << (row[x] & 63);
+				}
+			}
+		});
+	}
+
+	void LabelOverlay::clear()
+	{
+		m_image.clear();
+		m_ids.clear();
+		m_frame.clear();
+		m_tileLabels.clear();
+		m_allDirty = true;
+	}
+
+	void LabelOverlay::setColor(int label, unsigned int rgb)
+	{
+		if (label < 0 || label > 255)
+			throw std::exception("LabelOverlay: label out of range");
+		m_colors[label] = rgb & 0xffffff;
+	}
+
+	unsigned int LabelOverlay::getColor(int label)const
+	{
+		return label >= 0 && label < 256 ? m_colors[label] : 0;
+	}
+
+	void LabelOverlay::setAlpha(int label, int alpha)
+	{
+		if (label < 0 || label > 255)
+			throw std::exception("LabelOverlay: label out of range");
+		m_alphas[label] = (unsigned char)std::min(255, std::max(0, alpha));
+	}
+
+	int LabelOverlay::getAlpha(int label)const
+	{
+		return label >= 0 && label < 256 ? m_alphas[label] : 0;
+	}
+
+	void LabelOverlay::setOpacity(float opacity)
+	{
+		m_opacity = std::min(1.f, std::max(0.f, opacity));
+	}
+
+	void LabelOverlay::setHovered(int label, int alpha)
+	{
+		m_hovered = label < 0 || label > 255 ? -1 : label;
+		m_hoveredAlpha = std::min(255, std::max(0, alpha));
+	}
+
+	int LabelOverlay::labelAt(int x, int y)const
+	{
+		if (x < 0 || y < 0 || x >= m_ids.width() || y >= m_ids.height())
+			return -1;
+		return m_ids(x, y);
+	}
+
+	unsigned int LabelOverlay::paletteEntry(int label)const
+	{
+		const unsigned int a = label == m_hovered ? m_hoveredAlpha : (int)(m_alphas[label] * m_opacity + 0.5f);
+		if (a == 0)
+			return 0;
+		unsigned int entry = a << 24;
+		for (int k = 0; k < 24; k += 8)
+		{
+			// rounded as in conv_helper::blend_label_row_simd()
+			const unsigned int t = ((m_colors[label] >> k) & 0xff) * a + 128;
+			entry |= ((t + (t >> 8)) >> 8) << k;
+		}
+		return entry;
+	}
+
+	int LabelOverlay::update()
+	{
+		if (width() == 0 || height() == 0)
+			return 0;
+		unsigned int palette[256];
+		unsigned long long changed[4] = { 0, 0, 0, 0 };
+		for (int l = 0; l < 256; l++)
+		{
+			palette[l] = paletteEntry(l);
+			if (m_allDirty || palette[l] != m_palette[l])
+				changed[l >> 6] |= 1ull << (l & 63);
+		}
+
+		const int tilesX = (width() + TileSize - 1) / TileSize, numTiles = (int)m_tileLabels.size() / 4;
+		std::vector<int> dirty;
+		for (int t = 0; t < numTiles; t++)
+		{
+			const unsigned long long* bits = &m_tileLabels[(size_t)t * 4];
+			if ((bits[0] & changed[0]) | (bits[1] & changed[1]) | (bits[2] & changed[2]) | (bits[3] & changed[3]))
+				dirty.push_back(t);
+		}
+
+		ldp::parallelFor(0, (int)dirty.size(), 1, [&](int tb, int te)
+		{
+			for (int i = tb; i < te; i++)
+			{
+				const int x0 = dirty[i] % tilesX * TileSize, y0 = dirty[i] / tilesX * TileSize;
+				const int w = std::min(width() - x0, (int)TileSize);
+				for (int y = y0; y < std::min(height(), y0 + TileSize); y++)
+				{
+					conv_helper::blend_label_row_simd(m_frame.data_XY(x0, y), m_image.data_XY(x0, y),
+						m_ids.data_XY(x0, y), palette, w);
+				}
+			}
+		});
+
+		std::copy(palette, palette + 256, m_palette);
+		m_allDirty = false;
+		return (int)dirty.size();
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "ImageData.h"
+#include <vector>
+namespace ldp
+{
+	// compositing of a label mask over an RGB32 image through a palette of the 256 ids, E.G., in a viewer
+	// each id has a color and an alpha, scaled by the opacity, while the hovered id has an alpha of its
+	// own; the frame is blended by conv_helper::blend_label_row_simd() only in the tiles holding ids
+	// whose premultiplied entry changed since the last update(), thus changing the opacity or the
+	// hovered id costs the tiles covered by the ids concerned, not the whole image, and nothing when
+	// the ids are transparent. the dirty tiles are split among the threads.
+	class LabelOverlay
+	{
+	public:
+		enum{ TileSize = 128 };
+	public:
+		LabelOverlay();
+		~LabelOverlay();
+
+		// copies the image and the ids, both of the same size, thus every tile is dirty
+		void setImages(const Rgb32Image& image, const MaskImage& ids);
+		void clear();
+		int width()const { return m_frame.width(); }
+		int height()const { return m_frame.height(); }
+
+		// 0xRRGGBB of an id, the alpha bits ignored
+		void setColor(int label, unsigned int rgb);
+		unsigned int getColor(int label)const;
+		// in [0, 255], 0 by default, E.G., kept for the background
+		void setAlpha(int label, int alpha);
+		int getAlpha(int label)const;
+		// in [0, 1], scaling the alphas of all the ids but the hovered one
+		void setOpacity(float opacity);
+		float getOpacity()const { return m_opacity; }
+		// @label is drawn with @alpha instead, < 0 for none
+		void setHovered(int label, int alpha = 224);
+		int getHovered()const { return m_hovered; }
+
+		// the id at pixel (x, y), -1 outside
+		int labelAt(int x, int y)const;
+
+		// recomposites the dirty tiles, returning their number
+		int update();
+		// the composited image, the same size as the input, valid after update()
+		const Rgb32Image& frame()const { return m_frame; }
+	protected:
+		// the premultiplied entry of @label, see conv_helper::blend_label_row_simd()
+		unsigned int paletteEntry(int label)const;
+	private:
+		Rgb32Image m_image;
+		MaskImage m_ids;
+		Rgb32Image m_frame;
+		unsigned int m_colors[256];
+		unsigned char m_alphas[256];
+		float m_opacity;
+		int m_hovered;
+		int m_hoveredAlpha;
+		unsigned int m_palette[256];			// as composited in m_frame
+		std::vector<unsigned long long> m_tileLabels;	// 4 words per tile, bit l set when id l is in it
+		bool m_allDirty;
+	};
+}
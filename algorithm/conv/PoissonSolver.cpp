@@ -0,0 +1,357 @@
+#include "PoissonSolver.h"
+namespace ldp
+{
+#undef min
+#undef max
+	// the coarsest level has at most this many pixels per side, solved by the smoother alone
+	const static int g_coarsestSize = 4;
+	const static int g_coarsestSweeps = 64;
+
+	// a cycle reducing the residual by less than this has reached the precision of the floats
+	const static double g_stallRatio = 0.9;
+
+	// rows per task, small levels run as a single one
+	static int poisson_row_grain(int width)
+	{
+		return std::max(1, 16384 / std::max(1, width));
+	}
+
+	// sum over the rows of @body(y), added in order, thus the same on any number of threads
+	template<class Body> static double poisson_sum_rows(std::vector<double>& rowSums, int width, int height,
+		const Body& body)
+	{
+		ldp::parallelFor(0, height, poisson_row_grain(width), [&](int yb, int ye)
+		{
+			for (int y = yb; y < ye; y++)
+				rowSums[y] = body(y);
+		});
+		double sum = 0;
+		for (int y = 0; y < height; y++)
+			sum += rowSums[y];
+		return sum;
+	}
+
+	// cell @i in [-1, n + 1] of a grid of @n cells for the restriction, the transpose of the prolongation:
+	// the borders are mirrored, while odd sizes are first padded by a cell of zero residual, -1 here.
+	// a single cell is not coarsened but kept whole, E.G., the rows of a thin image once one pixel high
+	static int poisson_restrict_cell(int i, int n)
+	{
+		if (i < 0 || n == 1)
+			return 0;
+		if (i >= n)
+			return (n & 1) ? -1 : n - 1;
+		return i;
+	}
+
+	PoissonSolver::PoissonSolver() : m_cycleType(CycleV), m_preSweeps(2), m_postSweeps(2),
+		m_lastResidual(0.f), m_numLevels(0)
+	{
+	}
+
+	PoissonSolver::~PoissonSolver()
+	{
+	}
+
+	void PoissonSolver::setSmoothing(int preSweeps, int postSweeps)
+	{
+		if (preSweeps < 0 || postSweeps < 0 || preSweeps + postSweeps == 0)
+			throw std::exception("PoissonSolver: invalid smoothing sweeps");
+		m_preSweeps = preSweeps;
+		m_postSweeps = postSweeps;
+	}
+
+	int PoissonSolver::solve(FloatImage& f_dstU, float tolerance, int maxCycles)
+	{
+		m_lastResidual = 0.f;
+		const int width = f_dstU.width(), height = f_dstU.height();
+		if (width == 0 || height == 0)
+			return 0;
+
+		// levels
+		m_numLevels = 1;
+		for (ldp::Int2 res(width, height); std::max(res[0], res[1]) > g_coarsestSize; res = (res + 1) / 2)
+			m_numLevels++;
+		if ((int)m_levels.size() < m_numLevels)
+			m_levels.resize(m_numLevels);
+		ldp::Int2 res(width, height);
+		for (int l = 0; l < m_numLevels; l++)
+		{
+			Level& L = m_levels[l];
+			const int pitch = FloatImage::alignedPitch(res[0]);
+			if (l > 0)
+				L.u.resize(res, pitch);
+			L.f.resize(res, pitch);
+			L.r.resize(res, pitch);
+			res = (res + 1) / 2;
+		} // end for l
+		Level& L0 = m_levels[0];
+		FloatImage(f_dstU.data(), width, height, f_dstU.stride_Y()).swap(L0.u);
+		m_rowSums.resize(height);
+		m_zeros.assign(width, 0.f);
+
+		// run as a pool task, thus the small levels run right away on this worker
+		int cycles = 0;
+		ldp::parallelFor(0, 1, 1, [&](int, int)
+		{
+			// f of zero mean and u from 0
+			const double mean = poisson_sum_rows(m_rowSums, width, height, [&](int y)->double
+			{
+				const float* f = f_dstU.data_XY(0, y);
+				double s = 0;
+				for (int x = 0; x < width; x++)
+					s += f[x];
+				return s;
+			}) / ((double)width * height);
+			const double fNorm = sqrt(poisson_sum_rows(m_rowSums, width, height, [&](int y)->double
+			{
+				float* f = L0.f.data_XY(0, y);
+				float* u = L0.u.data_XY(0, y);
+				double s = 0;
+				for (int x = 0; x < width; x++)
+				{
+					f[x] = (float)(u[x] - mean);
+					u[x] = 0.f;
+					s += (double)f[x] * f[x];
+				}
+				return s;
+			}));
+			if (fNorm == 0)
+				return;
+
+			double lastResidual = 1.0;	// of u = 0
+			while (cycles < maxCycles)
+			{
+				cycle(0, m_cycleType);
+				cycles++;
+				const double r = sqrt(residual(0)) / fNorm;
+				m_lastResidual = (float)r;
+				if (r <= tolerance || r > g_stallRatio * lastResidual)
+					break;
+				lastResidual = r;
+			} // end while
+
+			// the solution of zero mean
+			const float uMean = (float)(poisson_sum_rows(m_rowSums, width, height, [&](int y)->double
+			{
+				const float* u = L0.u.data_XY(0, y);
+				double s = 0;
+				for (int x = 0; x < width; x++)
+					s += u[x];
+				return s;
+			}) / ((double)width * height));
+			ldp::parallelFor(0, height, poisson_row_grain(width), [&](int yb, int ye)
+			{
+				for (int y = yb; y < ye; y++)
+				{
+					float* u = L0.u.data_XY(0, y);
+					for (int x = 0; x < width; x++)
+						u[x] -= uMean;
+				}
+			});
+		});
+
+		// the view must not outlive the image
+		FloatImage().swap(L0.u);
+		return cycles;
+	}
+
+	void PoissonSolver::cycle(int level, CycleType type)
+	{
+		if (level + 1 == m_numLevels)
+		{
+			smooth(level, g_coarsestSweeps);
+			return;
+		}
+		smooth(level, m_preSweeps);
+		residual(level);
+		restrictResidual(level);
+		cycle(level + 1, type);
+		if (type == CycleW)
+			cycle(level + 1, CycleW);
+		else if (type == CycleF)
+			cycle(level + 1, CycleV);
+		prolongate(level);
+		smooth(level, m_postSweeps);
+	}
+
+	void PoissonSolver::smooth(int level, int sweeps)
+	{
+		Level& L = m_levels[level];
+		const int width = L.u.width(), height = L.u.height();
+		const auto relax = [&](int y, int color)
+		{
+			const float* up = y > 0 ? L.u.data_XY(0, y - 1) : m_zeros.data();
+			const float* down = y + 1 < height ? L.u.data_XY(0, y + 1) : m_zeros.data();
+			conv_helper::rb_relax_row_simd(L.u.data_XY(0, y), up, down, L.f.data_XY(0, y),
+				(y > 0) + (y + 1 < height), (y + color) & 1, width);
+		};
+
+		// both colors in one pass over blocks of rows: black row y - 1 follows red row y, its last
+		// dependency. the black rows at the block edges depend on the red ones of the neighboring
+		// blocks, which in turn read them, thus they wait for a second pass. the result is the same
+		// as the one of two separate passes, while the memory is traversed about once.
+		const int blockRows = 4 * poisson_row_grain(width);
+		const int numBlocks = (height + blockRows - 1) / blockRows;
+		for (int s = 0; s < sweeps; s++)
+		{
+			ldp::parallelFor(0, numBlocks, 1, [&](int bb, int be)
+			{
+				for (int b = bb; b < be; b++)
+				{
+					const int yb = b * blockRows, ye = std::min(height, yb + blockRows);
+					for (int y = yb; y < ye; y++)
+					{
+						relax(y, 0);
+						if (y - 1 > yb)
+							relax(y - 1, 1);
+					}
+				}
+			});
+			ldp::parallelFor(0, numBlocks, 1, [&](int bb, int be)
+			{
+				for (int b = bb; b < be; b++)
+				{
+					const int yb = b * blockRows, ye = std::min(height, yb + blockRows);
+					relax(yb, 1);
+					if (ye - 1 > yb)
+						relax(ye - 1, 1);
+				}
+			});
+		} // end for s
+	}
+
+	double PoissonSolver::residual(int level)
+	{
+		Level& L = m_levels[level];
+		const int width = L.u.width(), height = L.u.height();
+		return poisson_sum_rows(m_rowSums, width, height, [&](int y)->double
+		{
+			const float* u = L.u.data_XY(0, y);
+			const float* f = L.f.data_XY(0, y);
+			const float* up = y > 0 ? L.u.data_XY(0, y - 1) : m_zeros.data();
+			const float* down = y + 1 < height ? L.u.data_XY(0, y + 1) : m_zeros.data();
+			const int nv = (y > 0) + (y + 1 < height);
+			float* r = L.r.data_XY(0, y);
+
+			// borders
+			for (int x = 0; x < width; x += std::max(1, width - 1))
+			{
+				const float left = x > 0 ? u[x - 1] : 0.f, right = x + 1 < width ? u[x + 1] : 0.f;
+				const int n = nv + (x > 0) + (x + 1 < width);
+				r[x] = f[x] - (n * u[x] - left - right - up[x] - down[x]);
+			}
+			// the inside as a weighted sum of the shifted rows
+			if (width > 2)
+			{
+				const float* rows[6] = { f + 1, u, u + 2, up + 1, down + 1, u + 1 };
+				const float weights[6] = { 1.f, 1.f, 1.f, 1.f, 1.f, -(float)(nv + 2) };
+				conv_helper::conv_rows_simd(r + 1, rows, weights, 6, width - 2);
+			}
+
+			// independent partial sums, which vectorize
+			float s[8] = { 0.f };
+			int x = 0;
+			for (; x + 8 <= width; x += 8)
+			for (int k = 0; k < 8; k++)
+				s[k] += r[x + k] * r[x + k];
+			for (; x < width; x++)
+				s[0] += r[x] * r[x];
+			return ((double)s[0] + s[1] + s[2] + s[3]) + ((double)s[4] + s[5] + s[6] + s[7]);
+		});
+	}
+
+	void PoissonSolver::restrictResidual(int level)
+	{
+		const FloatImage& r = m_levels[level].r;
+		Level& C = m_levels[level + 1];
+		const int fineW = r.width(), fineH = r.height();
+		const int width = C.f.width(), height = C.f.height();
+
+		// weights (1, 3, 3, 1) / 8 on each axis, times 4 for the coarse laplacian of twice the spacing
+		const float weights[4] = { 1.f, 3.f, 3.f, 1.f };
+		const float* zeros = m_zeros.data();
+		const double sum = poisson_sum_rows(m_rowSums, width, height, [&](int y)->double
+		{
+			ldp::ScratchArena& arena = ldp::ThreadPool::instance().scratch();
+			ldp::ScratchArena::Scope scope(arena);
+			float* tmp = arena.allocate<float>(fineW + 1);
+			const float* rows[4];
+			for (int k = 0; k < 4; k++)
+			{
+				const int cy = poisson_restrict_cell(2 * y - 1 + k, fineH);
+				rows[k] = cy < 0 ? zeros : r.data_XY(0, cy);
+			}
+			conv_helper::conv_rows_simd(tmp, rows, weights, 4, fineW);
+			tmp[fineW] = 0.f;
+
+			float* f = C.f.data_XY(0, y);
+			double s = 0;
+			for (int x = 0; x < width; x++)
+			{
+				const int x0 = 2 * x;
+				float v;
+				if (x0 > 0 && x0 + 2 < fineW)
+					v = tmp[x0 - 1] + 3.f * (tmp[x0] + tmp[x0 + 1]) + tmp[x0 + 2];
+				else
+				{
+					// the padding cell is tmp[fineW]
+					const int x1 = poisson_restrict_cell(x0 + 1, fineW), x2 = poisson_restrict_cell(x0 + 2, fineW);
+					v = tmp[poisson_restrict_cell(x0 - 1, fineW)] + 3.f * (tmp[x0] + tmp[x1 < 0 ? fineW : x1])
+						+ tmp[x2 < 0 ? fineW : x2];
+				}
+				f[x] = v * (1.f / 16.f);
+				s += f[x];
+			}
+			return s;
+		});
+
+		// the sum is kept but for rounding, while the Neumann problem needs it to be exactly 0
+		const float mean = (float)(sum / ((double)width * height));
+		ldp::parallelFor(0, height, poisson_row_grain(width), [&](int yb, int ye)
+		{
+			for (int y = yb; y < ye; y++)
+			{
+				float* f = C.f.data_XY(0, y);
+				float* u = C.u.data_XY(0, y);
+				for (int x = 0; x < width; x++)
+				{
+					f[x] -= mean;
+					u[x] = 0.f;
+				}
+			}
+		});
+	}
+
+	void PoissonSolver::prolongate(int level)
+	{
+		Level& L = m_levels[level];
+		const FloatImage& coarse = m_levels[level + 1].u;
+		const int width = L.u.width(), height = L.u.height();
+		const int coarseW = coarse.width(), coarseH = coarse.height();
+
+		// bilinear between the cell centers: 3/4 of the nearest coarse cell, 1/4 of the next one
+		const float weights[2] = { 0.75f, 0.25f };
+		ldp::parallelFor(0, height, poisson_row_grain(width), [&](int yb, int ye)
+		{
+			ldp::ScratchArena& arena = ldp::ThreadPool::instance().scratch();
+			ldp::ScratchArena::Scope scope(arena);
+			float* tmp = arena.allocate<float>(coarseW);
+			for (int y = yb; y < ye; y++)
+			{
+				const int cy = y / 2;
+				const float* rows[2] = { coarse.data_XY(0, cy),
+					coarse.data_XY(0, std::max(0, std::min(coarseH - 1, (y & 1) ? cy + 1 : cy - 1))) };
+				conv_helper::conv_rows_simd(tmp, rows, weights, 2, coarseW);
+
+				float* u = L.u.data_XY(0, y);
+				for (int cx = 0; cx < coarseW; cx++)
+				{
+					const float left = tmp[std::max(0, cx - 1)], right = tmp[std::min(coarseW - 1, cx + 1)];
+					u[2 * cx] += 0.75f * tmp[cx] + 0.25f * left;
+					if (2 * cx + 1 < width)
+						u[2 * cx + 1] += 0.75f * tmp[cx] + 0.25f * right;
+				}
+			}
+		});
+	}
+}
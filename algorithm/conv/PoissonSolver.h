@@ -0,0 +1,73 @@
+#pragma once
+#include "ImageData.h"
+#include <vector>
+namespace ldp
+{
+	// geometric multigrid solver of the poisson equation -laplacian(u) = f with Neumann boundaries,
+	// discretized on the pixels as sum over the neighbors q inside the image of u(p) - u(q) = f(p).
+	// the grids are cell-centered, each level halving the previous one; the smoother is red-black
+	// gauss-seidel, the grid transfers are full-weighting restriction and bilinear prolongation.
+	// the levels are kept, thus solving again on images up to the same size allocates nothing.
+	class PoissonSolver
+	{
+	public:
+		enum CycleType
+		{
+			CycleV,
+			CycleW,
+			CycleF,
+		};
+	public:
+		PoissonSolver();
+		~PoissonSolver();
+
+		void setCycleType(CycleType type) { m_cycleType = type; }
+		CycleType cycleType()const { return m_cycleType; }
+
+		// gauss-seidel sweeps before and after the coarse-grid correction, on each level
+		void setSmoothing(int preSweeps, int postSweeps);
+
+		// solve in place, f as input and u as output
+		// the Neumann problem only has solutions for f of zero sum, thus its mean is removed first;
+		// among the solutions, differing by a constant, the one of zero mean is returned.
+		// @tolerance: on the norm of the residual, relative to the one of f. u being floats, the residual
+		//	stalls about where its rounding dominates, E.G., 2e-5 for noise of 1024x1024 and 4e-5 of
+		//	2048x2048, more on long thin images whose solutions grow large, thus the cycles also stop
+		//	once one reduces it by less than 0.9x; see lastResidual() for the one reached
+		// returns the number of cycles run
+		int solve(FloatImage& f_dstU, float tolerance = 1e-4f, int maxCycles = 20);
+
+		// relative residual of the last solve()
+		float lastResidual()const { return m_lastResidual; }
+	protected:
+		struct Level
+		{
+			FloatImage u;	// of level 0, a view of the image being solved
+			FloatImage f;
+			FloatImage r;	// residual
+		};
+		void cycle(int level, CycleType type);
+		void smooth(int level, int sweeps);
+
+		// r = f - A u on @level, returns its squared norm
+		double residual(int level);
+
+		// f of @level + 1 from the residual of @level, of zero mean; u of @level + 1 set to 0
+		void restrictResidual(int level);
+
+		// u of @level += the prolongated u of @level + 1
+		void prolongate(int level);
+	private:
+		PoissonSolver(const PoissonSolver&);
+		PoissonSolver& operator=(const PoissonSolver&);
+	protected:
+		CycleType m_cycleType;
+		int m_preSweeps;
+		int m_postSweeps;
+		float m_lastResidual;
+		int m_numLevels;
+		std::vector<Level> m_levels;
+		std::vector<double> m_rowSums;	// per-row partial sums, added in order for the same result on any threads
+		std::vector<float> m_zeros;		// the absent rows above and below the borders
+	};
+}
@@ -0,0 +1,193 @@
+#include "Rasterize.h"
+#include <algorithm>
+namespace ldp
+{
+#undef min
+#undef max
+	// sub-scanlines per row of the anti-aliased coverage
+	const static int g_rasterSubScanlines = 16;
+
+	// from vertex a to b, crossing the lines y = ty for ty in [ymin, ymax)
+	struct RasterEdge
+	{
+		float xa, ya, xb, yb;
+		float ymin, ymax;
+		int winding;
+	};
+
+	// the edges crossing the line y = @ty, in @active with their crossings @xs sorted by x; the lines of
+	// a sweep are of increasing ty, thus the edges are nearly sorted from the previous one
+	//	@next: the first edge of @edges, sorted by ymin, not yet active
+	static void raster_advance(const std::vector<RasterEdge>& edges, int& next, int* active, float* xs,
+		int& numActive, float ty)
+	{
+		int n = 0;
+		for (int i = 0; i < numActive; i++)
+		if (edges[active[i]].ymax > ty)
+			active[n++] = active[i];
+		for (; next < (int)edges.size() && edges[next].ymin <= ty; next++)
+		if (edges[next].ymax > ty)
+			active[n++] = next;
+		numActive = n;
+
+		// insertion sorted; the crossings are computed as by PointInPolygon(), for the same result
+		for (int i = 0; i < n; i++)
+		{
+			const int e = active[i];
+			const RasterEdge& E = edges[e];
+			const float x = (E.xb - E.xa) * (ty - E.ya) / (E.yb - E.ya) + E.xa;
+			int j = i;
+			for (; j > 0 && xs[j - 1] > x; j--)
+			{
+				xs[j] = xs[j - 1];
+				active[j] = active[j - 1];
+			}
+			xs[j] = x;
+			active[j] = e;
+		}
+	}
+
+	// span(xa, xb) for the intervals inside along the line of the sorted crossings
+	template<class Span> static void raster_spans(const std::vector<RasterEdge>& edges, const int* active,
+		const float* xs, int num, FillRule rule, const Span& span)
+	{
+		int w = 0;
+		float start = 0;
+		for (int i = 0; i < num; i++)
+		{
+			const int prev = w;
+			w = rule == FillEvenOdd ? (w ^ 1) : w + edges[active[i]].winding;
+			if (prev == 0 && w != 0)
+				start = xs[i];
+			else if (prev != 0 && w == 0)
+				span(start, xs[i]);
+		}
+	}
+
+	// the first pixel x in [0, width] of center x + 0.5 >= @v
+	static int raster_first_pixel(float v, int width)
+	{
+		v = std::min(std::max(v, -1.f), width + 1.f);
+		int x = std::min(width, std::max(0, (int)ceil(v - 0.5f)));
+		while (x < width && x + 0.5f < v)
+			x++;
+		while (x > 0 && x - 0.5f >= v)
+			x--;
+		return x;
+	}
+
+	// adds the span [xa, xb) of weight @w: fractions of the end pixels in @cover, while the pixels
+	// fully covered are accumulated from @delta
+	static void raster_cover(float* cover, float* delta, int width, float xa, float xb, float w)
+	{
+		xa = std::max(xa, 0.f);
+		xb = std::min(xb, (float)width);
+		if (!(xb > xa))
+			return;
+		const int ia = (int)xa, ib = (int)xb;
+		if (ia == ib)
+		{
+			cover[ia] += (xb - xa) * w;
+			return;
+		}
+		cover[ia] += (ia + 1 - xa) * w;
+		delta[ia + 1] += w;
+		delta[ib] -= w;
+		if (ib < width)
+			cover[ib] += (xb - ib) * w;
+	}
+
+	void rasterizePolygons(MaskImage& mask, const ldp::Float2* verts, const int* contourSizes, int numContours,
+		FillRule rule, bool antialias, unsigned char value)
+	{
+		const int width = mask.width(), height = mask.height();
+		if (width == 0 || height == 0)
+			return;
+
+		// the edges, as in PointInPolygon() from vertex i to its previous one; horizontal ones never cross
+		std::vector<RasterEdge> edges;
+		for (int c = 0, first = 0; c < numContours; first += contourSizes[c++])
+		{
+			const int n = contourSizes[c];
+			if (n < 0)
+				throw std::exception("rasterizePolygons: negative contour size");
+			const ldp::Float2* v = verts + first;
+			for (int i = 0, j = n - 1; i < n; j = i++)
+			{
+				if (v[i][1] == v[j][1])
+					continue;
+				RasterEdge e;
+				e.xa = v[i][0];
+				e.ya = v[i][1];
+				e.xb = v[j][0];
+				e.yb = v[j][1];
+				e.ymin = std::min(e.ya, e.yb);
+				e.ymax = std::max(e.ya, e.yb);
+				e.winding = e.ya > e.yb ? 1 : -1;
+				edges.push_back(e);
+			}
+		} // end for c
+		std::sort(edges.begin(), edges.end(), [](const RasterEdge& a, const RasterEdge& b)->bool
+		{
+			return a.ymin < b.ymin;
+		});
+
+		// rows per task as poisson_row_grain(), each task sweeping its own lines
+		const int numEdges = (int)edges.size();
+		ldp::parallelFor(0, height, std::max(1, 16384 / width), [&](int yb, int ye)
+		{
+			ScratchArena& arena = ThreadPool::instance().scratch();
+			ScratchArena::Scope scope(arena);
+			int* active = arena.allocate<int>(std::max(1, numEdges));
+			float* xs = arena.allocate<float>(std::max(1, numEdges));
+			int next = 0, numActive = 0;
+
+			if (!antialias)
+			{
+				for (int y = yb; y < ye; y++)
+				{
+					unsigned char* row = mask.data_XY(0, y);
+					memset(row, 0, width);
+					raster_advance(edges, next, active, xs, numActive, y + 0.5f);
+					raster_spans(edges, active, xs, numActive, rule, [&](float xa, float xb)
+					{
+						const int b = raster_first_pixel(xa, width), e = raster_first_pixel(xb, width);
+						if (e > b)
+							memset(row + b, value, e - b);
+					});
+				} // end for y
+				return;
+			}
+
+			float* cover = arena.allocate<float>(width);
+			float* delta = arena.allocate<float>(width + 1);
+			const float w = 1.f / g_rasterSubScanlines;
+			for (int y = yb; y < ye; y++)
+			{
+				std::fill(cover, cover + width, 0.f);
+				std::fill(delta, delta + width + 1, 0.f);
+				for (int s = 0; s < g_rasterSubScanlines; s++)
+				{
+					raster_advance(edges, next, active, xs, numActive, y + (s + 0.5f) * w);
+					raster_spans(edges, active, xs, numActive, rule, [&](float xa, float xb)
+					{
+						raster_cover(cover, delta, width, xa, xb, w);
+					});
+				} // end for s
+				unsigned char* row = mask.data_XY(0, y);
+				float full = 0;
+				for (int x = 0; x < width; x++)
+				{
+					full += delta[x];
+					row[x] = (unsigned char)(std::min(1.f, std::max(0.f, cover[x] + full)) * value + 0.5f);
+				}
+			} // end for y
+		});
+	}
+
+	void rasterizePolygon(MaskImage& mask, const ldp::Float2* verts, int numVerts, FillRule rule,
+		bool antialias, unsigned char value)
+	{
+		rasterizePolygons(mask, verts, &numVerts, 1, rule, antialias, value);
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "ImageData.h"
+namespace ldp
+{
+	enum FillRule
+	{
+		FillEvenOdd,	// inside where crossing an odd number of edges, as PointInPolygon() of util.h
+		FillNonZero,	// inside where the edges wind a nonzero number of times around
+	};
+
+	// scanline rasterization of polygons into a mask, E.G., from annotations
+	// each contour is closed implicitly, holes and self-intersections following @rule; positions are in
+	// pixels, pixel (x, y) covering [x, x + 1) x [y, y + 1).
+	// the edges crossing each scanline are kept in an active edge table sorted by x, thus a row costs
+	// O(edges crossing it) plus its width, and rows are split among the threads.
+	// all the pixels of @mask, which keeps its size, are written:
+	//	aliased: @value where the pixel center is inside, the same with PointInPolygon() for FillEvenOdd,
+	//		0 elsewhere
+	//	@antialias: the covered fraction of each pixel times @value, rounded; exact along x and sampled
+	//		by 16 sub-scanlines along y
+	// @contourSizes: the number of vertices of each contour, stored one after another in @verts
+	void rasterizePolygons(MaskImage& mask, const ldp::Float2* verts, const int* contourSizes, int numContours,
+		FillRule rule = FillEvenOdd, bool antialias = false, unsigned char value = 255);
+	void rasterizePolygon(MaskImage& mask, const ldp::Float2* verts, int numVerts,
+		FillRule rule = FillEvenOdd, bool antialias = false, unsigned char value = 255);
+}
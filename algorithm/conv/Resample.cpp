@@ -0,0 +1,334 @@
+#include "Resample.h"
+#include <type_traits>
+namespace ldp
+{
+#undef min
+#undef max
+	// filter of the output pixel at @x input pixels away, in the unit of the filter
+	static double resample_kernel(ResampleFilter filter, double x)
+	{
+		x = fabs(x);
+		if (filter == ResampleBilinear)
+			return x < 1 ? 1 - x : 0;
+		if (x < 1)
+			return (1.5 * x - 2.5) * x * x + 1;
+		if (x < 2)
+			return ((-0.5 * x + 2.5) * x - 4) * x + 2;
+		return 0;
+	}
+
+	// rows of the images as floats: float rows are used in place, while the others are converted
+	// through @buf; the output rows are written when complete
+	static const float* resample_load_row(float*, const float* src, int)
+	{
+		return src;
+	}
+	static const float* resample_load_row(float* buf, const unsigned char* src, int num)
+	{
+		conv_helper::decode_row_simd(buf, src, num, 1.f, 0.f);
+		return buf;
+	}
+	static float* resample_out_row(float*, float* dst)
+	{
+		return dst;
+	}
+	static float* resample_out_row(float* buf, unsigned char*)
+	{
+		return buf;
+	}
+	static void resample_store_row(float*, const float*, int)
+	{
+	}
+	static void resample_store_row(unsigned char* dst, const float* row, int num)
+	{
+		conv_helper::encode_row_simd(dst, row, num, 1.f, 0.f);
+	}
+
+	Resampler::Resampler() : m_channels(0)
+	{
+		m_axisX.srcSize = m_axisX.dstSize = m_axisX.taps = 0;
+		m_axisY.srcSize = m_axisY.dstSize = m_axisY.taps = 0;
+		m_axisX.filter = m_axisY.filter = ResampleBilinear;
+	}
+
+	Resampler::~Resampler()
+	{
+	}
+
+	void Resampler::buildAxis(Axis& axis, int srcSize, int dstSize, ResampleFilter filter)
+	{
+		axis.srcSize = srcSize;
+		axis.dstSize = dstSize;
+		axis.filter = filter;
+
+		// the input pixel k covers [k, k + 1), the output pixel i [i * scale, (i + 1) * scale)
+		const double scale = (double)srcSize / dstSize;
+		const double stretch = std::max(1.0, scale);
+		const double radius = (filter == ResampleBicubic ? 2 : 1) * stretch;
+		const int span = filter == ResampleArea ? (int)ceil(scale) + 2 : (int)ceil(2 * radius) + 2;
+		const int maxTaps = std::min(srcSize, span);
+
+		// the weights of each output pixel from its first input pixel, clamped to the image
+		std::vector<double> weights((size_t)dstSize * maxTaps, 0.0);
+		std::vector<int> first(dstSize);
+		axis.taps = 1;
+		for (int i = 0; i < dstSize; i++)
+		{
+			const double lo = i * scale, hi = (i + 1) * scale, center = (i + 0.5) * scale;
+			int kb = 0, ke = 0;
+			if (filter == ResampleArea)
+			{
+				kb = (int)floor(lo);
+				ke = (int)ceil(hi) - 1;
+			}
+			else
+			{
+				kb = (int)floor(center - radius);
+				ke = (int)ceil(center + radius);
+			}
+			auto weight = [&](int k)->double
+			{
+				if (filter == ResampleArea)
+					return std::min(hi, k + 1.0) - std::max(lo, (double)k);
+				return resample_kernel(filter, (k + 0.5 - center) / stretch);
+			};
+			auto clamp = [&](int k)->int
+			{
+				return std::min(srcSize - 1, std::max(0, k));
+			};
+
+			int b = srcSize, e = -1;
+			for (int k = kb; k <= ke; k++)
+			if (weight(k) != 0)
+			{
+				b = std::min(b, clamp(k));
+				e = std::max(e, clamp(k));
+			}
+			double* w = weights.data() + (size_t)i * maxTaps;
+			double sum = 0;
+			for (int k = kb; k <= ke; k++)
+			{
+				const double v = weight(k);
+				if (v == 0)
+					continue;
+				w[clamp(k) - b] += v;
+				sum += v;
+			}
+			for (int t = 0; t <= e - b; t++)
+				w[t] /= sum;
+			first[i] = b;
+			axis.taps = std::max(axis.taps, e - b + 1);
+		} // end for i
+
+		// the same number of taps for all, shifted inside the image
+		const int taps = axis.taps;
+		axis.begin.resize(dstSize);
+		axis.weights.assign((size_t)dstSize * taps, 0.f);
+		for (int i = 0; i < dstSize; i++)
+		{
+			axis.begin[i] = std::min(first[i], srcSize - taps);
+			const int shift = first[i] - axis.begin[i];
+			const double* w = weights.data() + (size_t)i * maxTaps;
+			for (int t = 0; t + shift < taps; t++)
+				axis.weights[(size_t)i * taps + t + shift] = (float)w[t];
+		}
+	}
+
+	void Resampler::prepare(int dstW, int dstH, int srcW, int srcH, int channels, ResampleFilter filter)
+	{
+		if (m_axisY.srcSize != srcH || m_axisY.dstSize != dstH || m_axisY.filter != filter)
+			buildAxis(m_axisY, srcH, dstH, filter);
+		if (m_axisX.srcSize == srcW && m_axisX.dstSize == dstW && m_axisX.filter == filter
+			&& m_channels == channels)
+			return;
+		buildAxis(m_axisX, srcW, dstW, filter);
+
+		// each channel gathers its own elements
+		m_channels = channels;
+		const int taps = m_axisX.taps, num = dstW * channels;
+		m_offsetsX.resize(num);
+		m_weightsX.resize((size_t)taps * num);
+		for (int x = 0; x < dstW; x++)
+		for (int c = 0; c < channels; c++)
+		{
+			const int j = x * channels + c;
+			m_offsetsX[j] = m_axisX.begin[x] * channels + c;
+			for (int k = 0; k < taps; k++)
+				m_weightsX[(size_t)k * num + j] = m_axisX.weights[(size_t)x * taps + k];
+		}
+	}
+
+	// out = sum of row(k, i) * weights[k] for k in [0, n), by conv_helper::conv_rows_simd() on at most
+	// @batch rows at a time, the first being the sum so far; @i is the index of the row in its batch
+	template<class RowFn> static void resample_combine(float* out, int num, const float* weights, int n,
+		int batch, const RowFn& row)
+	{
+		const float* rows[CONV_HELPER_MAX_SIMD_TAPS];
+		float w[CONV_HELPER_MAX_SIMD_TAPS];
+		for (int k = 0; k < n;)
+		{
+			int m = 0;
+			if (k > 0)
+			{
+				rows[0] = out;
+				w[0] = 1.f;
+				m = 1;
+			}
+			for (int i = 0; m < batch && k < n; m++, k++, i++)
+			{
+				rows[m] = row(k, i);
+				w[m] = weights[k];
+			}
+			conv_helper::conv_rows_simd(out, rows, w, m, num);
+		} // end for k
+	}
+
+	template<class T> void Resampler::resampleRows(T* dst, int dstPitch, const T* src, int srcPitch)
+	{
+		const int channels = m_channels, tapsX = m_axisX.taps, tapsY = m_axisY.taps;
+		const int srcLen = m_axisX.srcSize * channels, dstLen = m_axisX.dstSize * channels;
+		const int srcH = m_axisY.srcSize, dstH = m_axisY.dstSize;
+		const int* beginY = m_axisY.begin.data();
+		const float* weightsY = m_axisY.weights.data();
+		const int* offsetsX = m_offsetsX.data();
+		const float* weightsX = m_weightsX.data();
+		const int autoGrain = std::max(1, dstH / (8 * ThreadPool::instance().maxThreads()));
+
+		// the gathers along x cost about 4 contiguous multiply-adds, thus x goes first when it reduces the
+		// work along y, E.G., when upscaling, and y first otherwise, E.G., when downscaling a lot
+		const double gatherCost = 4;
+		const double costXFirst = std::min<double>(srcH, (double)dstH * tapsY) * dstLen * tapsX * gatherCost
+			+ (double)dstH * dstLen * tapsY;
+		const double costYFirst = (double)dstH * srcLen * tapsY + (double)dstH * dstLen * tapsX * gatherCost;
+
+		if (costXFirst <= costYFirst)
+		{
+			// chunks of output rows reading at least 4 times the input rows shared with the next chunk
+			const int grain = std::max(std::min(dstH, (int)(4LL * tapsY * dstH / srcH) + 1), autoGrain);
+			ldp::parallelFor(0, dstH, grain, [&](int yb, int ye)
+			{
+				ScratchArena& arena = ThreadPool::instance().scratch();
+				ScratchArena::Scope scope(arena);
+
+				// the input rows of the chunk filtered along x; the first input rows of the output rows are not
+				// monotone, as the taps of zero weight are dropped and the tables clamped to the image
+				int rb = beginY[yb], re = beginY[yb] + tapsY;
+				for (int y = yb + 1; y < ye; y++)
+				{
+					rb = std::min(rb, beginY[y]);
+					re = std::max(re, beginY[y] + tapsY);
+				}
+				float* rows = arena.allocate<float>((size_t)(re - rb) * dstLen);
+				float* srcBuf = arena.allocate<float>(srcLen);
+				float* dstBuf = arena.allocate<float>(dstLen);
+				for (int r = rb; r < re; r++)
+				{
+					const float* s = resample_load_row(srcBuf, src + (size_t)r * srcPitch, srcLen);
+					conv_helper::gather_row_simd(rows + (size_t)(r - rb) * dstLen, s, offsetsX, weightsX, tapsX,
+						channels, dstLen);
+				}
+
+				// then combined along y
+				for (int y = yb; y < ye; y++)
+				{
+					T* d = dst + (size_t)y * dstPitch;
+					float* out = resample_out_row(dstBuf, d);
+					const float* r0 = rows + (size_t)(beginY[y] - rb) * dstLen;
+					resample_combine(out, dstLen, weightsY + (size_t)y * tapsY, tapsY, CONV_HELPER_MAX_SIMD_TAPS,
+						[&](int k, int)->const float*{ return r0 + (size_t)k * dstLen; });
+					resample_store_row(d, out, dstLen);
+				} // end for y
+			});
+			return;
+		}
+
+		// each output row combines its input rows along y, then filtered along x; converted input rows are
+		// combined a few at a time, to stay in the cache
+		const int batch = std::is_same<T, float>::value ? CONV_HELPER_MAX_SIMD_TAPS : std::max(2,
+			std::min((int)CONV_HELPER_MAX_SIMD_TAPS, (int)(CONV_HELPER_RING_BYTES / (srcLen * sizeof(float)))));
+		ldp::parallelFor(0, dstH, autoGrain, [&](int yb, int ye)
+		{
+			ScratchArena& arena = ThreadPool::instance().scratch();
+			ScratchArena::Scope scope(arena);
+			float* srcBuf = arena.allocate<float>((size_t)batch * srcLen);
+			float* column = arena.allocate<float>(srcLen);
+			float* dstBuf = arena.allocate<float>(dstLen);
+			for (int y = yb; y < ye; y++)
+			{
+				const T* s0 = src + (size_t)beginY[y] * srcPitch;
+				resample_combine(column, srcLen, weightsY + (size_t)y * tapsY, tapsY, batch,
+					[&](int k, int i)->const float*
+				{
+					return resample_load_row(srcBuf + (size_t)i * srcLen, s0 + (size_t)k * srcPitch, srcLen);
+				});
+				T* d = dst + (size_t)y * dstPitch;
+				float* out = resample_out_row(dstBuf, d);
+				conv_helper::gather_row_simd(out, column, offsetsX, weightsX, tapsX, channels, dstLen);
+				resample_store_row(d, out, dstLen);
+			} // end for y
+		});
+	}
+
+	void Resampler::resample(float* dst, int dstW, int dstH, int dstPitch, const float* src, int srcW, int srcH,
+		int srcPitch, int channels, ResampleFilter filter)
+	{
+		if (channels <= 0 || dstW < 0 || dstH < 0 || srcW < 0 || srcH < 0
+			|| dstPitch < dstW * channels || srcPitch < srcW * channels)
+			throw std::exception("Resampler: invalid image sizes");
+		if (dstW == 0 || dstH == 0)
+			return;
+		if (srcW == 0 || srcH == 0)
+			throw std::exception("Resampler: empty source image");
+		prepare(dstW, dstH, srcW, srcH, channels, filter);
+		resampleRows(dst, dstPitch, src, srcPitch);
+	}
+
+	void Resampler::resample(unsigned char* dst, int dstW, int dstH, int dstPitch, const unsigned char* src,
+		int srcW, int srcH, int srcPitch, int channels, ResampleFilter filter)
+	{
+		if (channels <= 0 || dstW < 0 || dstH < 0 || srcW < 0 || srcH < 0
+			|| dstPitch < dstW * channels || srcPitch < srcW * channels)
+			throw std::exception("Resampler: invalid image sizes");
+		if (dstW == 0 || dstH == 0)
+			return;
+		if (srcW == 0 || srcH == 0)
+			throw std::exception("Resampler: empty source image");
+		prepare(dstW, dstH, srcW, srcH, channels, filter);
+		resampleRows(dst, dstPitch, src, srcPitch);
+	}
+
+	void Resampler::resample(FloatImage& dst, const FloatImage& src, int channels, ResampleFilter filter)
+	{
+		if (channels <= 0 || dst.width() % channels || src.width() % channels)
+			throw std::exception("Resampler: widths not multiples of the channels");
+		resample(dst.data(), dst.width() / channels, dst.height(), dst.stride_Y(), src.data(),
+			src.width() / channels, src.height(), src.stride_Y(), channels, filter);
+	}
+
+	void Resampler::resample(MaskImage& dst, const MaskImage& src, int channels, ResampleFilter filter)
+	{
+		if (channels <= 0 || dst.width() % channels || src.width() % channels)
+			throw std::exception("Resampler: widths not multiples of the channels");
+		resample(dst.data(), dst.width() / channels, dst.height(), dst.stride_Y(), src.data(),
+			src.width() / channels, src.height(), src.stride_Y(), channels, filter);
+	}
+
+	void resampleImage(FloatImage& dst, const FloatImage& src, int channels, ResampleFilter filter)
+	{
+		Resampler resampler;
+		resampler.resample(dst, src, channels, filter);
+	}
+
+	void resampleImage(MaskImage& dst, const MaskImage& src, int channels, ResampleFilter filter)
+	{
+		Resampler resampler;
+		resampler.resample(dst, src, channels, filter);
+	}
+
+	void resampleImage(unsigned char* dst, int dstW, int dstH, int dstPitch, const unsigned char* src,
+		int srcW, int srcH, int srcPitch, int channels, ResampleFilter filter)
+	{
+		Resampler resampler;
+		resampler.resample(dst, dstW, dstH, dstPitch, src, srcW, srcH, srcPitch, channels, filter);
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "ImageData.h"
+#include <vector>
+namespace ldp
+{
+	enum ResampleFilter
+	{
+		ResampleBilinear,	// triangle of radius 1
+		ResampleBicubic,	// Keys cubic of radius 2, a = -0.5
+		ResampleArea,		// average of the input area covered by each output pixel
+	};
+
+	// separable resampling of images of interleaved channels by precomputed filter tables
+	// along each axis an output pixel is a weighted sum of a fixed number of consecutive input pixels,
+	// the weights summing to 1 and the input clamped at the borders; the bilinear and bicubic filters
+	// are widened by the scale when downscaling, thus nothing aliases.
+	// the rows are filtered along x by gathers, vectorized over the output pixels and channels, and
+	// combined along y by contiguous multiply-adds, in the order of least work: x first when upscaling,
+	// y first when downscaling a lot; the output rows are split among the threads.
+	// the tables are kept for the next calls of the same sizes, E.G., when resizing a set of images.
+	class Resampler
+	{
+	public:
+		Resampler();
+		~Resampler();
+
+		// @dst: @dstW x @dstH pixels of @channels, @dstPitch elements from a row to the next;
+		// the same for @src, which must not overlap it. the widths are in pixels
+		void resample(float* dst, int dstW, int dstH, int dstPitch, const float* src, int srcW, int srcH,
+			int srcPitch, int channels, ResampleFilter filter);
+
+		// 8-bit channels, E.G., the bytes of QImage::Format_RGB32 as 4 channels, rounded and saturated
+		void resample(unsigned char* dst, int dstW, int dstH, int dstPitch, const unsigned char* src,
+			int srcW, int srcH, int srcPitch, int channels, ResampleFilter filter);
+
+		// @dst keeps its size; the widths are in elements as in ConvolutionPyramid
+		void resample(FloatImage& dst, const FloatImage& src, int channels, ResampleFilter filter);
+		void resample(MaskImage& dst, const MaskImage& src, int channels, ResampleFilter filter);
+	protected:
+		// weights of @taps input pixels from begin[i] for each output pixel i
+		struct Axis
+		{
+			int srcSize;
+			int dstSize;
+			ResampleFilter filter;
+			int taps;
+			std::vector<int> begin;
+			std::vector<float> weights;
+		};
+		static void buildAxis(Axis& axis, int srcSize, int dstSize, ResampleFilter filter);
+
+		// the tables for these sizes, rebuilt only when they change
+		void prepare(int dstW, int dstH, int srcW, int srcH, int channels, ResampleFilter filter);
+
+		template<class T> void resampleRows(T* dst, int dstPitch, const T* src, int srcPitch);
+	private:
+		Resampler(const Resampler&);
+		Resampler& operator=(const Resampler&);
+	protected:
+		Axis m_axisX;
+		Axis m_axisY;
+		int m_channels;
+		std::vector<int> m_offsetsX;	// the first input element of each output element of a row
+		std::vector<float> m_weightsX;	// of the elements of a row, tap by tap, see conv_helper::gather_row_simd()
+	};
+
+	// Resampler::resample() by tables built for this call only
+	void resampleImage(FloatImage& dst, const FloatImage& src, int channels, ResampleFilter filter);
+	void resampleImage(MaskImage& dst, const MaskImage& src, int channels, ResampleFilter filter);
+	void resampleImage(unsigned char* dst, int dstW, int dstH, int dstPitch, const unsigned char* src,
+		int srcW, int srcH, int srcPitch, int channels, ResampleFilter filter);
+}
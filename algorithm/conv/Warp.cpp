@@ -0,0 +1,165 @@
+#include "Warp.h"
+namespace ldp
+{
+#undef min
+#undef max
+	// the position of (u, v) of the unit square on a quad, u along its top edge from corner 0 to 3, v along
+	// its left edge from 0 to 1
+	//	perspective: x = (m0 u + m1 v + m2) / (m6 u + m7 v + 1), y = (m3 u + m4 v + m5) / (m6 u + m7 v + 1)
+	//	bilinear: (1 - u)(1 - v) q0 + (1 - u) v q1 + u v q2 + u (1 - v) q3
+	struct QuadWarpMap
+	{
+		QuadMapping mapping;
+		ldp::Double2 q[4];
+		double m[8];
+	};
+
+	static void quad_warp_map(QuadWarpMap& map, const ldp::Float2 quad[4], QuadMapping mapping)
+	{
+		map.mapping = mapping;
+		for (int k = 0; k < 4; k++)
+		{
+			if (!(fabs(quad[k][0]) < 1e30f && fabs(quad[k][1]) < 1e30f))
+				throw std::exception("warpQuad: invalid quad");
+			map.q[k] = ldp::Double2(quad[k][0], quad[k][1]);
+		}
+		if (mapping != QuadPerspective)
+			return;
+
+		// square to quad, Heckbert 1989, the square corners (0, 0), (1, 0), (1, 1), (0, 1) going to p0..p3
+		const ldp::Double2 p0 = map.q[0], p1 = map.q[3], p2 = map.q[2], p3 = map.q[1];
+		const ldp::Double2 s = p0 - p1 + p2 - p3;
+		double* m = map.m;
+		if (s[0] == 0 && s[1] == 0)
+		{
+			m[6] = m[7] = 0;
+		}
+		else
+		{
+			const ldp::Double2 d1 = p1 - p2, d2 = p3 - p2;
+			const double den = d1[0] * d2[1] - d2[0] * d1[1];
+			if (den == 0)
+				throw std::exception("warpQuad: degenerate quad");
+			m[6] = (s[0] * d2[1] - d2[0] * s[1]) / den;
+			m[7] = (d1[0] * s[1] - s[0] * d1[1]) / den;
+		}
+		for (int k = 0; k < 2; k++)
+		{
+			m[k * 3 + 0] = p1[k] - p0[k] + m[6] * p1[k];
+			m[k * 3 + 1] = p3[k] - p0[k] + m[7] * p3[k];
+			m[k * 3 + 2] = p0[k];
+		}
+	}
+
+	// the line of row @y of a @width x @height output, see conv_helper::warp_row_simd(), the pixel centers
+	// being at u = (x + 0.5) / width, v = (y + 0.5) / height
+	static void quad_warp_line(float line[6], const QuadWarpMap& map, int y, int width, int height)
+	{
+		const double du = 1.0 / width, u0 = 0.5 * du, v = (y + 0.5) / height;
+		if (map.mapping == QuadPerspective)
+		{
+			const double* m = map.m;
+			const double w[3][3] = { { m[0], m[1], m[2] }, { m[3], m[4], m[5] }, { m[6], m[7], 1 } };
+			for (int k = 0; k < 3; k++)
+			{
+				line[k * 2] = (float)(w[k][0] * u0 + w[k][1] * v + w[k][2]);
+				line[k * 2 + 1] = (float)(w[k][0] * du);
+			}
+			return;
+		}
+		const ldp::Double2 left = (1 - v) * map.q[0] + v * map.q[1];
+		const ldp::Double2 right = (1 - v) * map.q[3] + v * map.q[2];
+		for (int k = 0; k < 2; k++)
+		{
+			line[k * 2] = (float)(left[k] + u0 * (right[k] - left[k]));
+			line[k * 2 + 1] = (float)(du * (right[k] - left[k]));
+		}
+		line[4] = 1.f;
+		line[5] = 0.f;
+	}
+
+	// rows of the output, written in place for floats and encoded otherwise
+	static float* warp_out_row(float*, float* dst)
+	{
+		return dst;
+	}
+	static float* warp_out_row(float* buf, unsigned char*)
+	{
+		return buf;
+	}
+	static void warp_store_row(float*, const float*, int)
+	{
+	}
+	static void warp_store_row(unsigned char* dst, const float* row, int num)
+	{
+		conv_helper::encode_row_simd(dst, row, num, 1.f, 0.f);
+	}
+
+	template<class T> static void warp_quad(ImageTemplate<T>& dst, const FloatImage& src,
+		const ldp::Float2 quad[4], int channels, QuadMapping mapping)
+	{
+		if (channels <= 0 || dst.width() % channels || src.width() % channels)
+			throw std::exception("warpQuad: widths not multiples of the channels");
+		const int width = dst.width() / channels, height = dst.height();
+		if (width == 0 || height == 0)
+			return;
+		if (src.width() == 0 || src.height() == 0)
+			throw std::exception("warpQuad: empty source image");
+		QuadWarpMap map;
+		quad_warp_map(map, quad, mapping);
+
+		// rows per task as poisson_row_grain(), small crops run as a single one
+		const int grain = std::max(1, 16384 / dst.width());
+		ldp::parallelFor(0, height, grain, [&](int yb, int ye)
+		{
+			ScratchArena& arena = ThreadPool::instance().scratch();
+			ScratchArena::Scope scope(arena);
+			float* buf = arena.allocate<float>(dst.width());
+			float line[6];
+			for (int y = yb; y < ye; y++)
+			{
+				T* d = dst.data_XY(0, y);
+				float* out = warp_out_row(buf, d);
+				quad_warp_line(line, map, y, width, height);
+				conv_helper::warp_row_simd(out, src.data(), src.width() / channels, src.height(), src.stride_Y(),
+					channels, line, width);
+				warp_store_row(d, out, dst.width());
+			}
+		});
+	}
+
+	template<class T> static void warp_quads(ImageTemplate<T>* const* dsts, const ldp::Float2* quads,
+		int numQuads, const FloatImage& src, int channels, QuadMapping mapping)
+	{
+		// the rows of a large crop are split further
+		ldp::parallelFor(0, numQuads, 1, [&](int qb, int qe)
+		{
+			for (int q = qb; q < qe; q++)
+				warp_quad(*dsts[q], src, quads + q * 4, channels, mapping);
+		});
+	}
+
+	void warpQuad(FloatImage& dst, const FloatImage& src, const ldp::Float2 quad[4], int channels,
+		QuadMapping mapping)
+	{
+		warp_quad(dst, src, quad, channels, mapping);
+	}
+
+	void warpQuad(MaskImage& dst, const FloatImage& src, const ldp::Float2 quad[4], int channels,
+		QuadMapping mapping)
+	{
+		warp_quad(dst, src, quad, channels, mapping);
+	}
+
+	void warpQuads(FloatImage* const* dsts, const ldp::Float2* quads, int numQuads, const FloatImage& src,
+		int channels, QuadMapping mapping)
+	{
+		warp_quads(dsts, quads, numQuads, src, channels, mapping);
+	}
+
+	void warpQuads(MaskImage* const* dsts, const ldp::Float2* quads, int numQuads, const FloatImage& src,
+		int channels, QuadMapping mapping)
+	{
+		warp_quads(dsts, quads, numQuads, src, channels, mapping);
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "ImageData.h"
+namespace ldp
+{
+	enum QuadMapping
+	{
+		QuadPerspective,	// the homography of the rectangle onto the quad, lines stay straight
+		QuadBilinear,		// the bilinear blend of the corners, inverted by GetInnerCoordinate() of util.h
+	};
+
+	// rectification of quads of an image into rectangles, E.G., photographed sheets into canonical crops
+	// the corners of @quad, in the order of CalcBilinearCoef() of util.h: 0 3 / 1 2, I.E., top-left,
+	// bottom-left, bottom-right and top-right, go to the corners of @dst, which is sampled bilinearly at the
+	// centers of its pixels; positions are in pixels of @src, the centers at integers as bilinear_at(),
+	// and clamped to it.
+	// along a row of @dst the source positions are linear, or projective, in the column: each row is
+	// given by its line, computed in double, from which conv_helper::warp_row_simd() computes and samples
+	// the points, vectorized; the rows are split among the threads.
+	// @channels: interleaved, the widths of the images are in elements as in ConvolutionPyramid
+	// @dst: keeps its size; MaskImage ones are rounded and saturated
+	void warpQuad(FloatImage& dst, const FloatImage& src, const ldp::Float2 quad[4], int channels = 1,
+		QuadMapping mapping = QuadPerspective);
+	void warpQuad(MaskImage& dst, const FloatImage& src, const ldp::Float2 quad[4], int channels = 1,
+		QuadMapping mapping = QuadPerspective);
+
+	// a batch of crops of the same image, @dsts[i] from quads[4 * i, 4 * i + 4), in parallel
+	void warpQuads(FloatImage* const* dsts, const ldp::Float2* quads, int numQuads, const FloatImage& src,
+		int channels = 1, QuadMapping mapping = QuadPerspective);
+	void warpQuads(MaskImage* const* dsts, const ldp::Float2* quads, int numQuads, const FloatImage& src,
+		int channels = 1, QuadMapping mapping = QuadPerspective);
+}
@@ -0,0 +1,224 @@
+// the storage codecs of conv_helper, decode_row_simd()/encode_row_simd(), on every level supported against
+// references in fp32 and double arithmetic: the half conversions of all the patterns and of the ties
+// between them, NaN and infinities, and the fixed point ones with their rounding, saturation and round
+// trips through a scale and an offset
+// standalone, returning the number of failures: a console project of this file, conv/Convolution_Helper.cpp
+// and ThreadPool.cpp, with algorithm/, algorithm/ldpMat/ and algorithm/conv/ as include directories.
+#include "Convolution_Helper.h"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+#include <algorithm>
+#undef min
+#undef max
+using namespace conv_helper;
+
+static const char* g_levelNames[] = { "none", "sse2", "avx2", "avx512" };
+static int g_failures = 0;
+
+static unsigned int floatBits(float f)
+{
+	unsigned int b;
+	memcpy(&b, &f, sizeof(b));
+	return b;
+}
+
+static float bitsFloat(unsigned int b)
+{
+	float f;
+	memcpy(&f, &b, sizeof(f));
+	return f;
+}
+
+static void fail(const char* what, SimdLevel level, double input, double expected, double got)
+{
+	if (g_failures < 20)
+		printf("FAILED %s on %s: %.9g gave %.9g instead of %.9g\n", what, g_levelNames[level], input, got, expected);
+	g_failures++;
+}
+
+// the value of a half, by its definition
+static double halfValue(unsigned short h)
+{
+	const int e = (h >> 10) & 0x1f, m = h & 0x3ff;
+	const double sign = (h & 0x8000) ? -1.0 : 1.0;
+	if (e == 0x1f)
+		return m ? std::numeric_limits<double>::quiet_NaN() : sign * std::numeric_limits<double>::infinity();
+	if (e == 0)
+		return sign * ldexp((double)m, -24);
+	return sign * ldexp(1024.0 + m, e - 25);
+}
+
+// the nearest half of a finite float, ties to even, by the spacing of the halves around it
+static unsigned short nearestHalf(float f)
+{
+	const unsigned short sign = (floatBits(f) >> 16) & 0x8000;
+	const double a = fabs((double)f);
+	if (a >= 65520.0)
+		return sign | 0x7c00;
+	int e = 0;
+	frexp(a, &e);
+	const double ulp = ldexp(1.0, std::max(e - 1, -14) - 10);
+	// exact: a scaled by a power of 2, rounded to nearest even as by default
+	const double v = nearbyint(a / ulp) * ulp;
+	if (v < ldexp(1.0, -14))
+		return sign | (unsigned short)(v / ldexp(1.0, -24));
+	frexp(v, &e);
+	return sign | (unsigned short)(((e - 1 + 15) << 10) | (int)((ldexp(v, 1 - e) - 1.0) * 1024));
+}
+
+static void testHalf(SimdLevel level)
+{
+	// every pattern
+	std::vector<unsigned short> h(65536);
+	for (int i = 0; i < 65536; i++)
+		h[i] = (unsigned short)i;
+	std::vector<float> f(65536);
+	decode_row_simd(f.data(), (const half_float::half*)h.data(), 65536);
+	for (int i = 0; i < 65536; i++)
+	{
+		const double v = halfValue(h[i]);
+		if (v != v)
+		{
+			// quieted, the payload and the sign kept
+			const unsigned int expected = ((unsigned int)(h[i] & 0x8000) << 16) | 0x7fc00000 | ((h[i] & 0x3ff) << 13);
+			if (floatBits(f[i]) != expected)
+				fail("decode half NaN", level, h[i], bitsFloat(expected), f[i]);
+		}
+		else if ((double)f[i] != v || (floatBits(f[i]) >> 31) != (unsigned int)(h[i] >> 15))
+			fail("decode half", level, h[i], v, f[i]);
+	}
+
+	// the halves, the ties between neighbors and the floats next to them, specials and random patterns
+	std::vector<float> src;
+	for (int i = 0; i < 0x7c00; i++)
+	for (int s = 0; s < 2; s++)
+	{
+		const float a = (float)halfValue((unsigned short)i), b = (float)halfValue((unsigned short)(i + 1));
+		const float tie = (float)(((double)a + b) * 0.5);
+		const float sign = s ? -1.f : 1.f;
+		src.push_back(sign * a);
+		src.push_back(sign * tie);
+		src.push_back(sign * std::nextafter(tie, 0.f));
+		src.push_back(sign * std::nextafter(tie, 1e30f));
+	}
+	const float specials[] = { 0.f, -0.f, 65504.f, std::nextafter(65520.f, 0.f), 65520.f, 1e30f, -1e30f,
+		ldexp(1.f, -24), ldexp(1.f, -25), ldexp(1.5f, -25), std::nextafter(ldexp(1.f, -25), 1.f), 1e-30f,
+		std::numeric_limits<float>::denorm_min(), std::numeric_limits<float>::infinity(),
+		-std::numeric_limits<float>::infinity(), std::numeric_limits<float>::quiet_NaN(),
+		-std::numeric_limits<float>::quiet_NaN(), bitsFloat(0x7f800001), bitsFloat(0xffbfffff) };
+	src.insert(src.end(), specials, specials + sizeof(specials) / sizeof(float));
+	std::mt19937 rng(43);
+	for (int i = 0; i < 100000; i++)
+		src.push_back(bitsFloat(rng()));
+
+	std::vector<unsigned short> out(src.size());
+	encode_row_simd((half_float::half*)out.data(), src.data(), (int)src.size());
+	for (size_t i = 0; i < src.size(); i++)
+	{
+		const unsigned short sign = (floatBits(src[i]) >> 16) & 0x8000;
+		if (src[i] != src[i])
+		{
+			// quiet NaN of the same sign
+			if ((out[i] & 0xfe00) != (sign | 0x7e00))
+				fail("encode half NaN", level, src[i], halfValue(sign | 0x7e00), halfValue(out[i]));
+			continue;
+		}
+		const unsigned short expected = std::isinf(src[i]) ? (sign | 0x7c00) : nearestHalf(src[i]);
+		if (out[i] != expected)
+			fail("encode half", level, src[i], halfValue(expected), halfValue(out[i]));
+	}
+}
+
+// q * scale + offset and back, in fp32 as the codecs: NaN goes to 0, the rest saturates to [0, max]
+template<class T> static T encodeRef(float v, float scale, float offset)
+{
+	const float q = (v + -offset) * (1.f / scale);
+	if (!(q > 0.f))
+		return 0;
+	return (T)nearbyintf(std::min(q, (float)std::numeric_limits<T>::max()));
+}
+
+template<class T> static void testFixed(SimdLevel level, const char* name, float scale, float offset)
+{
+	const int maxQ = std::numeric_limits<T>::max();
+	std::vector<float> src;
+
+	// every code and the ties halfway to the next, below and above the range, and the specials
+	for (int q = -2; q <= maxQ + 2; q++)
+	{
+		src.push_back(q * scale + offset);
+		src.push_back((q + 0.5f) * scale + offset);
+	}
+	const float specials[] = { -1e30f, 1e30f, std::numeric_limits<float>::infinity(),
+		-std::numeric_limits<float>::infinity(), std::numeric_limits<float>::quiet_NaN() };
+	src.insert(src.end(), specials, specials + sizeof(specials) / sizeof(float));
+	std::mt19937 rng(maxQ);
+	std::uniform_real_distribution<float> u(-0.1f * maxQ, 1.1f * maxQ);
+	for (int i = 0; i < 10000; i++)
+		src.push_back(u(rng) * scale + offset);
+
+	std::vector<T> q(src.size());
+	encode_row_simd(q.data(), src.data(), (int)src.size(), scale, offset);
+	for (size_t i = 0; i < src.size(); i++)
+	{
+		const T expected = encodeRef<T>(src[i], scale, offset);
+		if (q[i] != expected)
+			fail(name, level, src[i], expected, q[i]);
+	}
+
+	// exact ties go to even, on the unit scale
+	if (scale == 1.f && offset == 0.f)
+	for (int k = 0; k < maxQ; k++)
+	{
+		const float tie = k + 0.5f;
+		T t;
+		encode_row_simd(&t, &tie, 1, 1.f, 0.f);
+		if (t != ((k & 1) ? k + 1 : k))
+			fail(name, level, tie, (k & 1) ? k + 1 : k, t);
+	}
+
+	// every code decodes to q * scale + offset in fp32, and encodes back to itself
+	std::vector<T> codes(maxQ + 1), back(maxQ + 1);
+	std::vector<float> values(maxQ + 1);
+	for (int k = 0; k <= maxQ; k++)
+		codes[k] = (T)k;
+	decode_row_simd(values.data(), codes.data(), maxQ + 1, scale, offset);
+	encode_row_simd(back.data(), values.data(), maxQ + 1, scale, offset);
+	for (int k = 0; k <= maxQ; k++)
+	{
+		if (values[k] != (float)k * scale + offset)
+			fail(name, level, k, (float)k * scale + offset, values[k]);
+		if (back[k] != codes[k])
+			fail(name, level, values[k], k, back[k]);
+	}
+}
+
+int main()
+{
+	printf("simd level supported: %s\n", g_levelNames[simdLevelSupported()]);
+	for (int l = SimdNone; l <= SimdAVX512; l++)
+	{
+		const SimdLevel level = (SimdLevel)l;
+		setSimdLevel(level);
+		if (simdLevel() != level)
+		{
+			printf("%s: not supported, skipped\n", g_levelNames[level]);
+			continue;
+		}
+		testHalf(level);
+		testFixed<unsigned char>(level, "u8 unit", 1.f, 0.f);
+		testFixed<unsigned char>(level, "u8", 2.f / 255, -1.f);
+		testFixed<unsigned short>(level, "u16 unit", 1.f, 0.f);
+		testFixed<unsigned short>(level, "u16 normalized", 1.f / 65535, 0.f);
+		testFixed<unsigned short>(level, "u16", 0.01f, -300.f);
+		testFixed<unsigned short>(level, "u16 coarse", 2.5f, 1000.f);
+		printf("%s: tested\n", g_levelNames[level]);
+	} // end for l
+	setSimdLevel(simdLevelSupported());
+	printf("%d failures\n", g_failures);
+	return g_failures;
+}
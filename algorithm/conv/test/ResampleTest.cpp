@@ -0,0 +1,137 @@
+// ldp::Resampler against dense filter matrices built in double from the definitions of the filters, on
+// sizes up and down, E.G., 21x37 -> 4x39 of 4 channels, whose tables of rows are not monotone; on one
+// thread and several, thus the rows are split into chunks
+// standalone, returning the number of failures: a console project of this file, conv/Resample.cpp,
+// conv/ImageData.cpp, conv/Convolution_Helper.cpp and ThreadPool.cpp, with algorithm/, algorithm/ldpMat/
+// and algorithm/conv/ as include directories.
+#include "Resample.h"
+#include <cstdio>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <algorithm>
+#undef min
+#undef max
+using namespace ldp;
+
+static const char* g_filterNames[] = { "bilinear", "bicubic", "area" };
+static int g_failures = 0;
+
+static double kernel(ResampleFilter filter, double x)
+{
+	x = fabs(x);
+	if (filter == ResampleBilinear)
+		return x < 1 ? 1 - x : 0;
+	if (x < 1)
+		return (1.5 * x - 2.5) * x * x + 1;
+	if (x < 2)
+		return ((-0.5 * x + 2.5) * x - 4) * x + 2;
+	return 0;
+}
+
+// the weight of input pixel k for output pixel i, row by row, the input clamped to the borders
+static std::vector<double> denseAxis(int srcSize, int dstSize, ResampleFilter filter)
+{
+	std::vector<double> m((size_t)dstSize * srcSize, 0.0);
+	const double scale = (double)srcSize / dstSize, stretch = std::max(1.0, scale);
+	for (int i = 0; i < dstSize; i++)
+	{
+		double sum = 0;
+		for (int k = -4 * srcSize - 8; k < 5 * srcSize + 8; k++)
+		{
+			const double w = filter == ResampleArea
+				? std::max(0.0, std::min((i + 1) * scale, k + 1.0) - std::max(i * scale, (double)k))
+				: kernel(filter, (k + 0.5 - (i + 0.5) * scale) / stretch);
+			m[(size_t)i * srcSize + std::min(srcSize - 1, std::max(0, k))] += w;
+			sum += w;
+		}
+		for (int k = 0; k < srcSize; k++)
+			m[(size_t)i * srcSize + k] /= sum;
+	}
+	return m;
+}
+
+static double reference(const std::vector<double>& mx, const std::vector<double>& my, const FloatImage& src,
+	int srcW, int srcH, int channels, int x, int y, int c)
+{
+	double v = 0;
+	for (int ky = 0; ky < srcH; ky++)
+	{
+		const double wy = my[(size_t)y * srcH + ky];
+		if (wy == 0)
+			continue;
+		for (int kx = 0; kx < srcW; kx++)
+			v += wy * mx[(size_t)x * srcW + kx] * src(kx * channels + c, ky);
+	}
+	return v;
+}
+
+static void testCase(int srcW, int srcH, int dstW, int dstH, int channels, ResampleFilter filter, std::mt19937& rng)
+{
+	std::uniform_int_distribution<int> u(0, 255);
+	MaskImage src8;
+	src8.resize(srcW * channels, srcH);
+	FloatImage src;
+	src.resize(srcW * channels, srcH);
+	for (int y = 0; y < srcH; y++)
+	for (int x = 0; x < srcW * channels; x++)
+	{
+		src8(x, y) = (unsigned char)u(rng);
+		src(x, y) = src8(x, y);
+	}
+	const std::vector<double> mx = denseAxis(srcW, dstW, filter), my = denseAxis(srcH, dstH, filter);
+
+	// padded rows, thus the pitch is not the width
+	FloatImage dst;
+	dst.resize(dstW * channels, dstH, FloatImage::alignedPitch(dstW * channels) + 3);
+	resampleImage(dst, src, channels, filter);
+	MaskImage dst8;
+	dst8.resize(dstW * channels, dstH);
+	resampleImage(dst8, src8, channels, filter);
+
+	double err = 0;
+	int err8 = 0;
+	for (int y = 0; y < dstH; y++)
+	for (int x = 0; x < dstW; x++)
+	for (int c = 0; c < channels; c++)
+	{
+		const double r = reference(mx, my, src, srcW, srcH, channels, x, y, c);
+		err = std::max(err, fabs(r - dst(x * channels + c, y)));
+		const double r8 = std::min(255.0, std::max(0.0, r));
+		err8 += fabs(r8 - dst8(x * channels + c, y)) > 0.5 + 1e-3;
+	}
+	if (err > 255 * 1e-5 || err8)
+	{
+		printf("FAILED %dx%d -> %dx%d of %d channels, %s: max error %g, %d of 8 bits off\n", srcW, srcH, dstW,
+			dstH, channels, g_filterNames[filter], err, err8);
+		g_failures++;
+	}
+}
+
+int main()
+{
+	const int cases[][5] = {
+		{ 21, 37, 4, 39, 4 },
+		{ 37, 21, 39, 4, 4 },
+		{ 37, 29, 11, 13, 3 },
+		{ 200, 150, 64, 48, 4 },
+		{ 50, 40, 173, 121, 1 },
+		{ 640, 480, 9, 8, 4 },
+		{ 31, 17, 31, 17, 2 },
+		{ 5, 3, 200, 150, 3 },
+		{ 1, 1, 7, 9, 2 },
+		{ 100, 1, 30, 5, 1 },
+		{ 3, 300, 2, 7, 4 },
+	};
+	std::mt19937 rng(44);
+	const int threads[] = { 1, 8 };
+	for (int t = 0; t < 2; t++)
+	{
+		ThreadPool::instance().setMaxThreads(threads[t]);
+		for (int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++)
+		for (int f = 0; f < 3; f++)
+			testCase(cases[i][0], cases[i][1], cases[i][2], cases[i][3], cases[i][4], (ResampleFilter)f, rng);
+	}
+	printf("%d failures\n", g_failures);
+	return g_failures;
+}
@@ -0,0 +1,247 @@
+// agreement of the SIMD kernels of conv_helper on every level supported with the scalar ones of SimdNone
+// standalone, returning the number of failures: a console project of this file, conv/Convolution_Helper.cpp
+// and ThreadPool.cpp, with algorithm/, algorithm/ldpMat/ and algorithm/conv/ as include directories.
+// SSE2 is bitwise the same as the scalar code; AVX2/AVX-512 may differ by a few ulps where they fuse
+// multiply-adds (conv, gather, warp), the other kernels are exact on all levels. thus the scalar code
+// must not be contracted into fused multiply-adds either, the default of MSVC, -ffp-contract=off for gcc.
+#include "Convolution_Helper.h"
+#include <cstdio>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <algorithm>
+#undef min
+#undef max
+using namespace conv_helper;
+
+static const char* g_levelNames[] = { "none", "sse2", "avx2", "avx512" };
+static const int g_sizes[] = { 1, 3, 7, 8, 16, 17, 33, 64, 131 };
+static std::mt19937 g_rng(1234);
+static int g_failures = 0;
+
+static std::vector<float> randomRow(int num, float lo = -1.f, float hi = 1.f)
+{
+	std::uniform_real_distribution<float> u(lo, hi);
+	std::vector<float> v(num);
+	for (int i = 0; i < num; i++)
+		v[i] = u(g_rng);
+	return v;
+}
+
+// @tol: relative to the magnitude of the reference, 0 for bitwise
+template<class T> static void check(const char* name, SimdLevel level, int num, const std::vector<T>& ref,
+	const std::vector<T>& res, double tol)
+{
+	double err = 0, mag = 1;
+	bool same = true;
+	for (size_t i = 0; i < ref.size(); i++)
+	{
+		const double a = (double)ref[i], b = (double)res[i];
+		same = same && (a == b || (a != a && b != b));
+		err = std::max(err, std::abs(a - b));
+		mag = std::max(mag, std::abs(a));
+	}
+	if (tol == 0 ? same : err <= tol * mag)
+		return;
+	printf("FAILED %s on %s, num %d: max error %g\n", name, g_levelNames[level], num, err);
+	g_failures++;
+}
+
+// the tolerance of the kernels with multiply-adds, which are fused from AVX2 on
+static double fusedTol(SimdLevel level)
+{
+	return level >= SimdAVX2 ? 1e-5 : 0;
+}
+
+// runs @f at SimdNone and then at @level
+template<class T, class F> static void compare(const char* name, SimdLevel level, int num, int size, F f,
+	double tol)
+{
+	std::vector<T> ref(size), res(size);
+	setSimdLevel(SimdNone);
+	f(ref.data());
+	setSimdLevel(level);
+	f(res.data());
+	check(name, level, num, ref, res, tol);
+}
+
+static void testFilters(SimdLevel level, int num)
+{
+	const int taps[] = { 1, 2, 3, 5, 8, 17 };
+	const std::vector<float> src = randomRow(num);
+	for (int t = 0; t < (int)(sizeof(taps) / sizeof(int)); t++)
+	{
+		const int N = taps[t];
+		const std::vector<float> kernel = randomRow(N);
+		compare<float>("conv_row", level, num, num, [&](float* dst)
+		{
+			conv_row_simd(dst, src.data(), kernel.data(), N, num);
+		}, fusedTol(level));
+		compare<float>("max_row", level, num, num, [&](float* dst)
+		{
+			max_row_simd(dst, src.data(), N, num);
+		}, 0);
+		compare<float>("min_row", level, num, num, [&](float* dst)
+		{
+			min_row_simd(dst, src.data(), N, num);
+		}, 0);
+
+		std::vector<std::vector<float>> rows(N);
+		std::vector<const float*> ptrs(N);
+		for (int i = 0; i < N; i++)
+		{
+			rows[i] = randomRow(num);
+			ptrs[i] = rows[i].data();
+		}
+		compare<float>("conv_rows", level, num, num, [&](float* dst)
+		{
+			conv_rows_simd(dst, ptrs.data(), kernel.data(), N, num);
+		}, fusedTol(level));
+		compare<float>("max_rows", level, num, num, [&](float* dst)
+		{
+			max_rows_simd(dst, ptrs.data(), N, num);
+		}, 0);
+		compare<float>("min_rows", level, num, num, [&](float* dst)
+		{
+			min_rows_simd(dst, ptrs.data(), N, num);
+		}, 0);
+	} // end for t
+}
+
+static void testRelax(SimdLevel level, int num)
+{
+	const std::vector<float> u = randomRow(num), up = randomRow(num), down = randomRow(num), f = randomRow(num);
+	const std::vector<float> zeros(num, 0.f);
+	for (int nv = 0; nv <= 2; nv++)
+	for (int phase = 0; phase < 2; phase++)
+	{
+		compare<float>("rb_relax_row", level, num, num, [&](float* dst)
+		{
+			std::copy(u.begin(), u.end(), dst);
+			rb_relax_row_simd(dst, nv > 0 ? up.data() : zeros.data(), nv > 1 ? down.data() : zeros.data(),
+				f.data(), nv, phase, num);
+		}, 0);
+	}
+}
+
+static void testCodecs(SimdLevel level, int num)
+{
+	// beyond the ranges of the types, for the saturation
+	const std::vector<float> src = randomRow(num, -70000.f, 70000.f);
+	std::vector<unsigned short> h(num);
+	std::vector<unsigned char> q8(num);
+	std::vector<unsigned short> q16(num);
+	for (int i = 0; i < num; i++)
+	{
+		h[i] = (unsigned short)g_rng();
+		q8[i] = (unsigned char)g_rng();
+		q16[i] = (unsigned short)g_rng();
+	}
+	compare<float>("decode half", level, num, num, [&](float* dst)
+	{
+		decode_row_simd(dst, (const half_float::half*)h.data(), num);
+	}, 0);
+	compare<float>("decode u8", level, num, num, [&](float* dst)
+	{
+		decode_row_simd(dst, q8.data(), num, 0.5f, -3.f);
+	}, 0);
+	compare<float>("decode u16", level, num, num, [&](float* dst)
+	{
+		decode_row_simd(dst, q16.data(), num, 1.f / 65535, 0.25f);
+	}, 0);
+	compare<unsigned short>("encode half", level, num, num, [&](unsigned short* dst)
+	{
+		encode_row_simd((half_float::half*)dst, src.data(), num);
+	}, 0);
+	compare<unsigned char>("encode u8", level, num, num, [&](unsigned char* dst)
+	{
+		encode_row_simd(dst, src.data(), num, 256.f, 1000.f);
+	}, 0);
+	compare<unsigned short>("encode u16", level, num, num, [&](unsigned short* dst)
+	{
+		encode_row_simd(dst, src.data(), num, 1.5f, -20000.f);
+	}, 0);
+}
+
+static void testGather(SimdLevel level, int num)
+{
+	const int taps = 4, step = 3, srcSize = num * 2 + taps * step;
+	const std::vector<float> src = randomRow(srcSize), weights = randomRow(taps * num);
+	std::vector<int> offsets(num);
+	for (int x = 0; x < num; x++)
+		offsets[x] = (int)(g_rng() % (srcSize - (taps - 1) * step));
+	compare<float>("gather_row", level, num, num, [&](float* dst)
+	{
+		gather_row_simd(dst, src.data(), offsets.data(), weights.data(), taps, step, num);
+	}, fusedTol(level));
+}
+
+static void testWarp(SimdLevel level, int num)
+{
+	const int width = 23, height = 17;
+	for (int channels = 1; channels <= 3; channels++)
+	{
+		const int pitch = width * channels + 2;
+		const std::vector<float> src = randomRow(pitch * height);
+		// a perspective line crossing the image and leaving it on both sides
+		const float line[6] = { -3.f, 0.37f, 20.f, -0.11f, 1.f, 0.004f };
+		compare<float>("warp_row", level, num, num * channels, [&](float* dst)
+		{
+			warp_row_simd(dst, src.data(), width, height, pitch, channels, line, num);
+		}, fusedTol(level));
+	}
+}
+
+static void testBlend(SimdLevel level, int num)
+{
+	std::vector<unsigned int> src(num), palette(256);
+	std::vector<unsigned char> labels(num);
+	for (int i = 0; i < 256; i++)
+	{
+		// premultiplied, a quarter of the entries transparent
+		const unsigned int a = i % 4 ? g_rng() & 0xff : 0;
+		unsigned int p = a << 24;
+		for (int k = 0; k < 24; k += 8)
+			p |= ((g_rng() & 0xff) * a / 255) << k;
+		palette[i] = p;
+	}
+	for (int x = 0; x < num; x++)
+	{
+		src[x] = g_rng();
+		// runs of labels, as in masks
+		labels[x] = x % 5 ? (x ? labels[x - 1] : 0) : (unsigned char)g_rng();
+	}
+	compare<unsigned int>("blend_label_row", level, num, num, [&](unsigned int* dst)
+	{
+		blend_label_row_simd(dst, src.data(), labels.data(), palette.data(), num);
+	}, 0);
+}
+
+int main()
+{
+	printf("simd level supported: %s\n", g_levelNames[simdLevelSupported()]);
+	for (int l = SimdSSE2; l <= SimdAVX512; l++)
+	{
+		const SimdLevel level = (SimdLevel)l;
+		setSimdLevel(level);
+		if (simdLevel() != level)
+		{
+			printf("%s: not supported, skipped\n", g_levelNames[level]);
+			continue;
+		}
+		for (int s = 0; s < (int)(sizeof(g_sizes) / sizeof(int)); s++)
+		{
+			const int num = g_sizes[s];
+			testFilters(level, num);
+			testRelax(level, num);
+			testCodecs(level, num);
+			testGather(level, num);
+			testWarp(level, num);
+			testBlend(level, num);
+		}
+		printf("%s: tested\n", g_levelNames[level]);
+	} // end for l
+	setSimdLevel(simdLevelSupported());
+	printf("%d failures\n", g_failures);
+	return g_failures;
+}
@@ -8,6 +8,10 @@
 #include <QFile>
 #include <QFileInfo>
 #include <qdir.h>
+#include <QHash>
+#include <QDataStream>
+#include "ThreadPool.h"
+#include "ImageHash.h"
 #define CHECK_FILE(result, filename) \
 if (!(result))\
 	throw std::exception(("open file error: " + filename).toStdString().c_str());
@@ -29,6 +33,9 @@ void GlobalDataHolder::init()
 	m_lastRun_imgId = 0;
 	m_addPatternMode = false;
 	m_matchByClothTypeOnly = true;
+	m_patternAnnProbes = 16;
+	m_patternInfosRevision = 0;
+	m_patternDescriptorsRevision = -1;
 	loadLastRunInfo();
 }
 
@@ -342,11 +349,85 @@ void GlobalDataHolder::loadJdImageList(QString filename)
 		} // end if value[3]
 	} // end for row
 	autoSetGenders(m_imgInfos, m_xmlExportPureName);
+	transferJdLabelsFromDuplicates();
 	saveXml(QDir::cleanPath(m_rootPath+QDir::separator()+m_xmlExportPureName));
 	// useful when construct __attributes.xml
 	//PatternImageInfo::constructTypeMaps_qxml_save("__attributes.xml");
 }
 
+inline QString jdImageKey(const PatternImageInfo& info)
+{
+	if (info.numImages() == 0)
+		return "";
+	return QDir::cleanPath(info.getBaseName() + QDir::separator() + QFileInfo(info.getImageName(0)).fileName());
+}
+
+void GlobalDataHolder::transferJdLabelsFromDuplicates(int maxHammingDist)
+{
+	const QString indexName = QDir::cleanPath(m_rootPath + QDir::separator() + "__jd_image_index.dat");
+	ldp::ImageHashIndex index;
+	if (QFileInfo(indexName).exists() && !index.load(indexName))
+		std::cout << "warning: invalid image index, rebuilt: " << indexName.toStdString() << std::endl;
+
+	// fingerprints of this batch, computed in parallel
+	const int nInfos = (int)m_imgInfos.size();
+	std::vector<ldp::ImageFingerprint> fps(nInfos);
+	ldp::parallelFor(0, nInfos, 1, [&](int ib, int ie)
+	{
+		for (int i = ib; i < ie; i++)
+		if (m_imgInfos[i].numImages())
+			fps[i] = ldp::imageFingerprint(m_imgInfos[i].getImageName(0));
+	});
+
+	// labeled batches are loaded lazily, only when a duplicate is found in them
+	// NOTE: loading an xml may change the global pattern xml name, so we restore it after.
+	const QString patternXmlName = PatternImageInfo::getPatternXmlName();
+	QMap<QString, QHash<QString, PatternImageInfo>> labeledBatches;
+	std::vector<int> candidates;
+	int nTransferred = 0;
+	for (int i = 0; i < nInfos; i++)
+	{
+		if (!fps[i].isValid())
+			continue;
+		auto& info = m_imgInfos[i];
+		index.query(fps[i], maxHammingDist, candidates);
+		for (int id : candidates)
+		{
+			const auto& e = index.entry(id);
+			auto batchIter = labeledBatches.find(e.group);
+			if (batchIter == labeledBatches.end())
+			{
+				std::vector<PatternImageInfo> infos;
+				QString xmlName = QDir::cleanPath(m_rootPath + QDir::separator() + e.group);
+				if (QFileInfo(xmlName).exists())
+					loadXml_qxml(xmlName, m_rootPath, infos);
+				QHash<QString, PatternImageInfo> keyInfoMap;
+				for (const auto& labeled : infos)
+				if (!labeled.getJdMappedPattern().isEmpty())
+					keyInfoMap.insert(jdImageKey(labeled), labeled);
+				batchIter = labeledBatches.insert(e.group, keyInfoMap);
+			}
+			auto labeledIter = batchIter.value().find(e.key);
+			if (labeledIter == batchIter.value().end())
+				continue;
+			const auto& labeled = labeledIter.value();
+			for (const auto& name : PatternImageInfo::attributeNames())
+				info.setAttributeType(name, labeled.getAttributeType(name));
+			info.setJdMappedPattern(labeled.getJdMappedPattern());
+			nTransferred++;
+			break;
+		} // end for id
+	} // end for i
+	PatternImageInfo::setPatternXmlName(patternXmlName);
+
+	for (int i = 0; i < nInfos; i++)
+	if (fps[i].isValid())
+		index.insert(fps[i], m_xmlExportPureName, jdImageKey(m_imgInfos[i]));
+	if (!index.save(indexName))
+		std::cout << "warning: image index not saved: " << indexName.toStdString() << std::endl;
+	std::cout << "labels transferred from duplicates: " << nTransferred << "/" << nInfos << std::endl;
+}
+
 bool GlobalDataHolder::loadXml_tixml(QString filename, QString root, std::vector<PatternImageInfo>& imgInfos)
 {
 	TiXmlDocument doc;
@@ -508,6 +589,9 @@ void GlobalDataHolder::loadPatternXml(QString filename)
 {
 	m_patternInfos.clear();
 	m_namePatternMap.clear();
+	m_patternDescriptors.resize(0, 0);
+	m_patternDescriptorNames.clear();
+	m_patternAnnIndex.clear();
 	m_inputPatternXmlName = filename;
 	QFileInfo finfo(filename);
 	QFileInfo linfo(m_lastRun_PatternDir);
@@ -515,16 +599,12 @@ void GlobalDataHolder::loadPatternXml(QString filename)
 		m_lastRun_PatternDir = finfo.absolutePath();
 	saveLastRunInfo();
 	CHECK_FILE(loadXml_qxml(filename, finfo.absolutePath(), m_patternInfos), filename);
+	patternInfosChanged();
 	PatternImageInfo::setPatternXmlName(filename);
-	for (auto& pattern : m_patternInfos)
-		m_namePatternMap.insert(pattern.getBaseName(), qMakePair(&pattern, 0));
-	for (auto& info : m_imgInfos)
-	{
-		auto& iter = m_namePatternMap.find(info.getJdMappedPattern());
-		if (iter != m_namePatternMap.end())
-			iter.value().second++;
-	}
+	rebuildNamePatternMap();
 	autoSetGenders(m_patternInfos, finfo.baseName());
+	updatePatternDescriptors();
+	updatePatternAnnIndex();
 }
 
 void GlobalDataHolder::savePatternXml(QString filename)const
@@ -537,17 +617,8 @@ void GlobalDataHolder::savePatternXml(QString filename)const
 	saveLastRunInfo();
 }
 
-void GlobalDataHolder::uniquePatterns()
+void GlobalDataHolder::rebuildNamePatternMap()
 {
-	std::cout << "before cleaning: " << m_patternInfos.size() << std::endl;
-	QMap<QString, PatternImageInfo> urlPatternMap;
-	for (const auto& info : m_patternInfos)
-	if (urlPatternMap.find(info.getUrl()) == urlPatternMap.end())
-		urlPatternMap.insert(info.getUrl(), info);
-
-	m_patternInfos.clear();
-	for (const auto& info : urlPatternMap)
-		m_patternInfos.push_back(info);
 	m_namePatternMap.clear();
 	for (auto& pattern : m_patternInfos)
 		m_namePatternMap.insert(pattern.getBaseName(), qMakePair(&pattern, 0));
@@ -557,7 +628,357 @@ void GlobalDataHolder::uniquePatterns()
 		if (iter != m_namePatternMap.end())
 			iter.value().second++;
 	}
+}
+
+// libraries smaller than this are ranked by brute force
+const static int g_patternAnnMinSize = 50000;
+const static int g_patternAnnSubQuantizers = 12;
+const static int g_patternAnnTopK = 1024;
+
+const static quint32 g_patternDescMagic = 0x4c445044; // "LDPD"
+const static quint32 g_patternDescVersion = 2; // 2: thumbnails by the area filter of ldp::resampleImage()
+
+static bool loadPatternDescriptors(QString filename, QStringList& names, ldp::Matf& D)
+{
+	QFile file(filename);
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+	QDataStream stm(&file);
+	quint32 magic = 0, version = 0, dim = 0;
+	stm >> magic >> version >> dim >> names;
+	if (magic != g_patternDescMagic || version != g_patternDescVersion || dim != ldp::ImageDescriptorDim)
+		return false;
+	D.resize(dim, names.size());
+	const int bytes = int(D.size() * sizeof(float));
+	return stm.readRawData((char*)D.data(), bytes) == bytes;
+}
+
+static bool savePatternDescriptors(QString filename, const QStringList& names, const ldp::Matf& D)
+{
+	QFile file(filename);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+	QDataStream stm(&file);
+	stm << g_patternDescMagic << g_patternDescVersion << (quint32)D.rows() << names;
+	const int bytes = int(D.size() * sizeof(float));
+	return stm.writeRawData((const char*)D.data(), bytes) == bytes;
+}
+
+void GlobalDataHolder::updatePatternDescriptors()
+{
+	// called on each query, thus O(1) when nothing changed
+	const int nPatterns = (int)m_patternInfos.size();
+	if (m_patternDescriptorsRevision == m_patternInfosRevision && m_patternDescriptors.cols() == nPatterns)
+		return;
+	QStringList names;
+	for (const auto& pattern : m_patternInfos)
+		names.push_back(pattern.getBaseName());
+
+	ldp::Matf D(ldp::ImageDescriptorDim, nPatterns);
+	std::vector<int> missing;
+	for (int i = 0; i < nPatterns; i++)
+		missing.push_back(i);
+
+	// reuse from the current ones, then from the cache file
+	const QString cacheName = m_inputPatternXmlName + ".desc";
+	for (int pass = 0; pass < 2 && !missing.empty(); pass++)
+	{
+		QStringList srcNames = m_patternDescriptorNames;
+		ldp::Matf srcD = m_patternDescriptors;
+		if (pass == 1 && !loadPatternDescriptors(cacheName, srcNames, srcD))
+			break;
+		if (srcD.cols() != srcNames.size())
+			continue;
+		QHash<QString, int> srcCols;
+		for (int i = 0; i < srcNames.size(); i++)
+			srcCols.insert(srcNames[i], i);
+		std::vector<int> rest;
+		for (int i : missing)
+		{
+			auto iter = srcCols.find(names[i]);
+			if (iter != srcCols.end())
+				D.col(i) = srcD.col(iter.value());
+			else
+				rest.push_back(i);
+		}
+		missing.swap(rest);
+	} // end for pass
+
+	// compute the remaining ones in parallel
+	const int nMissing = (int)missing.size();
+	ldp::parallelFor(0, nMissing, 1, [&](int kb, int ke)
+	{
+		for (int k = kb; k < ke; k++)
+		{
+			const int i = missing[k];
+			if (m_patternInfos[i].numImages())
+				ldp::imageDescriptor(m_patternInfos[i].getImageName(0), D.col(i).data());
+			else
+				D.col(i).setZero();
+		}
+	});
+
+	m_patternDescriptors = D;
+	m_patternDescriptorNames = names;
+	m_patternDescriptorsRevision = m_patternInfosRevision;
+	if (nMissing && !m_inputPatternXmlName.isEmpty())
+	{
+		std::cout << "pattern descriptors computed: " << nMissing << "/" << nPatterns << std::endl;
+		if (!savePatternDescriptors(cacheName, names, D))
+			std::cout << "warning: pattern descriptors not saved: " << cacheName.toStdString() << std::endl;
+	}
+}
+
+void GlobalDataHolder::updatePatternAnnIndex()
+{
+	const int nPatterns = (int)m_patternInfos.size();
+	if (nPatterns < g_patternAnnMinSize || m_patternDescriptors.cols() != nPatterns
+		|| m_inputPatternXmlName.isEmpty())
+		return;
+	const QString annName = m_inputPatternXmlName + ".ann";
+	if (m_patternAnnIndex.filename() != annName)
+	{
+		if (QFileInfo(annName).exists() && !m_patternAnnIndex.open(annName))
+			std::cout << "warning: invalid ann index, rebuilt: " << annName.toStdString() << std::endl;
+	}
+
+	// train once, on the library at that time
+	if (!m_patternAnnIndex.isTrained() || m_patternAnnIndex.dim() != m_patternDescriptors.rows())
+	{
+		const int nList = std::max(16, (int)sqrt((double)nPatterns));
+		std::cout << "training ann index, lists: " << nList << std::endl;
+		m_patternAnnIndex.train(m_patternDescriptors, nList, g_patternAnnSubQuantizers);
+		m_patternAnnIndex.add(m_patternDescriptors, m_patternDescriptorNames);
+		if (!m_patternAnnIndex.save(annName))
+			std::cout << "warning: ann index not saved: " << annName.toStdString() << std::endl;
+		return;
+	}
+
+	// incremental, only new patterns are encoded and appended to the log of the index
+	std::vector<int> cols;
+	QStringList names;
+	for (int i = 0; i < nPatterns; i++)
+	if (!m_patternAnnIndex.contains(m_patternDescriptorNames[i]))
+	{
+		cols.push_back(i);
+		names.push_back(m_patternDescriptorNames[i]);
+	}
+	if (cols.empty())
+		return;
+	ldp::Matf D(m_patternDescriptors.rows(), (int)cols.size());
+	for (size_t i = 0; i < cols.size(); i++)
+		D.col(i) = m_patternDescriptors.col(cols[i]);
+	m_patternAnnIndex.add(D, names);
+}
+
+void GlobalDataHolder::patternSimilarities(const ldp::Matf& query, std::vector<float>& sims)const
+{
+	const int nPatterns = (int)m_patternInfos.size();
+	sims.assign(nPatterns, -1.f);
+	if (m_patternDescriptors.cols() != nPatterns || query.rows() != m_patternDescriptors.rows())
+		return;
+	if (nPatterns < g_patternAnnMinSize || !m_patternAnnIndex.isTrained())
+	{
+		ldp::Matf S;
+		ldp::descriptorSimilarity(m_patternDescriptors, query, S);
+		for (int i = 0; i < nPatterns; i++)
+			sims[i] = S(i, 0);
+		return;
+	}
+
+	// approximate candidates, re-scored exactly; removed patterns are skipped
+	std::vector<int> ids;
+	std::vector<float> dists;
+	m_patternAnnIndex.search(query.data(), g_patternAnnTopK, m_patternAnnProbes, ids, dists);
+	for (int id : ids)
+	{
+		const auto& iter = m_namePatternMap.find(m_patternAnnIndex.key(id));
+		if (iter == m_namePatternMap.end())
+			continue;
+		const int i = int(iter.value().first - m_patternInfos.data());
+		sims[i] = m_patternDescriptors.col(i).dot(query.col(0));
+	}
+}
+
+QString GlobalDataHolder::normalizeUrl(QString url)
+{
+	url = url.trimmed().toLower();
+	int pos = url.indexOf('#');
+	if (pos >= 0)
+		url = url.left(pos);
+	pos = url.indexOf("://");
+	if (pos >= 0)
+		url = url.right(url.size() - pos - 3);
+	if (url.startsWith("www."))
+		url = url.right(url.size() - 4);
+	while (url.endsWith('/'))
+		url.chop(1);
+	return url;
+}
+
+inline int uniquePatterns_findRoot(std::vector<int>& parent, int i)
+{
+	while (parent[i] != i)
+	{
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+void GlobalDataHolder::uniquePatterns(int maxHammingDist)
+{
+	const int nPatterns = (int)m_patternInfos.size();
+	std::cout << "before cleaning: " << nPatterns << std::endl;
+
+	// exact duplicates: the same normalized url, the first one is kept
+	// patterns without url are never treated as duplicates of each other
+	std::vector<bool> keep(nPatterns, true);
+	QHash<QString, int> urlSet;
+	urlSet.reserve(nPatterns);
+	for (int i = 0; i < nPatterns; i++)
+	{
+		QString url = normalizeUrl(m_patternInfos[i].getUrl());
+		if (url.isEmpty())
+			continue;
+		if (urlSet.contains(url))
+			keep[i] = false;
+		else
+			urlSet.insert(url, i);
+	} // end for i
+	int nKept = 0;
+	for (int i = 0; i < nPatterns; i++)
+		nKept += keep[i];
+	std::cout << "url duplicates removed: " << nPatterns - nKept << std::endl;
+
+	// near duplicates: perceptual hashes of all images, computed in parallel
+	std::vector<QPair<int, QString>> images;
+	for (int i = 0; i < nPatterns; i++)
+	{
+		if (!keep[i])
+			continue;
+		const auto& info = m_patternInfos[i];
+		for (int k = 0; k < info.numImages(); k++)
+		if (!info.getImageName(k).endsWith("_label.png"))
+			images.push_back(qMakePair(i, info.getImageName(k)));
+	} // end for i
+	std::vector<ldp::ImageFingerprint> fps(images.size());
+	ldp::parallelFor(0, (int)images.size(), 1, [&](int ib, int ie)
+	{
+		for (int i = ib; i < ie; i++)
+			fps[i] = ldp::imageFingerprint(images[i].second);
+	});
+
+	// group patterns whose images are within maxHammingDist on both pHash and dHash
+	std::vector<int> parent(nPatterns), linkedTo(nPatterns, -1), linkDist(nPatterns, 0);
+	for (int i = 0; i < nPatterns; i++)
+		parent[i] = i;
+	ldp::HashBKTree tree;
+	tree.reserve((int)images.size());
+	std::vector<int> found;
+	for (int i = 0; i < (int)images.size(); i++)
+	{
+		if (!fps[i].isValid())
+			continue;
+		found.clear();
+		tree.query(fps[i].pHash, maxHammingDist, found);
+		for (int j : found)
+		{
+			const int pi = images[i].first, pj = images[j].first;
+			if (pi == pj || ldp::hammingDistance(fps[i].dHash, fps[j].dHash) > maxHammingDist)
+				continue;
+			const int ri = uniquePatterns_findRoot(parent, pi), rj = uniquePatterns_findRoot(parent, pj);
+			if (ri == rj)
+				continue;
+			parent[std::max(ri, rj)] = std::min(ri, rj);
+			if (linkedTo[pi] < 0)
+			{
+				linkedTo[pi] = pj;
+				linkDist[pi] = ldp::hammingDistance(fps[i].pHash, fps[j].pHash);
+			}
+		} // end for j
+		tree.insert(fps[i].pHash, i);
+	} // end for i
+
+	// collect the clusters and report them for review
+	QMap<int, QVector<int>> clusters;
+	for (int i = 0; i < nPatterns; i++)
+	if (keep[i])
+		clusters[uniquePatterns_findRoot(parent, i)].push_back(i);
+	int nClusters = 0, nInClusters = 0;
+	for (const auto& c : clusters)
+	if (c.size() > 1)
+	{
+		nClusters++;
+		nInClusters += c.size();
+	}
+	std::cout << "near-duplicate clusters: " << nClusters << ", patterns involved: " << nInClusters << std::endl;
+	if (nClusters && !m_inputPatternXmlName.isEmpty())
+	{
+		QString reportName = m_inputPatternXmlName + "_duplicates.xml";
+		QFile file(reportName);
+		CHECK_FILE(file.open(QIODevice::WriteOnly), reportName);
+		QXmlStreamWriter writer(&file);
+		writer.setAutoFormatting(true);
+		writer.writeStartDocument();
+		writer.writeStartElement("document");
+		writer.writeTextElement("pattern-xml", m_inputPatternXmlName);
+		int clusterId = 0;
+		for (const auto& c : clusters)
+		{
+			if (c.size() <= 1)
+				continue;
+			writer.writeStartElement("cluster");
+			writer.writeAttribute("id", QString().sprintf("%d", clusterId++));
+			writer.writeAttribute("size", QString().sprintf("%d", c.size()));
+			for (int i : c)
+			{
+				const auto& info = m_patternInfos[i];
+				writer.writeStartElement("pattern");
+				writer.writeAttribute("name", info.getBaseName());
+				if (linkedTo[i] >= 0)
+				{
+					writer.writeAttribute("matched", m_patternInfos[linkedTo[i]].getBaseName());
+					writer.writeAttribute("dist", QString().sprintf("%d", linkDist[i]));
+				}
+				writer.writeTextElement("url", info.getUrl());
+				writer.writeEndElement();
+			} // end for i
+			writer.writeEndElement();
+		} // end for c
+		writer.writeEndElement();
+		writer.writeEndDocument();
+		std::cout << "clusters saved for review: " << reportName.toStdString() << std::endl;
+	} // end if nClusters
+
+	// compact in place, the usage counts of the kept patterns are reused
+	std::vector<int> usage(nPatterns, 0);
+	for (int i = 0; i < nPatterns; i++)
+	{
+		const auto& iter = m_namePatternMap.find(m_patternInfos[i].getBaseName());
+		if (iter != m_namePatternMap.end())
+			usage[i] = iter.value().second;
+	}
+	int n = 0;
+	for (int i = 0; i < nPatterns; i++)
+	{
+		if (!keep[i])
+			continue;
+		if (n != i)
+		{
+			std::swap(m_patternInfos[n], m_patternInfos[i]);
+			usage[n] = usage[i];
+		}
+		n++;
+	}
+	m_patternInfos.erase(m_patternInfos.begin() + n, m_patternInfos.end());
+	patternInfosChanged();
+	m_namePatternMap.clear();
+	for (int i = 0; i < n; i++)
+		m_namePatternMap.insert(m_patternInfos[i].getBaseName(), qMakePair(&m_patternInfos[i], usage[i]));
 	std::cout << "after cleaning: " << m_patternInfos.size() << std::endl;
+	updatePatternDescriptors();
+	updatePatternAnnIndex();
 }
 
 void GlobalDataHolder::exportPatternTrainingData(const QStringList& labeledXmls)
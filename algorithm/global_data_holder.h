@@ -3,6 +3,8 @@
 #include "util.h"
 #include <map>
 #include "PatternImageInfo.h"
+#include "ImageDescriptor.h"
+#include "IvfPqIndex.h"
 
 class GlobalDataHolder
 {
@@ -19,7 +21,28 @@ public:
 	void collect_labelded_patterns(QString folder);
 	void loadPatternXml(QString filename);
 	void savePatternXml(QString filename)const;
-	void uniquePatterns();
+	// remove patterns with the same normalized url, and group those with near-duplicate
+	// images (perceptual hash within @maxHammingDist) into clusters to be reviewed,
+	// the clusters are written to "<pattern xml>_duplicates.xml".
+	void uniquePatterns(int maxHammingDist = 6);
+	// rebuild m_namePatternMap from m_patternInfos and count the usage from m_imgInfos
+	void rebuildNamePatternMap();
+	// to be called after m_patternInfos is changed, otherwise updatePatternDescriptors() keeps the
+	// current descriptors
+	void patternInfosChanged() { m_patternInfosRevision++; }
+
+	// bring m_patternDescriptors in line with m_patternInfos, descriptors are reused by pattern
+	// name, then loaded from "<pattern xml>.desc", and only the remaining ones are computed.
+	void updatePatternDescriptors();
+	// for large libraries, keep the ANN index "<pattern xml>.ann" over m_patternDescriptors in
+	// line with the patterns, it is trained once and then patterns are added incrementally.
+	void updatePatternAnnIndex();
+	// similarity of each pattern to the query descriptor (ImageDescriptorDim x 1), exact for
+	// small libraries; otherwise only the ANN candidates are scored and others are set to -1
+	void patternSimilarities(const ldp::Matf& query, std::vector<float>& sims)const;
+
+	// lower-cased url without scheme, "www.", fragment and trailing '/'
+	static QString normalizeUrl(QString url);
 
 	void exportPatternTrainingData(const QStringList& labeledXmls);
 
@@ -32,6 +55,9 @@ protected:
 	static bool loadXml_qxml(QString filename, QString root, std::vector<PatternImageInfo>& imgInfos);
 	static bool saveXml_qxml(QString filename, QString root, const std::vector<PatternImageInfo>& imgInfos);
 	static void autoSetGenders(std::vector<PatternImageInfo>& infos, QString fileBaseName);
+	// fingerprint the loaded jd images into the index next to the dataset, and copy the
+	// labels and the mapped pattern from near-duplicates already labeled in other batches
+	void transferJdLabelsFromDuplicates(int maxHammingDist = 4);
 public:
 	std::vector<PatternImageInfo> m_imgInfos;
 	QString m_rootPath;
@@ -47,6 +73,15 @@ public:
 	QMap<QString, QPair<PatternImageInfo*,int>> m_namePatternMap;
 	mutable QString m_lastRun_PatternDir;
 	QString m_inputPatternXmlName;
+	// visual descriptors of m_patternInfos, column i for pattern i, see ImageDescriptor.h
+	ldp::Matf m_patternDescriptors;
+	QStringList m_patternDescriptorNames;
+	// of m_patternInfos, and of it when m_patternDescriptors was brought in line
+	int m_patternInfosRevision;
+	int m_patternDescriptorsRevision;
+	ldp::IvfPqIndex m_patternAnnIndex;
+	// lists probed per ANN query, larger for higher recall
+	int m_patternAnnProbes;
 
 	bool m_addPatternMode;
 	bool m_matchByClothTypeOnly;
@@ -302,6 +302,7 @@ namespace ldp
 	LDP_TYPE_PROMOTION_RULES_1(unsigned char,		int								); 
 	LDP_TYPE_PROMOTION_RULES_1(short,				int								); 
 	LDP_TYPE_PROMOTION_RULES_1(unsigned short,		int								); 
+	LDP_TYPE_PROMOTION_RULES_1(half_float::half,	float							); 
 	LDP_TYPE_PROMOTION_RULES_2(char,				unsigned char,				int	);
 	LDP_TYPE_PROMOTION_RULES_2(char,				short,						int	);
 	LDP_TYPE_PROMOTION_RULES_2(char,				unsigned short,				int	);
@@ -1,4 +1,7 @@
 #include "util.h"
+#include "ThreadPool.h"
+#include <random>
+#include <numeric>
 #undef min
 #undef max
 namespace ldp
@@ -104,215 +107,569 @@ namespace ldp
 		return true;
 	}
 
-	void kmeansCenterPP(const Mat& data, std::vector<Vec>& _out_centers, int K, int trials=3)
+	// columns per block of the distance GEMM, bounding the K x block temporary
+	const static int g_kmeansBlockSize = 1024;
+	// k-means|| is used for seeding at least this many centers
+	const static int g_kmeansParallelSeedingMinK = 64;
+
+	// nearest (and optionally second nearest) center of the columns @cols of X, or of all columns if @cols is null
+	// distances are computed by |x|^2 + |c|^2 - 2 C^T X in blocks
+	template<class T>
+	static void kmeansAssign(const Eigen::Matrix<T, -1, -1>& X, const Eigen::Matrix<T, -1, 1>& xNorms,
+		const Eigen::Matrix<T, -1, -1>& C, const int* cols, int nCols, int* best, T* bestDist, T* secondDist)
 	{
-		const int N = data.cols();
-		const int nDim = data.rows();
+		typedef Eigen::Matrix<T, -1, -1> MatT;
+		const int K = C.cols();
+		const Eigen::Matrix<T, -1, 1> cNorms = C.colwise().squaredNorm().transpose();
+		MatT Xb, S;
+		for (int b = 0; b < nCols; b += g_kmeansBlockSize)
+		{
+			const int bn = std::min(g_kmeansBlockSize, nCols - b);
+			if (cols)
+			{
+				Xb.resize(X.rows(), bn);
+				for (int j = 0; j < bn; j++)
+					Xb.col(j) = X.col(cols[b + j]);
+				S.noalias() = C.transpose() * Xb;
+			}
+			else
+				S.noalias() = C.transpose() * X.middleCols(b, bn);
 
-		std::vector<int> centers(K);
-		std::vector<real> _dist(N * 3);
-		real* dist = _dist.data(), *tdist = dist + N, *tdist2 = tdist + N;
-		real sum0 = 0;
+			ldp::parallelFor(0, bn, 0, [&](int jb, int je)
+			{
+				for (int j = jb; j < je; j++)
+				{
+					const T xn = xNorms[cols ? cols[b + j] : b + j];
+					T d1 = std::numeric_limits<T>::max(), d2 = d1;
+					int k1 = 0;
+					for (int k = 0; k < K; k++)
+					{
+						const T d = xn + cNorms[k] - 2 * S(k, j);
+						if (d < d1)
+						{
+							d2 = d1;
+							d1 = d;
+							k1 = k;
+						}
+						else if (d < d2)
+							d2 = d;
+					}
+					best[b + j] = k1;
+					bestDist[b + j] = sqrt(std::max(T(0), d1));
+					if (secondDist)
+						secondDist[b + j] = K > 1 ? sqrt(std::max(T(0), d2)) : std::numeric_limits<T>::max();
+				} // end for j
+			});
+		} // end for b
+	}
 
-		centers[0] = (unsigned)rand() % N;
+	// counter-based uniform number in [0, 1) by splitmix64
+	// it only depends on (seed, counter), thus parallel sampling is reproducible for any thread count.
+	inline double kmeansUniform(unsigned long long seed, unsigned long long counter)
+	{
+		unsigned long long z = seed + (counter + 1) * 0x9E3779B97F4A7C15ULL;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		z = z ^ (z >> 31);
+		return (z >> 11) * (1.0 / 9007199254740992.0);
+	}
 
-		for (int i = 0; i < N; i++)
+	// dist[i] = min(dist[i], |x_i - c|^2), returns the (weighted) sum of the updated distances
+	// the block-wise colwise expressions are vectorized by Eigen.
+	template<class T>
+	static double kmeansUpdateMinDist(const Eigen::Matrix<T, -1, -1>& X, const Eigen::Matrix<T, -1, 1>& c,
+		const T* weights, const T* dist, T* newDist)
+	{
+		const int N = X.cols();
+		const int nBlocks = (N + g_kmeansBlockSize - 1) / g_kmeansBlockSize;
+		// per-block sums added in order, independent of the thread count
+		std::vector<double> blockSums(nBlocks);
+		ldp::parallelFor(0, nBlocks, 1, [&](int bb, int be)
 		{
-			dist[i] = (data.col(i) - data.col(centers[0])).lpNorm<2>();
-			sum0 += dist[i];
-		}
+			for (int b = bb; b < be; b++)
+			{
+				const int i0 = b * g_kmeansBlockSize;
+				const int bn = std::min(g_kmeansBlockSize, N - i0);
+				Eigen::Map<Eigen::Matrix<T, -1, 1>> nd(newDist + i0, bn);
+				nd = (X.middleCols(i0, bn).colwise() - c).colwise().squaredNorm().transpose();
+				nd = nd.cwiseMin(Eigen::Map<const Eigen::Matrix<T, -1, 1>>(dist + i0, bn));
+				if (weights)
+					blockSums[b] = nd.dot(Eigen::Map<const Eigen::Matrix<T, -1, 1>>(weights + i0, bn));
+				else
+					blockSums[b] = nd.sum();
+			}
+		});
+		return std::accumulate(blockSums.begin(), blockSums.end(), 0.0);
+	}
+
+	// index i with prefix[i] > u * prefix.back(), by binary search
+	inline int kmeansSampleByPrefix(const std::vector<double>& prefix, double u)
+	{
+		const double t = u * prefix.back();
+		const int i = int(std::upper_bound(prefix.begin(), prefix.end(), t) - prefix.begin());
+		return std::min(i, (int)prefix.size() - 1);
+	}
+
+	// greedy k-means++ (Arthur 2007): D^2 (times @weights if given) sampling with 2 + log(K) trials per center,
+	// keeping the trial that decreases the cost most. K <= N, and once every point coincides with a seed
+	// the remaining ones are the first points not chosen yet, thus the seeds are always distinct.
+	template<class T>
+	static void kmeansPlusPlus(const Eigen::Matrix<T, -1, -1>& X, const T* weights, int K,
+		std::vector<int>& seeds, std::mt19937& rng)
+	{
+		const int N = X.cols();
+		const int trials = 2 + (int)log((double)std::max(K, 1));
+		std::uniform_real_distribution<double> uniform(0.0, 1.0);
+		std::vector<double> prefix(N);
+		std::vector<T> dist(N, std::numeric_limits<T>::max()), tdist(N), bestDist(N);
+		std::vector<char> chosen(N, 0);
+		int unchosen = 0;
+		seeds.clear();
+
+		// the first one by the weights only
+		double sum = 0;
+		for (int i = 0; i < N; i++)
+			prefix[i] = (sum += weights ? weights[i] : T(1));
+		int c = kmeansSampleByPrefix(prefix, uniform(rng));
+		seeds.push_back(c);
+		chosen[c] = 1;
+		kmeansUpdateMinDist<T>(X, X.col(c), weights, dist.data(), dist.data());
 
 		for (int k = 1; k < K; k++)
 		{
-			real bestSum = std::numeric_limits<real>::max();
-			int bestCenter = -1;
+			sum = 0;
+			for (int i = 0; i < N; i++)
+				prefix[i] = (sum += weights ? weights[i] * dist[i] : dist[i]);
 
-			for (int j = 0; j < trials; j++)
+			// all remaining points coincide with the chosen ones: take the next unused point
+			if (sum <= 0)
 			{
-				real p = ((real)rand()) / real(RAND_MAX *sum0), s = 0;
-
-				int best_i = 0;
-				for (best_i = 0; best_i < N - 1; best_i++)
-				if ((p -= dist[best_i]) <= 0)
-					break;
-				int ci = best_i;
-				for (int i = 0; i < N; i++)
+				while (chosen[unchosen])
+					unchosen++;
+				seeds.push_back(unchosen);
+				chosen[unchosen] = 1;
+				continue;
+			}
+			double bestCost = std::numeric_limits<double>::max();
+			int bestC = -1;
+			for (int t = 0; t < trials; t++)
+			{
+				c = kmeansSampleByPrefix(prefix, uniform(rng));
+				const double tcost = kmeansUpdateMinDist<T>(X, X.col(c), weights, dist.data(), tdist.data());
+				if (tcost < bestCost)
 				{
-					tdist2[i] = std::min((data.col(i) - data.col(ci)).norm(), dist[i]);
-					s += tdist2[i];
+					bestCost = tcost;
+					bestC = c;
+					bestDist.swap(tdist);
 				}
+			} // end for t
+			seeds.push_back(bestC);
+			chosen[bestC] = 1;
+			dist.swap(bestDist);
+		} // end for k
+	}
 
-				if (s < bestSum)
+	// k-means|| (Bahmani 2012): a few rounds sample each point independently with probability
+	// l * d^2 / cost, l = 2K, in parallel; the candidates are weighted by the points closest to
+	// them, tracked along the rounds, and reduced to K seeds by weighted k-means++.
+	template<class T>
+	static void kmeansParallelSeeding(const Eigen::Matrix<T, -1, -1>& X, int K, std::vector<int>& seeds,
+		unsigned int randSeed)
+	{
+		typedef Eigen::Matrix<T, -1, -1> MatT;
+		typedef Eigen::Matrix<T, -1, 1> VecT;
+		const int N = X.cols();
+		const int nRounds = 5;
+		const double l = 2.0 * K;
+		std::mt19937 rng(randSeed);
+
+		std::vector<int> cands, owner(N, 0);
+		std::vector<T> dist(N, std::numeric_limits<T>::max());
+		cands.push_back(std::uniform_int_distribution<int>(0, N - 1)(rng));
+		double cost = kmeansUpdateMinDist<T>(X, X.col(cands[0]), nullptr, dist.data(), dist.data());
+
+		const VecT xNorms = X.colwise().squaredNorm().transpose();
+		std::vector<char> picked(N);
+		std::vector<int> best(N);
+		std::vector<T> bestDist(N);
+		for (int r = 0; r < nRounds && cost > 0; r++)
+		{
+			const unsigned long long roundSeed = randSeed + 0x5851F42D4C957F2DULL * (r + 1);
+			ldp::parallelFor(0, N, 0, [&](int ib, int ie)
+			{
+				for (int i = ib; i < ie; i++)
+					picked[i] = kmeansUniform(roundSeed, i) * cost < l * dist[i];
+			});
+			std::vector<int> newCands;
+			for (int i = 0; i < N; i++)
+			if (picked[i])
+				newCands.push_back(i);
+			if (newCands.empty())
+				continue;
+
+			// distances to the new candidates by blocked GEMM
+			MatT C(X.rows(), (int)newCands.size());
+			for (int j = 0; j < (int)newCands.size(); j++)
+				C.col(j) = X.col(newCands[j]);
+			kmeansAssign(X, xNorms, C, nullptr, N, best.data(), bestDist.data(), (T*)nullptr);
+			cost = 0;
+			for (int i = 0; i < N; i++)
+			{
+				const T d = bestDist[i] * bestDist[i];
+				if (d < dist[i])
 				{
-					bestSum = s;
-					bestCenter = ci;
-					std::swap(tdist, tdist2);
+					dist[i] = d;
+					owner[i] = (int)cands.size() + best[i];
 				}
+				cost += dist[i];
 			}
-			centers[k] = bestCenter;
-			sum0 = bestSum;
-			std::swap(dist, tdist);
+			cands.insert(cands.end(), newCands.begin(), newCands.end());
+		} // end for r
+
+		// too few distinct candidates, E.G., heavily duplicated data
+		if ((int)cands.size() <= K)
+		{
+			kmeansPlusPlus<T>(X, nullptr, K, seeds, rng);
+			return;
 		}
 
+		// reduced by weighted k-means++
+		MatT C(X.rows(), (int)cands.size());
+		for (int j = 0; j < (int)cands.size(); j++)
+			C.col(j) = X.col(cands[j]);
+		std::vector<T> weights(cands.size(), T(0));
+		for (int i = 0; i < N; i++)
+			weights[owner[i]] += T(1);
+		std::vector<int> local;
+		kmeansPlusPlus<T>(C, weights.data(), K, local, rng);
+		seeds.resize(K);
 		for (int k = 0; k < K; k++)
+			seeds[k] = cands[local[k]];
+	}
+
+	template<class T>
+	static void kmeansSeeding_t(const Eigen::Matrix<T, -1, -1>& Data, int K, std::vector<int>& seeds,
+		unsigned int randSeed)
+	{
+		const int N = Data.cols();
+		if (K < 0 || K > N)
+			throw std::runtime_error("K outof range in kmeansSeeding()");
+		seeds.clear();
+		if (K == 0)
+			return;
+		if (K >= g_kmeansParallelSeedingMinK && N >= 20 * K)
+			kmeansParallelSeeding(Data, K, seeds, randSeed);
+		else
 		{
-			if (centers[k] < 0)
-				throw std::runtime_error("kmeans init failed!");
-			_out_centers[k] = data.col(centers[k]);
+			std::mt19937 rng(randSeed);
+			kmeansPlusPlus<T>(Data, nullptr, K, seeds, rng);
 		}
 	}
 
-	void kmeans(const Mat& Data, int K, std::vector<int>& dataClusterId,
-		std::vector<Vec>& dataCenters,
-		int nMaxIter, bool useRandInit, bool showInfo)
+	// centers as the means of their clusters, by partial sums over one contiguous part per thread
+	// an empty cluster takes the farthest point of the biggest cluster, whose bounds are reset then.
+	template<class T>
+	static void kmeansUpdateCenters(const Eigen::Matrix<T, -1, -1>& Data, std::vector<int>& dataClusterId,
+		Eigen::Matrix<T, -1, -1>& centers, std::vector<T>& upper, std::vector<T>& lower)
 	{
+		typedef Eigen::Matrix<T, -1, -1> MatT;
 		const int nData = Data.cols();
 		const int nDim = Data.rows();
-		if (K< 0 || K>nData)
-			throw std::runtime_error("K outof range in kmeans()");
-
-		// prepare
-		dataClusterId.resize(nData, -1);
-
-		Mat distMat;
-		distMat.resize(nData, K);
-		distMat.setZero();
-
-		std::vector<Vec> oldCenterPoints;
-		std::vector<int> counters(K);
-		dataCenters.resize(K);
-		for (int i = 0; i < K; i++)
-			dataCenters[i].resize(nDim);
-		oldCenterPoints = dataCenters;
-
-		real max_center_shift = 0;
-		Vec temp;
-		temp.resize(nDim);
-
-
-		// kmeans iteration
-		for (int iter = 0; iter < nMaxIter; iter++)
+		const int K = centers.cols();
+		const int nThreads = std::max(1, std::min(ThreadPool::instance().maxThreads(), nData / 1024));
+		std::vector<MatT> sums(nThreads, MatT::Zero(nDim, K));
+		std::vector<std::vector<int>> counts(nThreads, std::vector<int>(K, 0));
+		ldp::parallelFor(0, nThreads, 1, [&](int tb, int te)
 		{
-			if (iter == 0)
+			for (int t = tb; t < te; t++)
 			{
-				if (useRandInit)
+				MatT& sum = sums[t];
+				std::vector<int>& count = counts[t];
+				for (int i = nData * t / nThreads; i < nData * (t + 1) / nThreads; i++)
 				{
-					for (int i = 0; i < K; i++)
-					{
-						int pid = rand() % nData;
-						dataCenters[i] = Data.col(i);
-					}
-					if (showInfo)
-						printf("kmeans: rand init\n");
+					const int k = dataClusterId[i];
+					sum.col(k) += Data.col(i);
+					count[k]++;
 				}
-				else
+			}
+		});
+		MatT& sum = sums[0];
+		std::vector<int>& counters = counts[0];
+		for (int t = 1; t < nThreads; t++)
+		{
+			sum += sums[t];
+			for (int k = 0; k < K; k++)
+				counters[k] += counts[t][k];
+		}
+
+		for (int k = 0; k < K; k++)
+		{
+			if (counters[k] != 0)
+				continue;
+			int max_k = 0;
+			for (int k1 = 1; k1 < K; k1++)
+			{
+				if (counters[max_k] < counters[k1])
+					max_k = k1;
+			}
+			const Eigen::Matrix<T, -1, 1> max_center = sum.col(max_k) / T(counters[max_k]);
+			T max_dist = 0;
+			int farthest_i = -1;
+			for (int i = 0; i < nData; i++)
+			{
+				if (dataClusterId[i] != max_k)
+					continue;
+				const T dist = (Data.col(i) - max_center).squaredNorm();
+				if (max_dist <= dist)
 				{
-					kmeansCenterPP(Data, dataCenters, K);
-					if (showInfo)
-						printf("kmeans: best init\n");
+					max_dist = dist;
+					farthest_i = i;
 				}
-			}//end if iter==0
-			else
+			}
+			counters[max_k]--;
+			counters[k]++;
+			dataClusterId[farthest_i] = k;
+			sum.col(max_k) -= Data.col(farthest_i);
+			sum.col(k) += Data.col(farthest_i);
+			upper[farthest_i] = 0;
+			lower[farthest_i] = 0;
+		}//end for k
+
+		for (int k = 0; k < K; k++)
+			centers.col(k) = sum.col(k) / T(counters[k]);
+	}
+
+	template<class T>
+	static void kmeans_t(const Eigen::Matrix<T, -1, -1>& Data, int K, std::vector<int>& dataClusterId,
+		Eigen::Matrix<T, -1, -1>& centers, int nMaxIter, bool useRandInit, bool showInfo, unsigned int randSeed)
+	{
+		typedef Eigen::Matrix<T, -1, -1> MatT;
+		typedef Eigen::Matrix<T, -1, 1> VecT;
+		const int nData = Data.cols();
+		const int nDim = Data.rows();
+		if (K < 0 || K > nData)
+			throw std::runtime_error("K outof range in kmeans()");
+		dataClusterId.assign(nData, -1);
+		centers.resize(nDim, K);
+		if (K == 0)
+			return;
+
+		// init
+		std::vector<int> seeds(K);
+		if (useRandInit)
+		{
+			// K distinct points by a partial Fisher-Yates shuffle
+			std::mt19937 rng(randSeed);
+			std::vector<int> perm(nData);
+			for (int i = 0; i < nData; i++)
+				perm[i] = i;
+			for (int i = 0; i < K; i++)
+			{
+				const int pid = std::uniform_int_distribution<int>(i, nData - 1)(rng);
+				std::swap(perm[i], perm[pid]);
+				seeds[i] = perm[i];
+			}
+			if (showInfo)
+				printf("kmeans: rand init\n");
+		}
+		else
+		{
+			kmeansSeeding_t(Data, K, seeds, randSeed);
+			if (showInfo)
+				printf("kmeans: best init\n");
+		}
+		for (int k = 0; k < K; k++)
+			centers.col(k) = Data.col(seeds[k]);
+
+		// Hamerly's bounds: upper on the distance to the assigned center,
+		// lower on the distance to any other center
+		const VecT xNorms = Data.colwise().squaredNorm().transpose();
+		std::vector<T> upper(nData), lower(nData);
+		kmeansAssign(Data, xNorms, centers, nullptr, nData, dataClusterId.data(), upper.data(), lower.data());
+		if (showInfo)
+			printf("kmeans: iter = %d, changed = %d\n", 0, nData);
+
+		MatT oldCenters, CC;
+		VecT shift, half(K);
+		std::vector<char> needScan(nData);
+		std::vector<int> active, activeBest;
+		std::vector<T> activeUpper, activeLower;
+		for (int iter = 1; iter < nMaxIter; iter++)
+		{
+			oldCenters = centers;
+			kmeansUpdateCenters(Data, dataClusterId, centers, upper, lower);
+
+			// loosen the bounds by the center shifts
+			shift = (centers - oldCenters).colwise().norm().transpose();
+			int maxShiftK = 0;
+			for (int k = 1; k < K; k++)
+			if (shift[k] > shift[maxShiftK])
+				maxShiftK = k;
+			T maxShift2 = 0;
+			for (int k = 0; k < K; k++)
+			if (k != maxShiftK)
+				maxShift2 = std::max(maxShift2, shift[k]);
+			const T maxShift = shift[maxShiftK];
+
+			// half the distance of each center to its nearest other one
+			const VecT cNorms = centers.colwise().squaredNorm().transpose();
+			CC.noalias() = centers.transpose() * centers;
+			for (int k = 0; k < K; k++)
 			{
-				// compute centers
-				std::fill(counters.begin(), counters.end(), int(0));
-				for (int i_c = 0; i_c < dataCenters.size(); i_c++)
-					dataCenters[i_c].setZero();
+				T d = std::numeric_limits<T>::max();
+				for (int j = 0; j < K; j++)
+				if (j != k)
+					d = std::min(d, cNorms[k] + cNorms[j] - 2 * CC(j, k));
+				half[k] = K > 1 ? T(0.5) * sqrt(std::max(T(0), d)) : std::numeric_limits<T>::max();
+			}
 
-				for (int i_data = 0; i_data < nData; i_data++)
+			// points that cannot be proven to stay, even with a tightened upper bound
+			ldp::parallelFor(0, nData, 0, [&](int ib, int ie)
+			{
+				for (int i = ib; i < ie; i++)
 				{
-					int k = dataClusterId[i_data];
-					dataCenters[k] += Data.col(i_data);
-					counters[k]++;
+					const int a = dataClusterId[i];
+					upper[i] += shift[a];
+					lower[i] -= a == maxShiftK ? maxShift2 : maxShift;
+					const T m = std::max(half[a], lower[i]);
+					needScan[i] = 0;
+					if (upper[i] <= m)
+						continue;
+					upper[i] = (Data.col(i) - centers.col(a)).norm();
+					needScan[i] = upper[i] > m;
 				}
+			});
+			active.clear();
+			for (int i = 0; i < nData; i++)
+			if (needScan[i])
+				active.push_back(i);
+
+			// full assignment of the remaining points
+			const int nActive = (int)active.size();
+			activeBest.resize(nActive);
+			activeUpper.resize(nActive);
+			activeLower.resize(nActive);
+			kmeansAssign(Data, xNorms, centers, active.data(), nActive, activeBest.data(),
+				activeUpper.data(), activeLower.data());
+			int numChanged = 0;
+			for (int j = 0; j < nActive; j++)
+			{
+				const int i = active[j];
+				if (dataClusterId[i] != activeBest[j])
+					numChanged++;
+				dataClusterId[i] = activeBest[j];
+				upper[i] = activeUpper[j];
+				lower[i] = activeLower[j];
+			}
 
-				if (iter > 0)
-					max_center_shift = 0;
+			if (showInfo)
+				printf("kmeans: iter = %d, scanned = %d, changed = %d\n", iter, nActive, numChanged);
+			if (numChanged == 0)
+				break;
+		}//end for iter
+	}
 
-				for (int k = 0; k < K; k++)
-				{
-					if (counters[k] != 0)
-						continue;
+	template<class T>
+	static void kmeansMiniBatch_t(const Eigen::Matrix<T, -1, -1>& Data, int K, std::vector<int>& dataClusterId,
+		Eigen::Matrix<T, -1, -1>& centers, int batchSize, int nMaxIter, bool showInfo, unsigned int randSeed)
+	{
+		typedef Eigen::Matrix<T, -1, -1> MatT;
+		typedef Eigen::Matrix<T, -1, 1> VecT;
+		const int nData = Data.cols();
+		const int nDim = Data.rows();
+		if (K < 0 || K > nData)
+			throw std::runtime_error("K outof range in kmeansMiniBatch()");
+		dataClusterId.assign(nData, -1);
+		centers.resize(nDim, K);
+		if (K == 0)
+			return;
+		batchSize = std::max(1, std::min(batchSize, nData));
+		std::mt19937 rng(randSeed);
+
+		// seeding on a random subset
+		const int nSeedData = std::min(nData, std::max(batchSize, 8 * K));
+		std::vector<int> perm(nData);
+		for (int i = 0; i < nData; i++)
+			perm[i] = i;
+		for (int i = 0; i < nSeedData; i++)
+			std::swap(perm[i], perm[std::uniform_int_distribution<int>(i, nData - 1)(rng)]);
+		MatT seedData(nDim, nSeedData);
+		for (int i = 0; i < nSeedData; i++)
+			seedData.col(i) = Data.col(perm[i]);
+		std::vector<int> seeds;
+		kmeansSeeding_t(seedData, K, seeds, randSeed);
+		for (int k = 0; k < K; k++)
+			centers.col(k) = seedData.col(seeds[k]);
 
-					// if some cluster appeared to be empty then:
-					//   1. find the biggest cluster
-					//   2. find the farthest from the center point in the biggest cluster
-					//   3. exclude the farthest point from the biggest cluster and form a new 1-point cluster.
-					int max_k = 0;
-					for (int k1 = 1; k1 < K; k1++)
-					{
-						if (counters[max_k] < counters[k1])
-							max_k = k1;
-					}
+		// each center moves towards its batch samples with rate 1 / (samples seen so far)
+		const VecT xNorms = Data.colwise().squaredNorm().transpose();
+		std::vector<int> counts(K, 0), batch(batchSize), batchBest(batchSize);
+		std::vector<T> batchDist(batchSize);
+		std::uniform_int_distribution<int> sampler(0, nData - 1);
+		for (int iter = 0; iter < nMaxIter; iter++)
+		{
+			for (int j = 0; j < batchSize; j++)
+				batch[j] = sampler(rng);
+			kmeansAssign(Data, xNorms, centers, batch.data(), batchSize, batchBest.data(),
+				batchDist.data(), (T*)nullptr);
+			for (int j = 0; j < batchSize; j++)
+			{
+				const int k = batchBest[j];
+				counts[k]++;
+				centers.col(k) += (Data.col(batch[j]) - centers.col(k)) / T(counts[k]);
+			}
+			if (showInfo && (iter % 10 == 0 || iter == nMaxIter - 1))
+				printf("kmeans mini-batch: iter = %d, batch cost = %f\n", iter,
+				double(std::accumulate(batchDist.begin(), batchDist.end(), T(0)) / batchSize));
+		}//end for iter
 
-					double max_dist = 0;
-					int farthest_i = -1;
-					Vec& new_center = dataCenters[k];
-					Vec& old_center = dataCenters[max_k];
-					Vec& _old_center = temp; // normalized
-					//float scale = 1.f/counters[max_k];
-					_old_center /= real(counters[max_k]);
+		std::vector<T> dist(nData);
+		kmeansAssign(Data, xNorms, centers, nullptr, nData, dataClusterId.data(), dist.data(), (T*)nullptr);
+	}
 
-					for (int i_data = 0; i_data < nData; i_data++)
-					{
-						if (dataClusterId[i_data] != max_k)
-							continue;
-						const Vec& sample = Data.col(i_data);
-						real dist = (sample - _old_center).norm();
+	void kmeansSeeding(const Mat& Data, int K, std::vector<int>& seeds, unsigned int randSeed)
+	{
+		kmeansSeeding_t(Data, K, seeds, randSeed);
+	}
 
-						if (max_dist <= dist)
-						{
-							max_dist = dist;
-							farthest_i = i_data;
-						}
-					}
+	void kmeansSeeding(const Matf& Data, int K, std::vector<int>& seeds, unsigned int randSeed)
+	{
+		kmeansSeeding_t(Data, K, seeds, randSeed);
+	}
 
-					counters[max_k]--;
-					counters[k]++;
-					dataClusterId[farthest_i] = k;
-					const Vec& sample = Data.col(farthest_i);
+	void kmeans(const Mat& Data, int K, std::vector<int>& dataClusterId, Mat& centers,
+		int nMaxIter, bool useRandInit, bool showInfo, unsigned int randSeed)
+	{
+		kmeans_t(Data, K, dataClusterId, centers, nMaxIter, useRandInit, showInfo, randSeed);
+	}
 
-					old_center -= sample;
-					new_center += sample;
-				}//end for k
+	void kmeans(const Matf& Data, int K, std::vector<int>& dataClusterId, Matf& centers,
+		int nMaxIter, bool useRandInit, bool showInfo, unsigned int randSeed)
+	{
+		kmeans_t(Data, K, dataClusterId, centers, nMaxIter, useRandInit, showInfo, randSeed);
+	}
 
-				for (int k = 0; k < K; k++)
-				{
-					Vec& center = dataCenters[k];
-					center /= real(counters[k]);
-					const Vec& old_center = oldCenterPoints[k];
-					real dist = (center - old_center).norm();
-					max_center_shift = std::max(max_center_shift, dist);
-				}//end for k
-			}//end else iter!=0
-
-			// assign labels
-			int numChanged = 0;
-			for (int i_data = 0; i_data < nData; i_data++)
-			{
-				const Vec& sample = Data.col(i_data);
-				int k_best = 0;
-				real min_dist = std::numeric_limits<real>::max();
+	void kmeans(const Mat& Data, int K, std::vector<int>& dataClusterId,
+		std::vector<Vec>& dataCenters,
+		int nMaxIter, bool useRandInit, bool showInfo)
+	{
+		// seeded by rand() as before, so srand() still controls it
+		Mat centers;
+		kmeans_t(Data, K, dataClusterId, centers, nMaxIter, useRandInit, showInfo, (unsigned int)rand());
+		dataCenters.resize(K);
+		for (int k = 0; k < K; k++)
+			dataCenters[k] = centers.col(k);
+	}
 
-				for (int k = 0; k < K; k++)
-				{
-					const Vec& center = dataCenters[k];
-					real dist = (center - sample).norm();
-					if (min_dist > dist)
-					{
-						min_dist = dist;
-						k_best = k;
-					}
-				}//end for k
-				if (dataClusterId[i_data] != k_best)
-					numChanged++;
-				dataClusterId[i_data] = k_best;
-			}//end for i, assign labels
+	void kmeansMiniBatch(const Mat& Data, int K, std::vector<int>& dataClusterId, Mat& centers,
+		int batchSize, int nMaxIter, bool showInfo, unsigned int randSeed)
+	{
+		kmeansMiniBatch_t(Data, K, dataClusterId, centers, batchSize, nMaxIter, showInfo, randSeed);
+	}
 
-			if (showInfo)
-				printf("kmeans: iter = %d, changed = %d\n", iter, numChanged);
-			if (numChanged == 0)
-				break;
-		}//end for iter
+	void kmeansMiniBatch(const Matf& Data, int K, std::vector<int>& dataClusterId, Matf& centers,
+		int batchSize, int nMaxIter, bool showInfo, unsigned int randSeed)
+	{
+		kmeansMiniBatch_t(Data, K, dataClusterId, centers, batchSize, nMaxIter, showInfo, randSeed);
 	}
 }
\ No newline at end of file
@@ -601,6 +601,29 @@ namespace ldp
 		std::vector<Vec>& dataCenters,
 		int nMaxIter=10, bool useRandInit = false, bool showInfo=false);
 
+	// kmeans with contiguous centers, @centers: nDim x k, a column per center
+	// distances are by blocked GEMM, and Hamerly's bounds skip the points that cannot
+	// change their cluster; the float version is preferred for large descriptor sets.
+	// the result is reproducible for a given @randSeed.
+	void kmeans(const Mat& Data, int k, std::vector<int>& dataClusterId, Mat& centers,
+		int nMaxIter = 10, bool useRandInit = false, bool showInfo = false, unsigned int randSeed = 0);
+	void kmeans(const Matf& Data, int k, std::vector<int>& dataClusterId, Matf& centers,
+		int nMaxIter = 10, bool useRandInit = false, bool showInfo = false, unsigned int randSeed = 0);
+
+	// mini-batch kmeans (Sculley 2010) for data too large for full iterations
+	// each iteration moves the centers towards @batchSize random samples, with per-center rates
+	void kmeansMiniBatch(const Mat& Data, int k, std::vector<int>& dataClusterId, Mat& centers,
+		int batchSize = 4096, int nMaxIter = 100, bool showInfo = false, unsigned int randSeed = 0);
+	void kmeansMiniBatch(const Matf& Data, int k, std::vector<int>& dataClusterId, Matf& centers,
+		int batchSize = 4096, int nMaxIter = 100, bool showInfo = false, unsigned int randSeed = 0);
+
+	// indices of @k columns of @Data as the initial centers of kmeans
+	//	small k: greedy k-means++
+	//	large k: k-means|| (Bahmani 2012), a few parallel oversampling rounds reduced by weighted k-means++
+	// the result only depends on @randSeed, not on the number of threads.
+	void kmeansSeeding(const Mat& Data, int k, std::vector<int>& seeds, unsigned int randSeed = 0);
+	void kmeansSeeding(const Matf& Data, int k, std::vector<int>& seeds, unsigned int randSeed = 0);
+
 
 	class TimeStamp
 	{
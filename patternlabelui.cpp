@@ -5,7 +5,6 @@
 #include <QFileDialog>
 #include <QRadioButton>
 #include <QGridLayout>
-#include <QPixmapCache>
 #include <QThread>
 #include <QMutex>
 #include <QShortcut>
@@ -520,7 +519,14 @@ void PatternLabelUI::updateByIndex(int index, int imgId)
 	g_dataholder.m_lastRun_imgId = g_dataholder.m_curIndex;
 	const auto& info = g_dataholder.m_imgInfos.at(g_dataholder.m_curIndex);
 	g_dataholder.m_curIndex_imgIndex = (imgId + info.numImages()) % info.numImages();
-	ui.widget->setColorImage(info.getImage(g_dataholder.m_curIndex_imgIndex)->toImage());
+	const QString imgName = info.getImageName(g_dataholder.m_curIndex_imgIndex);
+	ui.widget->setColorImage(PatternImageInfo::getImage(imgName, ui.widget->size() * ui.widget->devicePixelRatio()),
+		imgName);
+	QString labelMask;
+	for (int i = 0; i < info.numImages(); i++)
+	if (i != g_dataholder.m_curIndex_imgIndex && info.getImageName(i).endsWith("_label.png", Qt::CaseInsensitive))
+		labelMask = info.getImageName(i);
+	ui.widget->setLabelMask(labelMask);
 
 	QVector<QString> typeNames = PatternImageInfo::attributeNames();
 	for (auto name : typeNames)
@@ -616,9 +622,12 @@ void PatternLabelUI::on_pbAddPattern_clicked()
 			return;
 		const auto& info = g_dataholder.m_imgInfos[g_dataholder.m_curIndex];
 		g_dataholder.m_patternInfos.push_back(info);
+		g_dataholder.patternInfosChanged();
 		g_dataholder.m_namePatternMap.clear();
 		for (auto& pattern : g_dataholder.m_patternInfos)
 			g_dataholder.m_namePatternMap.insert(pattern.getBaseName(), qMakePair(&pattern, 0));
+		g_dataholder.updatePatternDescriptors();
+		g_dataholder.updatePatternAnnIndex();
 		if (!m_patternWindow->isHidden())
 			m_patternWindow->updateImages();
 	} catch (std::exception e)